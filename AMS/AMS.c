@@ -14,9 +14,20 @@
 #include "../API/API.h"
 #include "../DBus/DBus-utils.h"
 #include "../Codec/DBusCodec.h"
+#include "../Tracing/probes.h"
+#include "../Tracing/memstats.h"
+#include "../Store/Store.h"
+#include "../DF/DF.h"
+#include "../DF/DFSubscription.h"
+#include "../MTS/MTS.h"
+#include "../Snapshot/snapshot.h"
 #include <stdlib.h>
 #include <string.h>
 
+AID* lookupName(GArray* index, GString* name);
+GArray* searchIndex(GArray* index, char* pattern, int maxResults);
+void freeAMSEntry(gpointer data);
+
 /* Function required by the D-Bus protocol but is not used in this apllication
  */
 void AMSUnregFunction(DBusConnection* conn, void* user_data) {
@@ -100,17 +111,18 @@ void handleModify(DBusMessage* msg) {
 	g_string_free(temp, TRUE);
 	
 	//now perform the modify
-	
-	//check to make sure that the agent exists
-	int index = AMS_agentExists(id->name);
+	APError error;
+	APErrorInit(&error);
+	AMS_modify(id, &error);
 	GString* retVal;
-	if (index == -1) {
-		retVal = g_string_new(ERROR_AGENT_DOES_NOT_EXIST);
+	if (APErrorIsSet(error)) {
+		retVal = g_string_new(error.message->str);
 		g_message("AMS: Agent not found in registry");
+		APErrorFree(&error);
+		AIDFree(*id);
+		AP_FREE(id);
 	}
 	else {
-		g_array_remove_index(theAMS.agentDirectory, index);
-		g_array_append_val(theAMS.agentDirectory, id);
 		retVal = g_string_new(RETURN_OK);
 		g_message("AMS: Modify complete");
 	}
@@ -134,8 +146,9 @@ void handleModify(DBusMessage* msg) {
  * 
  * msg: the DBusMessage object that holds the request message sent by the agent
  * that must implement the AMS search conversation protocol using the DBusCodec
+ * index: the name index to search, either the live one or a published copy
  */
-void handleSearch(DBusMessage* msg) {
+void handleSearch(DBusMessage* msg, GArray* index) {
 	DBusMessage* reply;
 	
 	//get the content of the message
@@ -147,10 +160,9 @@ void handleSearch(DBusMessage* msg) {
 	
 	//now perform the search	
 	GString* str = g_string_new(name);
-	int index = AMS_agentExists(str);
+	AID* id = lookupName(index, str);
 	GArray* results = g_array_new(FALSE, FALSE, sizeof(AID*));
-	if (index != -1) {
-		AID* id = g_array_index(theAMS.agentDirectory, AID*, index);
+	if (id != NULL) {
 		g_array_append_val(results, id);
 	}
 	
@@ -166,6 +178,93 @@ void handleSearch(DBusMessage* msg) {
 	dbus_connection_flush(theAMS.configuration->connection);	
 }
 
+/* Handles a request to resolve many agent names at once.  The reply holds one identifier
+ * for each name in the same order as the request, a name that is not registered gets an
+ * empty identifier.  Only the names that are in the message are resolved whatever count
+ * it claims to hold
+ * 
+ * msg: the DBusMessage object that holds the number of names followed by the names
+ * index: the name index to search, either the live one or a published copy
+ */
+void handleSearchBatch(DBusMessage* msg, GArray* index) {
+	DBusMessage* reply;
+	
+	//get the content of the message
+	DBusMessageIter iter;
+	dbus_message_iter_init(msg, &iter);
+	int count = decodeInt(&iter);
+	if (count < 0) count = 0;
+	g_message("AMS: resolving %d names", count);
+	
+	//look up each of the names
+	GArray* results = g_array_new(FALSE, FALSE, sizeof(AID*));
+	int i;
+	for (i=0; i<count; i++) {
+		//the count comes from the sender so stop at the end of the names actually sent
+		if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_STRING) break;
+		GString* name = decodeString(&iter);
+		dbus_message_iter_next(&iter);
+		AID* id = NULL;
+		if (name != NULL) {
+			id = lookupName(index, name);
+			g_string_free(name, TRUE);
+		}
+		g_array_append_val(results, id);
+	}
+	
+	//build the reply to the message
+	reply = dbus_message_new_method_return(msg);
+	DBusMessageIter replyIter;
+	dbus_message_iter_init_append(reply, &replyIter);
+	encodeAIDArray(&replyIter, results);
+	
+	//send the reply back
+	dbus_connection_send(theAMS.configuration->connection, reply, NULL);
+	dbus_connection_flush(theAMS.configuration->connection);	
+	dbus_message_unref(reply);
+	g_array_free(results, TRUE);
+}
+
+/* Handles a search for all of the agents whose names match a pattern
+ * 
+ * msg: the DBusMessage object that holds the pattern followed by the maximum number of
+ * 	results wanted
+ * index: the name index to search, either the live one or a published copy
+ */
+void handleSearchPattern(DBusMessage* msg, GArray* index) {
+	DBusMessage* reply;
+	
+	//get the content of the message
+	DBusMessageIter iter;
+	dbus_message_iter_init(msg, &iter);
+	GString* pattern = decodeString(&iter);
+	dbus_message_iter_next(&iter);
+	int maxResults = decodeInt(&iter);
+	
+	GArray* results;
+	if (pattern == NULL) {
+		results = g_array_new(FALSE, FALSE, sizeof(AID*));
+	}
+	else {
+		g_message("AMS: looking for agents matching %s", pattern->str);
+		results = searchIndex(index, pattern->str, maxResults);
+		g_string_free(pattern, TRUE);
+	}
+	
+	//build the reply to the message
+	reply = dbus_message_new_method_return(msg);
+	DBusMessageIter replyIter;
+	dbus_message_iter_init_append(reply, &replyIter);
+	g_message("AMS: found %d matches", results->len);
+	encodeAIDArray(&replyIter, results);
+	
+	//send the reply back
+	dbus_connection_send(theAMS.configuration->connection, reply, NULL);
+	dbus_connection_flush(theAMS.configuration->connection);	
+	dbus_message_unref(reply);
+	g_array_free(results, TRUE);
+}
+
 /* Performs all of the required operations to handle a de-register request from an agent
  * It sends the reply depending on the results of the operation.
  * 
@@ -214,22 +313,77 @@ void handleDeRegister(DBusMessage* msg) {
  * and interaction layer.  The reply conforms to the AMS get-description conversation
  * protocol.
  * 
+ * The description never changes once the platform is running so it is only encoded for
+ * the first request, later requests are sent a copy of that reply.
+ * 
  * msg: the DBusMessage object that holds the request message sent by the agent
  * that must implement the AMS get-description conversation protocol using the DBusCodec
  */
 void sendDescription(DBusMessage* msg) {
 	//create the reply to the message that has been sent
 	DBusMessage* reply;
-	reply = dbus_message_new_method_return(msg);
+	if (theAMS.descriptionReply == NULL) {
+		reply = dbus_message_new_method_return(msg);
 
-	//build up the content of the message
-	DBusMessageIter args;
-	dbus_message_iter_init_append(reply,&args);	
-	encodePlatformDescription(&args, theAMS.platformDescription);
+		//build up the content of the message
+		DBusMessageIter args;
+		dbus_message_iter_init_append(reply,&args);	
+		encodePlatformDescription(&args, theAMS.platformDescription);
+		theAMS.descriptionReply = reply;
+	}
+	reply = copyReply(theAMS.descriptionReply, msg);
 	
 	//send the reply	
 	dbus_connection_send(theAMS.configuration->connection, reply, NULL);
 	dbus_connection_flush(theAMS.configuration->connection);
+	dbus_message_unref(reply);
+}
+
+/* a search waiting for a thread of the reader pool */
+struct stAMSRead {
+	DBusMessage* msg;
+	void (*handler)(DBusMessage*, GArray*);
+};
+typedef struct stAMSRead AMSRead;
+
+/* run by a thread of the reader pool to answer a search from the published copy of the
+ * name index, without holding up the main loop thread or the other searches
+ * 
+ * data - the search to answer
+ * userData - not used
+ */
+void AMSReaderThread(gpointer data, gpointer userData) {
+	AMSRead* read = (AMSRead*)data;
+	int epoch = SnapshotReadBegin();
+	AMSSnapshot* snapshot = AMS_snapshot();
+	read->handler(read->msg, snapshot->nameIndex);
+	SnapshotReadEnd(epoch);
+	
+	dbus_message_unref(read->msg);
+	g_free(read);
+}
+
+/* answers a search of the directory on the reader pool, or straight away from the live
+ * index if there is no pool
+ * 
+ * msg - the search request
+ * handler - the function that answers the request
+ */
+void readDirectory(DBusMessage* msg, void (*handler)(DBusMessage*, GArray*)) {
+	if (theAMS.readerPool == NULL) {
+		handler(msg, theAMS.nameIndex);
+		return;
+	}
+	
+	//the search must see every change that was made before it was received, so if the
+	//published copy is older it waits for the next one rather than making a copy itself
+	AMSRead* read = g_new(AMSRead, 1);
+	read->msg = dbus_message_ref(msg);
+	read->handler = handler;
+	if (theAMS.snapshot->version != theAMS.version)
+		g_queue_push_tail(theAMS.waitingReads, read);
+	else
+		g_thread_pool_push(theAMS.readerPool, read, NULL);
 }
 
 /* This function is called whenever a message is sent to the AMS service that is running
@@ -270,8 +424,16 @@ DBusHandlerResult AMSMessageHandler(DBusConnection* connection, DBusMessage *msg
 	}
 	else if (g_ascii_strcasecmp(MSG_AMS_SEARCH, method) == 0) {
 		g_message("AMS: received search request from %s", dbus_message_get_sender(msg));
-		handleSearch(msg);
+		readDirectory(msg, handleSearch);
 	}			
+	else if (g_ascii_strcasecmp(MSG_AMS_SEARCH_BATCH, method) == 0) {
+		g_message("AMS: received batch search request from %s", dbus_message_get_sender(msg));
+		readDirectory(msg, handleSearchBatch);
+	}
+	else if (g_ascii_strcasecmp(MSG_AMS_SEARCH_PATTERN, method) == 0) {
+		g_message("AMS: received pattern search request from %s", dbus_message_get_sender(msg));
+		readDirectory(msg, handleSearchPattern);
+	}
 	else {
 		g_message("AMS: Unknown method called (%s)", method);
 	}	
@@ -300,8 +462,22 @@ void AMS_start(DBusConnection* conn, GMainLoop* mainLoop, gchar* baseService) {
 	theAMS.configuration->mainLoop = mainLoop;
 	theAMS.configuration->baseService = g_string_new(baseService);
 	
-	//initialise the white pages registry
+	//initialise the white pages registry and the index of it that is ordered by name
 	theAMS.agentDirectory = g_array_new(FALSE, FALSE, sizeof(AID*));
+	theAMS.nameIndex = g_array_new(FALSE, FALSE, sizeof(AID*));
+	theAMS.descriptionReply = NULL;
+	theAMS.restoredNames = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	
+	//searches are answered from a published copy of the index by a thread for each
+	//processor, so that they run alongside each other and the changes
+	theAMS.version = 0;
+	theAMS.snapshot = NULL;
+	theAMS.publishSource = 0;
+	theAMS.waitingReads = g_queue_new();
+	AMS_publish();
+	theAMS.readerPool = NULL;
+	if (g_get_num_processors() > 1)
+		theAMS.readerPool = g_thread_pool_new(AMSReaderThread, NULL, g_get_num_processors(), FALSE, NULL);
 	
 	//set up this services agent identifier
 	AID* id = g_new(AID, 1);
@@ -337,17 +513,332 @@ void AMS_start(DBusConnection* conn, GMainLoop* mainLoop, gchar* baseService) {
  */
 void AMS_end() {
 	g_message("AMS disconnecting from the DBus");
+	AMS_publish();
+	if (theAMS.readerPool != NULL) g_thread_pool_free(theAMS.readerPool, FALSE, TRUE);
+	theAMS.readerPool = NULL;
+	if (theAMS.publishSource != 0) g_source_remove(theAMS.publishSource);
+	theAMS.publishSource = 0;
+	SnapshotRetire(theAMS.snapshot, freeAMSSnapshot);
+	theAMS.snapshot = NULL;
+	SnapshotSynchronize();
+	if (theAMS.descriptionReply != NULL) dbus_message_unref(theAMS.descriptionReply);
+	g_hash_table_destroy(theAMS.restoredNames);
 	dbus_connection_unref(theAMS.configuration->connection);
 	g_string_free(theAMS.configuration->baseService, TRUE);
 }
 
-/* adds an entry into the AMS registry that is maintained by the AMS, any problems are 
- * reported into the error structure
+/************** NAME INDEX ***********************************************/
+/* finds where a name is, or would be, in the index that orders the agents by name.  The
+ * names are compared without regard to case as they are everywhere else in the AMS
+ * 
+ * index - the name index to look in, either the live one or a published copy
+ * name - the name to look for
+ * length - the number of characters of the names to compare, -1 for all of them
+ * returns - the position of the first agent whose name is not less than the given name
+ */
+int indexPosition(GArray* index, char* name, int length) {
+	int low = 0;
+	int high = index->len;
+	while (low < high) {
+		int middle = (low + high) / 2;
+		AID* id = g_array_index(index, AID*, middle);
+		int compare = length == -1 ? g_ascii_strcasecmp(id->name->str, name) 
+			: g_ascii_strncasecmp(id->name->str, name, length);
+		if (compare < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+/* adds an agent to the index at the position that keeps it in order */
+void indexInsert(AID* id) {
+	int position = indexPosition(theAMS.nameIndex, id->name->str, -1);
+	g_array_insert_val(theAMS.nameIndex, position, id);
+}
+
+/* removes an agent from the index */
+void indexRemove(AID* id) {
+	int position = indexPosition(theAMS.nameIndex, id->name->str, -1);
+	for (; position < theAMS.nameIndex->len; position++) {
+		if (g_array_index(theAMS.nameIndex, AID*, position) == id) {
+			g_array_remove_index(theAMS.nameIndex, position);
+			return;
+		}
+	}
+}
+
+/* finds the position of an agent in the agent directory
+ * 
+ * id - the identifier held in the directory
+ * returns - the index into the directory, -1 if it is not there
+ */
+int directoryPosition(AID* id) {
+	int i;
+	for (i=0; i < theAMS.agentDirectory->len; i++) {
+		if (g_array_index(theAMS.agentDirectory, AID*, i) == id) return i;
+	}
+	return -1;
+}
+
+/* tells any agents that are listening that an agent has changed, so that they can throw
+ * away any copies of its identifier
+ * 
+ * name - the full name of the agent
+ * event - AMS_EVENT_MODIFIED or AMS_EVENT_DEREGISTERED
+ */
+void announceChange(char* name, char* event) {
+	if (theAMS.configuration == NULL || theAMS.configuration->connection == NULL) return;
+	DBusMessage* signal = dbus_message_new_signal(AMS_SERVICE_PATH, PLATFORM_SERVICE, SIGNAL_AMS_AGENT_CHANGED);
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(signal, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &event);
+	dbus_connection_send(theAMS.configuration->connection, signal, NULL);
+	dbus_message_unref(signal);
+}
+
+/* looks up an agent by name in an ordered index
+ * 
+ * index - the name index to look in, either the live one or a published copy
+ * name - the full name of the agent
+ * returns - the identifier held in the directory for the agent, NULL if not registered
+ */
+AID* lookupName(GArray* index, GString* name) {
+	if (name == NULL) return NULL;
+	int position = indexPosition(index, name->str, -1);
+	if (position == index->len) return NULL;
+	
+	AID* id = g_array_index(index, AID*, position);
+	if (g_ascii_strcasecmp(id->name->str, name->str) != 0) return NULL;
+	return id;
+}
+
+/* looks up an agent by name using the ordered index
+ * 
+ * name - the full name of the agent
+ * returns - the identifier held in the directory for the agent, NULL if not registered
+ */
+AID* AMS_lookup(GString* name) {
+	return lookupName(theAMS.nameIndex, name);
+}
+
+/* looks up an agent by name in a published copy of the index, which can be done from any
+ * thread between SnapshotReadBegin and SnapshotReadEnd.  The copy may not yet hold the
+ * latest changes, see AMS_snapshotIsCurrent
+ * 
+ * snapshot - the copy returned by AMS_snapshot
+ * name - the full name of the agent
+ * returns - the identifier held in the directory for the agent, NULL if not registered
+ */
+AID* AMS_snapshotLookup(AMSSnapshot* snapshot, GString* name) {
+	return lookupName(snapshot->nameIndex, name);
+}
+
+/* finds all of the agents whose names match a pattern.  A pattern without any wildcards
+ * matches every name that starts with it, otherwise * and ? can be used as they are in
+ * file names.  Only the part of the index that starts with the text in front of the first
+ * wildcard is looked at.
+ * 
+ * index - the name index to look in, either the live one or a published copy
+ * pattern - the pattern to match the names against
+ * maxResults - the most agents to return, 0 or less for all of them
+ * returns - array of the matching identifiers held in the directory, the array should be
+ * 	freed but not the identifiers
+ */
+GArray* searchIndex(GArray* index, char* pattern, int maxResults) {
+	GArray* results = g_array_new(FALSE, FALSE, sizeof(AID*));
+	int prefixLength = strcspn(pattern, "*?");
+	gboolean wildcards = pattern[prefixLength] != '\0';
+	gchar* lowerPattern = g_ascii_strdown(pattern, -1);
+	
+	int position;
+	for (position = indexPosition(index, pattern, prefixLength); position < index->len; position++) {
+		if (maxResults > 0 && results->len >= maxResults) break;
+		AID* id = g_array_index(index, AID*, position);
+		
+		//the index is in order so once the prefix stops matching nothing further on will
+		if (g_ascii_strncasecmp(id->name->str, pattern, prefixLength) != 0) break;
+		
+		if (wildcards) {
+			gchar* lowerName = g_ascii_strdown(id->name->str, id->name->len);
+			gboolean matched = g_pattern_match_simple(lowerPattern, lowerName);
+			g_free(lowerName);
+			if (!matched) continue;
+		}
+		g_array_append_val(results, id);
+	}
+	
+	g_free(lowerPattern);
+	return results;
+}
+
+/* finds all of the agents whose names match a pattern, see searchIndex
+ * 
+ * pattern - the pattern to match the names against
+ * maxResults - the most agents to return, 0 or less for all of them
+ * returns - array of the matching identifiers held in the directory, the array should be
+ * 	freed but not the identifiers
+ */
+GArray* AMS_searchPattern(char* pattern, int maxResults) {
+	return searchIndex(theAMS.nameIndex, pattern, maxResults);
+}
+
+/************** PUBLISHED COPIES ********************************************/
+/* frees an entry that has been replaced or removed once no reader can be using it */
+void freeAMSEntry(gpointer data) {
+	AID* id = (AID*)data;
+	AIDFree(*id);
+	AP_FREE(id);
+}
+
+/* frees a copy of the name index once no reader can be using it */
+void freeAMSSnapshot(gpointer data) {
+	AMSSnapshot* snapshot = (AMSSnapshot*)data;
+	g_array_free(snapshot->nameIndex, TRUE);
+	AP_FREE(snapshot);
+}
+
+/* publishes a copy of the name index if the directory has changed since the last one was
+ * made, and passes the searches that were waiting for it to the reader pool.  Must only
+ * be called from the main loop thread
+ */
+void AMS_publish() {
+	if (theAMS.snapshot == NULL || theAMS.snapshot->version != theAMS.version) {
+		AMSSnapshot* snapshot = AP_NEW(MEM_AMS, AMSSnapshot, 1);
+		snapshot->version = theAMS.version;
+		snapshot->nameIndex = g_array_sized_new(FALSE, FALSE, sizeof(AID*), theAMS.nameIndex->len);
+		g_array_append_vals(snapshot->nameIndex, theAMS.nameIndex->data, theAMS.nameIndex->len);
+		SnapshotPublish((gpointer*)&theAMS.snapshot, snapshot, freeAMSSnapshot);
+	}
+	
+	while (!g_queue_is_empty(theAMS.waitingReads))
+		g_thread_pool_push(theAMS.readerPool, g_queue_pop_head(theAMS.waitingReads), NULL);
+}
+
+/* returns the current published copy of the name index, which stays valid until the 
+ * matching call to SnapshotReadEnd.  Can be called from any thread
+ */
+AMSSnapshot* AMS_snapshot() {
+	return (AMSSnapshot*)g_atomic_pointer_get(&theAMS.snapshot);
+}
+
+/* whether a published copy of the name index holds every change made to the directory.
+ * Must only be called from the main loop thread
+ * 
+ * snapshot - the copy returned by AMS_snapshot
+ * returns - TRUE if the directory has not changed since the copy was made
+ */
+gboolean AMS_snapshotIsCurrent(AMSSnapshot* snapshot) {
+	return snapshot->version == theAMS.version;
+}
+
+/* publishes from the main loop a short while after a change, so that a run of changes
+ * is copied once however busy the main loop is */
+gboolean AMSPublishTimeout(gpointer data) {
+	theAMS.publishSource = 0;
+	AMS_publish();
+	return FALSE;
+}
+
+/* records that the directory has changed so that a new copy is published */
+void directoryChanged() {
+	theAMS.version++;
+	if (theAMS.publishSource == 0) 
+		theAMS.publishSource = g_timeout_add(SNAPSHOT_PUBLISH_INTERVAL, AMSPublishTimeout, NULL);
+}
+
+/************** ENTRIES RESTORED AT STARTUP ******************************/
+/* checks whether an entry was restored when the platform started and has not been 
+ * registered, modified or de-registered by its agent since
+ * 
+ * name - the name of the agent
+ */
+gboolean isRestored(char* name) {
+	gchar* key = g_ascii_strdown(name, -1);
+	gboolean restored = g_hash_table_lookup_extended(theAMS.restoredNames, key, NULL, NULL);
+	g_free(key);
+	return restored;
+}
+
+/* stops treating an entry as restored, called once its agent has been heard from
+ * 
+ * name - the name of the agent
+ */
+void forgetRestored(char* name) {
+	gchar* key = g_ascii_strdown(name, -1);
+	g_hash_table_remove(theAMS.restoredNames, key);
+	g_free(key);
+}
+
+/* removes a restored entry from the AMS along with the DF entry restored with it, the 
+ * agent registers both again if it is still running
+ * 
+ * id - the restored entry
+ */
+void removeRestored(AID* id) {
+	GString* name = g_string_new(id->name->str);
+	forgetRestored(name->str);
+	DF_deRegisterEntry(name, NULL);
+	AMS_deRegister(name->str, NULL);
+	g_string_free(name, TRUE);
+}
+
+/* checks whether the bus name in an agent's transport address is still owned
+ * 
+ * id - the agent
+ * returns - FALSE if the agent has no valid address or nothing owns its bus name, TRUE
+ * 	if it is owned or the bus could not be asked
+ */
+gboolean agentIsRunning(AID* id) {
+	GString* address = getTransportableAddress(id);
+	if (address == NULL) return FALSE;
+	
+	gchar** addressParts = g_strsplit(address->str, ":", 5);
+	gboolean running = FALSE;
+	if (g_strv_length(addressParts) >= 2 && dbus_validate_bus_name(addressParts[1], NULL)) {
+		DBusError error;
+		dbus_error_init(&error);
+		running = dbus_bus_name_has_owner(theAMS.configuration->connection, addressParts[1], &error);
+		if (dbus_error_is_set(&error)) {
+			running = TRUE;
+			dbus_error_free(&error);
+		}
+	}
+	g_strfreev(addressParts);
+	return running;
+}
+
+/* Called by the store once it has restored the directories when the platform starts.
+ * Agents that died while the platform was down no longer own their bus names and are
+ * removed.  The entries of the others are kept but treated as restored, so that an agent
+ * that bootstraps again replaces its old entry rather than finding its name taken
+ */
+void AMS_checkRestored() {
+	int i;
+	int removed = 0;
+	for (i=theAMS.agentDirectory->len - 1; i>=0; i--) {
+		AID* id = g_array_index(theAMS.agentDirectory, AID*, i);
+		if (id == theAMS.configuration->identifier || id == theMTS.configuration->identifier
+			|| id == theDF.configuration->identifier) continue;
+		
+		g_hash_table_insert(theAMS.restoredNames, g_ascii_strdown(id->name->str, -1), NULL);
+		if (!agentIsRunning(id)) {
+			removeRestored(id);
+			removed++;
+		}
+	}
+	if (removed > 0) g_message("AMS: removed %d restored agents that are no longer running", removed);
+}
+
+/* performs the checks and the insertion for AMS_register, split out so that the tracepoints
+ * either side of it fire no matter which of the checks fails
  * 
  * id - the agent identifier that needs to be added
  * err - the error struture that should be used to report errors
  */
-void AMS_register(AID* id, APError* err) {
+void addDirectoryEntry(AID* id, APError* err) {
 	//check to make sure that we have been passed a identifiuer
 	if (id == NULL) {
 		APSetError(err, ERROR_NULL);
@@ -366,14 +857,68 @@ void AMS_register(AID* id, APError* err) {
 		return;
 	}
 	
-	//check to make sure that the doesnot already exist
-	if (AMS_agentExists(id->name) != -1) {
+	//check to make sure that the doesnot already exist, unless the entry was restored when
+	//the platform started and the agent is bootstrapping again
+	AID* existing = AMS_lookup(id->name);
+	if (existing != NULL && !isRestored(existing->name->str)) {
 		APSetError(err, ERROR_DUPLICATE_AGENT);
 		return;
 	}
+	if (existing != NULL) {
+		g_message("AMS: %s has registered again, replacing the entry restored at startup", id->name->str);
+		removeRestored(existing);
+	}
 	
-	//add the identifier to the registry
+	//add the identifier to the registry, the agent may be a restarted one that the MTS
+	//still has a code table for
 	g_array_append_val(theAMS.agentDirectory, id);
+	indexInsert(id);
+	directoryChanged();
+	MTS_forgetAgent(id);
+	AP_MEM_MOVE_AID(id, MEM_AMS);
+	Store_journalAMS(STORE_OP_REGISTER, id);
+}
+
+/* adds an entry into the AMS registry that is maintained by the AMS, any problems are 
+ * reported into the error structure
+ * 
+ * id - the agent identifier that needs to be added
+ * err - the error struture that should be used to report errors
+ */
+void AMS_register(AID* id, APError* err) {
+	AP_PROBE1(ams_register_entry, theAMS.agentDirectory->len);
+	addDirectoryEntry(id, err);
+	AP_PROBE1(ams_register_return, theAMS.agentDirectory->len);
+}
+
+/* replaces the entry in the AMS registry for the agent with the same name as the given
+ * identifier
+ * 
+ * id - the new agent identifier for the agent
+ * err - the error structure that should be used to report errors
+ */
+void AMS_modify(AID* id, APError* err) {
+	//check to make sure that the agent exists
+	AID* old = AMS_lookup(id->name);
+	if (old == NULL) {
+		APSetError(err, ERROR_AGENT_DOES_NOT_EXIST);
+		return;
+	}
+	
+	forgetRestored(old->name->str);
+	g_array_remove_index(theAMS.agentDirectory, directoryPosition(old));
+	indexRemove(old);
+	MTS_forgetAgent(old);
+	g_array_append_val(theAMS.agentDirectory, id);
+	indexInsert(id);
+	directoryChanged();
+	MTS_forgetAgent(id);
+	AP_MEM_MOVE_AID(id, MEM_AMS);
+	Store_journalAMS(STORE_OP_MODIFY, id);
+	announceChange(id->name->str, AMS_EVENT_MODIFIED);
+	
+	//the published copy may still hold the old entry
+	SnapshotRetire(old, freeAMSEntry);
 }
 
 /* prints out the current status of the agent directory to the log which by default is just
@@ -396,13 +941,9 @@ void AMS_printDirectory() {
  * return - the index into the array if the element is found -1 otherwise
  */
 int AMS_agentExists(GString* name) {
-	if (name == NULL) return -1;
-	int i;
-	for (i=0; i < theAMS.agentDirectory->len; i++) {
-		AID* id = g_array_index(theAMS.agentDirectory, AID*, i);
-		if (g_ascii_strcasecmp(id->name->str, name->str) == 0) return i;
-	}
-	return -1;
+	AID* id = AMS_lookup(name);
+	if (id == NULL) return -1;
+	return directoryPosition(id);
 }
 
 /* Removes the given agent from the agent directory
@@ -411,12 +952,23 @@ int AMS_agentExists(GString* name) {
  * err - the structure that should be used to fill in the error
  */
 void AMS_deRegister(char* name, APError* err) {
+	AP_PROBE1(ams_deregister_entry, name);
 	GString* temp = g_string_new(name);	
-	int retVal = AMS_agentExists(temp);
-	if (retVal == -1) {
+	AID* id = AMS_lookup(temp);
+	if (id == NULL) {
 		APSetError(err, ERROR_AGENT_NOT_FOUND);
 	}
 	else {
-		g_array_remove_index(theAMS.agentDirectory, retVal);
+		forgetRestored(name);
+		g_array_remove_index(theAMS.agentDirectory, directoryPosition(id));
+		indexRemove(id);
+		directoryChanged();
+		MTS_forgetAgent(id);
+		Store_journalAMSDeRegister(name);
+		DF_cancelSubscriptions(temp);
+		announceChange(name, AMS_EVENT_DEREGISTERED);
+		SnapshotRetire(id, freeAMSEntry);
 	}
+	g_string_free(temp, TRUE);
+	AP_PROBE1(ams_deregister_return, theAMS.agentDirectory->len);
 }
@@ -20,8 +20,19 @@ void AMS_end();
 
 /********* FUNCTIONS CALLABLE BY OTHER PLATFORM SERVICES **********/
 void AMS_register(AID* id, APError* err);
+void AMS_modify(AID* id, APError* err);
 void AMS_deRegister(char* name, APError* err);
 int AMS_agentExists(GString* name);
+AID* AMS_lookup(GString* name);
+GArray* AMS_searchPattern(char* pattern, int maxResults);
+void AMS_checkRestored();
+
+/********* READING FROM OTHER THREADS ******************/
+void AMS_publish();
+AMSSnapshot* AMS_snapshot();
+AID* AMS_snapshotLookup(AMSSnapshot* snapshot, GString* name);
+gboolean AMS_snapshotIsCurrent(AMSSnapshot* snapshot);
+void freeAMSSnapshot(gpointer data);
 
 /********* TEST FUNCTIONS **********************/
 void AMS_printDirectory();
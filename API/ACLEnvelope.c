@@ -10,6 +10,7 @@
 #include "ACLEnvelope.h"
 #include "../platform-defs.h"
 #include "API.h"
+#include "../util.h"
 
 /************* SETTER METHODS **************************/
 void ACLEnvelopeSetFrom(ACLEnvelope* msg, AID* id) {
@@ -28,11 +29,29 @@ void ACLEnvelopeSetIntendedReceiver(ACLEnvelope* msg, AID* id) {
 	msg->intendedReceiver = id;
 }
 
+void ACLEnvelopeSetPriority(ACLEnvelope* msg, int priority) {
+	if (priority < ACL_PRIORITY_BULK) priority = ACL_PRIORITY_BULK;
+	if (priority >= ACL_PRIORITY_LEVELS) priority = ACL_PRIORITY_LEVELS - 1;
+	msg->priority = priority;
+}
+
+void ACLEnvelopeSetDeadline(ACLEnvelope* msg, gint64 deadline) {
+	msg->deadline = deadline;
+}
+
 /***************** GETTER METHODS ****************************/
 AID* ACLEnvelopeGetFrom(ACLEnvelope* msg) { return msg->from; }
 GArray* ACLEnvelopeGetTo(ACLEnvelope* msg) { return msg->to; }
 GString* ACLEnvelopeGetACLRepresentation(ACLEnvelope* msg) { return msg->aclRepresentation; }
 AID* ACLEnvelopeGetIntendedReceiver(ACLEnvelope* msg) { return msg->intendedReceiver; }
+int ACLEnvelopeGetPriority(ACLEnvelope* msg) { return msg->priority; }
+gint64 ACLEnvelopeGetDeadline(ACLEnvelope* msg) { return msg->deadline; }
+int ACLEnvelopeHasExpired(ACLEnvelope* msg) {
+	if (msg->deadline == 0) 
+		return FALSE;
+	else
+		return msg->deadline < currentTimeMillis();
+}
 int ACLEnvelopeHasIntendedReceiver(ACLEnvelope* msg) { 
 	if (msg->intendedReceiver == NULL) 
 		return FALSE;
@@ -80,6 +99,9 @@ GString* ACLEnvelopeToString(ACLEnvelope* msg) {
 		g_string_free(temp, TRUE);
 	}
 	
+	g_string_sprintfa(gstr, ":priority %d\n", msg->priority);
+	if (msg->deadline != 0) g_string_sprintfa(gstr, ":deadline %" G_GINT64_FORMAT "\n", msg->deadline);
+	
 	g_string_sprintfa(gstr, ")");
 	return gstr;
 }
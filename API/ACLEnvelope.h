@@ -17,6 +17,8 @@ void ACLEnvelopeSetFrom(ACLEnvelope* msg, AID* id);
 void ACLEnvelopeAddTo(ACLEnvelope* msg, AID* id);
 void ACLEnvelopeSetACLRepresentation(ACLEnvelope* msg, char* value);
 void ACLEnvelopeSetIntendedReceiver(ACLEnvelope* msg, AID* id);
+void ACLEnvelopeSetPriority(ACLEnvelope* msg, int priority);
+void ACLEnvelopeSetDeadline(ACLEnvelope* msg, gint64 deadline);
 
 //getter methods
 AID* ACLEnvelopeGetFrom(ACLEnvelope* msg);
@@ -24,6 +26,9 @@ GArray* ACLEnvelopeGetTo(ACLEnvelope* msg);
 GString* ACLEnvelopeGetACLRepresentation(ACLEnvelope* msg);
 AID* ACLEnvelopeGetIntendedReceiver(ACLEnvelope* msg);
 int ACLEnvelopeHasIntendedReceiver(ACLEnvelope* msg);
+int ACLEnvelopeGetPriority(ACLEnvelope* msg);
+gint64 ACLEnvelopeGetDeadline(ACLEnvelope* msg);
+int ACLEnvelopeHasExpired(ACLEnvelope* msg);
 
 //utility functions
 GString* ACLEnvelopeToString(ACLEnvelope* msg);
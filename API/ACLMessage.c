@@ -9,6 +9,10 @@
 
 #include "ACLMessage.h"
 #include "API.h"
+#include "../Codec/compression.h"
+#include "../Codec/sharedContent.h"
+#include <sys/mman.h>
+#include <unistd.h>
 
 /********************* SETTER METHODS ******************************/
 void ACLMessageSetPerformative(ACLMessage* msg, char* performative) {	
@@ -61,6 +65,75 @@ void ACLMessageSetReplyBy(ACLMessage* msg, char* replyBy) {
 
 void ACLMessageSetContent(ACLMessage* msg, char* content) {
 	msg->content = g_string_new(content);
+	if (msg->contentMapping != NULL) munmap(msg->contentMapping, msg->contentLength);
+	if (msg->contentFd >= 0) close(msg->contentFd);
+	msg->contentMapping = NULL;
+	msg->contentFd = -1;
+	if (msg->compressedContent != NULL) {
+		g_byte_array_free(msg->compressedContent, TRUE);
+		msg->compressedContent = NULL;
+	}
+}
+
+/* gets the content of a message without copying it, content passed in shared memory 
+ * is mapped read only the first time this is called.  The content remains valid until
+ * the message is freed.
+ * 
+ * msg - the message
+ * length - set to the number of bytes of content
+ * returns - the content, which is not nul terminated when it is mapped
+ */
+const gchar* ACLMessageGetContentMapped(ACLMessage* msg, gsize* length) {
+	if (msg->contentFd >= 0 && msg->contentMapping == NULL) {
+		if (!mapSharedContent(msg->contentFd, &msg->contentMapping, &msg->contentLength)) {
+			*length = 0;
+			return NULL;
+		}
+	}
+	if (msg->contentMapping != NULL) {
+		*length = msg->contentLength;
+		return (const gchar*)msg->contentMapping;
+	}
+	
+	GString* content = ACLMessageGetContent(msg);
+	*length = content == NULL ? 0 : content->len;
+	return content == NULL ? NULL : content->str;
+}
+
+/* content that arrived in shared memory or compressed is only copied out or decompressed
+ * the first time it is read.  Content that cannot be read is kept as it arrived so that
+ * it is not lost
+ * 
+ * msg - the message
+ * returns - FALSE if the message has content that could not be read
+ */
+gboolean loadContent(ACLMessage* msg) {
+	if (msg->content == NULL && msg->contentFd >= 0) {
+		gsize length;
+		const gchar* mapped = ACLMessageGetContentMapped(msg, &length);
+		if (mapped == NULL) return FALSE;
+		msg->content = g_string_new_len(mapped, length);
+	}
+	if (msg->content == NULL && msg->compressedContent != NULL) {
+		msg->content = decompressContent(msg->compressedContent);
+		if (msg->content == NULL) return FALSE;
+		g_byte_array_free(msg->compressedContent, TRUE);
+		msg->compressedContent = NULL;
+	}
+	return TRUE;
+}
+
+/* copies content passed in shared memory into the message and closes the descriptor, so
+ * that a message that is kept for a long time does not hold a descriptor open
+ * 
+ * msg - the message
+ */
+void ACLMessageUnshareContent(ACLMessage* msg) {
+	if (msg->contentFd < 0 || !loadContent(msg)) return;
+	if (msg->contentMapping != NULL) munmap(msg->contentMapping, msg->contentLength);
+	close(msg->contentFd);
+	msg->contentMapping = NULL;
+	msg->contentFd = -1;
 }
 
 /***************** GETTER METHODS *********************************/
@@ -76,7 +149,22 @@ GString* ACLMessageGetConversationID(ACLMessage* msg) { return msg->conversation
 GString* ACLMessageGetReplyWith(ACLMessage* msg) { return msg->replyWith; }
 GString* ACLMessageGetInReplyTo(ACLMessage* msg) { return msg->inReplyTo; }
 GString* ACLMessageGetReplyBy(ACLMessage* msg) { return msg->replyBy; }
-GString* ACLMessageGetContent(ACLMessage* msg) { return msg->content; }
+GString* ACLMessageGetContent(ACLMessage* msg) { 
+	loadContent(msg);
+	return msg->content; 
+}
+
+/* gets the content of a message, telling the caller if the message has content that
+ * could not be read, such as compressed content that has been corrupted
+ * 
+ * msg - the message
+ * err - the error structure that is set if the content could not be read
+ * returns - the content, or NULL if there is none or it could not be read
+ */
+GString* ACLMessageReadContent(ACLMessage* msg, APError* err) {
+	if (!loadContent(msg)) APSetError(err, ERROR_CONTENT_UNREADABLE);
+	return msg->content;
+}
 
 /************* UTILITY FUNCTIONS **********************************/
 
@@ -125,7 +213,7 @@ GString* ACLMessageToString(ACLMessage* msg) {
 	}	
 	
 	//content
-	if (msg->content != NULL) g_string_sprintfa(buffer, "\t:content %s\n", msg->content->str);
+	if (ACLMessageGetContent(msg) != NULL) g_string_sprintfa(buffer, "\t:content %s\n", msg->content->str);
 	
 	//language
 	if (msg->language != NULL) g_string_sprintfa(buffer, "\t:language %s\n", msg->language->str);
@@ -42,6 +42,9 @@ GString* ACLMessageGetReplyWith(ACLMessage* msg);
 GString* ACLMessageGetInReplyTo(ACLMessage* msg);
 GString* ACLMessageGetReplyBy(ACLMessage* msg);
 GString* ACLMessageGetContent(ACLMessage* msg);
+GString* ACLMessageReadContent(ACLMessage* msg, APError* err);
+void ACLMessageUnshareContent(ACLMessage* msg);
+const gchar* ACLMessageGetContentMapped(ACLMessage* msg, gsize* length);
 
 //utility functions
 GString* ACLMessageToString(ACLMessage* msg);
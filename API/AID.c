@@ -11,6 +11,7 @@
 #include "AID.h"
 #include "../platform-defs.h"
 #include "../util.h"
+#include "../Tracing/memstats.h"
 
 /* Initialises the given id structure by setting all elements to their initial values.  The value
  * passed in must not be null
@@ -40,7 +41,9 @@ AID* AIDNew() {
  * id - the agent-identifier to be freed
  */
 void AIDFree(AID id) {
-	if (id.name != NULL) g_string_free(id.name, TRUE);
+	if (id.name != NULL) AP_STRING_FREE(id.name, TRUE);
+	int i;
+	for (i=0; i<id.addresses->len; i++) AP_STRING_FREE(g_array_index(id.addresses, GString*, i), TRUE);
 	g_array_free(id.addresses, TRUE);
 }
 
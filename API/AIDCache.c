@@ -0,0 +1,146 @@
+/****************************************************************************************
+ * Filename:	AIDCache.c
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Cache of the agent identifiers an agent has resolved through the AMS.  The cache holds
+ * a bounded number of identifiers and throws away the one used least recently when it is
+ * full.  Identifiers are also thrown away once they are older than the time to live, or
+ * when the AMS announces that the agent has been modified or has left the platform.
+ * **************************************************************************************/
+
+#include "AIDCache.h"
+#include "API.h"
+#include <time.h>
+
+/* a single cached identifier, the link is its position in the least recently used order */
+struct stAIDCacheEntry {
+	gchar* key;
+	AID* id;
+	time_t expires;
+	GList* link;
+};
+typedef struct stAIDCacheEntry AIDCacheEntry;
+
+/* releases an entry once it has been removed from the cache */
+void freeAIDCacheEntry(AIDCacheEntry* entry) {
+	AIDFree(*entry->id);
+	g_free(entry->id);
+	g_free(entry->key);
+	g_free(entry);
+}
+
+/* removes an entry from both the table and the order and then frees it */
+void removeAIDCacheEntry(AIDCache* cache, AIDCacheEntry* entry) {
+	g_hash_table_remove(cache->entries, entry->key);
+	g_queue_delete_link(cache->order, entry->link);
+	freeAIDCacheEntry(entry);
+}
+
+/* removes the entry for a name if there is one, the lock must already be held */
+void removeAIDCacheName(AIDCache* cache, char* name) {
+	gchar* key = g_ascii_strdown(name, -1);
+	AIDCacheEntry* entry = g_hash_table_lookup(cache->entries, key);
+	g_free(key);
+	if (entry != NULL) removeAIDCacheEntry(cache, entry);
+}
+
+/* creates a new empty cache
+ * 
+ * maxEntries - the most identifiers that will be held
+ * timeToLive - the number of seconds an identifier is used for before it must be
+ * 	resolved by the AMS again
+ * returns - the new cache, which should be freed with AIDCacheFree
+ */
+AIDCache* AIDCacheNew(int maxEntries, int timeToLive) {
+	AIDCache* cache = g_new(AIDCache, 1);
+	cache->entries = g_hash_table_new(g_str_hash, g_str_equal);
+	cache->order = g_queue_new();
+	cache->maxEntries = maxEntries;
+	cache->timeToLive = timeToLive;
+	cache->hits = 0;
+	cache->misses = 0;
+	g_mutex_init(&cache->lock);
+	return cache;
+}
+
+/* frees a cache and all of the identifiers held in it */
+void AIDCacheFree(AIDCache* cache) {
+	while (!g_queue_is_empty(cache->order)) {
+		freeAIDCacheEntry((AIDCacheEntry*)g_queue_pop_head(cache->order));
+	}
+	g_queue_free(cache->order);
+	g_hash_table_destroy(cache->entries);
+	g_mutex_clear(&cache->lock);
+	g_free(cache);
+}
+
+/* looks up an identifier in the cache
+ * 
+ * cache - the cache to look in
+ * name - the full name of the agent
+ * returns - a copy of the cached identifier which should be freed, or NULL if the name
+ * 	is not held or has expired
+ */
+AID* AIDCacheLookup(AIDCache* cache, GString* name) {
+	gchar* key = g_ascii_strdown(name->str, name->len);
+	g_mutex_lock(&cache->lock);
+	AIDCacheEntry* entry = g_hash_table_lookup(cache->entries, key);
+	g_free(key);
+	
+	if (entry != NULL && entry->expires <= time(NULL)) {
+		removeAIDCacheEntry(cache, entry);
+		entry = NULL;
+	}
+	if (entry == NULL) {
+		cache->misses++;
+		g_mutex_unlock(&cache->lock);
+		return NULL;
+	}
+	
+	//move the entry to the front as it is now the most recently used
+	g_queue_unlink(cache->order, entry->link);
+	g_queue_push_head_link(cache->order, entry->link);
+	cache->hits++;
+	AID* copy = AIDClone(*entry->id);
+	g_mutex_unlock(&cache->lock);
+	return copy;
+}
+
+/* adds an identifier that has just been resolved to the cache, replacing any identifier
+ * already held for the agent
+ * 
+ * cache - the cache to add it to
+ * id - the identifier, a copy of it is taken
+ */
+void AIDCacheInsert(AIDCache* cache, AID* id) {
+	if (id == NULL || id->name == NULL || cache->maxEntries <= 0) return;
+	g_mutex_lock(&cache->lock);
+	removeAIDCacheName(cache, id->name->str);
+	
+	//make room by discarding the least recently used identifier
+	if (g_queue_get_length(cache->order) >= cache->maxEntries) {
+		GList* oldest = g_queue_peek_tail_link(cache->order);
+		removeAIDCacheEntry(cache, (AIDCacheEntry*)oldest->data);
+	}
+	
+	AIDCacheEntry* entry = g_new(AIDCacheEntry, 1);
+	entry->key = g_ascii_strdown(id->name->str, id->name->len);
+	entry->id = AIDClone(*id);
+	entry->expires = time(NULL) + cache->timeToLive;
+	g_queue_push_head(cache->order, entry);
+	entry->link = g_queue_peek_head_link(cache->order);
+	g_hash_table_insert(cache->entries, entry->key, entry);
+	g_mutex_unlock(&cache->lock);
+}
+
+/* removes the identifier for an agent from the cache if it is held
+ * 
+ * cache - the cache to remove it from
+ * name - the full name of the agent
+ */
+void AIDCacheRemove(AIDCache* cache, char* name) {
+	g_mutex_lock(&cache->lock);
+	removeAIDCacheName(cache, name);
+	g_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,22 @@
+/****************************************************************************************
+ * Filename:	AIDCache.h
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Declarations of the functions for the cache of agent identifiers that an agent can 
+ * use to avoid asking the AMS to resolve the same names again and again
+ * **************************************************************************************/
+
+#ifndef __API_AIDCACHE_H__
+#define __API_AIDCACHE_H__
+
+#include <glib.h>
+#include "../platform-defs.h"
+
+AIDCache* AIDCacheNew(int maxEntries, int timeToLive);
+void AIDCacheFree(AIDCache* cache);
+AID* AIDCacheLookup(AIDCache* cache, GString* name);
+void AIDCacheInsert(AIDCache* cache, AID* id);
+void AIDCacheRemove(AIDCache* cache, char* name);
+
+#endif
@@ -45,8 +45,15 @@ GString* SAPErrorGetError(APError* err);
 #define ERROR_UNAUTHORISED_AMS "You don't have the authority to perform that action - not registered with AMS"
 #define ERROR_DUPLICATE "Duplicate entries are not allowed"
 #define ERROR_ENTRY_NOT_FOUND "No entry was found for that agent"
+#define ERROR_UNKNOWN_OPERATION "Unknown operation"
+#define ERROR_SUBSCRIPTION_NOT_FOUND "No subscription with that identifier was found"
+#define ERROR_NO_TRANSPORT_ADDRESS "The agent has no address that the platform can deliver to"
+#define ERROR_INVALID_TRANSPORT_ADDRESS "The agent's address does not name a valid bus name and object path"
+#define ERROR_UNKNOWN_REPRESENTATION "Unknown ACL representation"
+#define ERROR_CONTENT_UNREADABLE "The content of the message could not be read"
 
 #define ERROR_MUST_HAVE_RECEIVER "Message must have at least on receiver"
+#define ERROR_EMPTY_BATCH "A batch must hold at least one message"
 #define ERROR_PERFORMATIVE_REQUIRED "Performative required"
 
 #define RETURN_OK "ok"
@@ -15,6 +15,9 @@
 #include "AID.h"
 #include  "APError.h"
 #include "DFAPI.h"
+#include "AIDCache.h"
+#include "workerPool.h"
+#include "container.h"
 #include "platform.h"
 #include "ACLMessage.h"
 #include "ACLEnvelope.h"
@@ -11,6 +11,7 @@
 #include "DFAPI.h"
 #include "API.h"
 #include "../util.h"
+#include "../Tracing/memstats.h"
 
 /***************************************************************************************
  * ****************** AGENT DF DESCRIPTIONS **********************************
@@ -70,6 +71,39 @@ AgentDFDescription* DFDescNew() {
 	return dfDesc;
 }
 
+/* frees an array of strings along with the strings it holds */
+void DFStringArrayFree(GArray* array) {
+	if (array == NULL) return;
+	int i;
+	for (i=0; i<array->len; i++) {
+		GString* value = g_array_index(array, GString*, i);
+		if (value != NULL) g_string_free(value, TRUE);
+	}
+	g_array_free(array, TRUE);
+}
+
+/* frees a DF description along with its identifier and services.  It must not be called
+ * on an entry that is held in the DF registry
+ * 
+ * desc - the description to free, may be NULL
+ */
+void DFDescFree(AgentDFDescription* desc) {
+	if (desc == NULL) return;
+	if (desc->id != NULL) {
+		AIDFree(*desc->id);
+		AP_FREE(desc->id);
+	}
+	
+	int i;
+	for (i=0; desc->services != NULL && i<desc->services->len; i++)
+		DFServiceDescriptionFree(g_array_index(desc->services, DFServiceDescription*, i));
+	if (desc->services != NULL) g_array_free(desc->services, TRUE);
+	DFStringArrayFree(desc->protocols);
+	DFStringArrayFree(desc->ontologies);
+	DFStringArrayFree(desc->languages);
+	AP_FREE(desc);
+}
+
 //Getters
 AID* DFDescGetAID(AgentDFDescription* desc) {
 	return desc->id;
@@ -131,6 +165,44 @@ AgentDFDescription* SDFDescAddService(AgentDFDescription* desc, DFServiceDescrip
 	return desc;
 }
 
+/***************************************************************************************
+ * ****************** DF BATCH OPERATIONS ************************************
+ * **************************************************************************************/
+
+/* creates a new operation that can be added to a batch sent with AP_DFBatch
+ * 
+ * operation - what should be done with the entry, one of MSG_DF_REGISTER, MSG_DF_MODIFY 
+ * 	or MSG_DF_DEREGISTER
+ * entry - the entry the operation applies to, for a de-registration only the identifier
+ * 	needs to be set
+ * returns - a newly allocated operation that should be freed
+ */
+DFBatchOperation* DFBatchOperationNew(char* operation, AgentDFDescription* entry) {
+	DFBatchOperation* op = g_new(DFBatchOperation, 1);
+	op->operation = g_string_new(operation);
+	op->entry = entry;
+	op->status = NULL;
+	return op;
+}
+
+//Getters
+GString* DFBatchOperationGetStatus(DFBatchOperation* op) {
+	return op->status;
+}
+
+/* frees an operation once its batch has been sent.  The entry is freed as well unless
+ * it is still needed by the agent, such as its own DF entry
+ * 
+ * op - the operation to free
+ * freeEntry - TRUE to free the entry the operation applied to
+ */
+void DFBatchOperationFree(DFBatchOperation* op, gboolean freeEntry) {
+	if (op->operation != NULL) g_string_free(op->operation, TRUE);
+	if (op->status != NULL) g_string_free(op->status, TRUE);
+	if (freeEntry) DFDescFree(op->entry);
+	g_free(op);
+}
+
 /***************************************************************************************
  * **************** DF SERVICE DESCRIPTIONS **********************************
  * **************************************************************************************/
@@ -178,6 +250,20 @@ DFServiceDescription* DFServiceDescriptionNew() {
 	return service;	
 }
 
+/* frees a DF service description and the strings it holds
+ * 
+ * service - the description to free, may be NULL
+ */
+void DFServiceDescriptionFree(DFServiceDescription* service) {
+	if (service == NULL) return;
+	if (service->name != NULL) g_string_free(service->name, TRUE);
+	if (service->type != NULL) g_string_free(service->type, TRUE);
+	DFStringArrayFree(service->protocols);
+	DFStringArrayFree(service->ontologies);
+	DFStringArrayFree(service->languages);
+	AP_FREE(service);
+}
+
 //getters
 GString* ServiceDescGetName(DFServiceDescription* desc) {
 	return desc->name;
@@ -18,6 +18,7 @@ GString* DFServiceDescriptionToString(DFServiceDescription* service);
 
 /********************* AGENT DF DESCRIPTIONS ******************************/
 AgentDFDescription* DFDescNew();
+void DFDescFree(AgentDFDescription* desc);
 
 AID* DFDescGetAID(AgentDFDescription* desc);
 GArray* DFDescGetServices(AgentDFDescription* desc);
@@ -36,8 +37,14 @@ AgentDFDescription* SDFDescAddOntology(AgentDFDescription* desc, char* value);
 AgentDFDescription* SDFDescAddLanguage(AgentDFDescription* desc, char* value);
 AgentDFDescription* SDFDescAddService(AgentDFDescription* desc, DFServiceDescription* value);
 
+/********************* DF BATCH OPERATIONS ********************************/
+DFBatchOperation* DFBatchOperationNew(char* operation, AgentDFDescription* entry);
+GString* DFBatchOperationGetStatus(DFBatchOperation* op);
+void DFBatchOperationFree(DFBatchOperation* op, gboolean freeEntry);
+
 /********************* DF SERVICE DESCRIPTION ****************************/
 DFServiceDescription* DFServiceDescriptionNew();
+void DFServiceDescriptionFree(DFServiceDescription* service);
 
 GString* ServiceDescGetName(DFServiceDescription* desc);
 GString* ServiceDescGetType(DFServiceDescription* desc);
@@ -18,6 +18,7 @@
 #include <dbus/dbus-glib-lowlevel.h>
 #include "../Codec/codecs.h"
 #include "API.h"
+#include "../Tracing/memstats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -26,6 +27,9 @@
  */
 void agentUnregFunction(DBusConnection* conn, void* user_data) {}
 
+//rule used to receive the announcements the AMS makes when agents change
+#define AMS_CHANGE_MATCH_RULE "type='signal',interface='" PLATFORM_SERVICE "',member='" SIGNAL_AMS_AGENT_CHANGED "'"
+
 /* Called by agents to register a function that is to be called whenever a message is
  * received
  * 
@@ -45,6 +49,124 @@ void AP_unregisterMessageReceiverCallback(AgentConfiguration* agent) {
 	agent->callbackFunction = NULL;
 }
 
+/* Called by agents to register a function that is to be called whenever the DF notifies
+ * the agent of a change to an entry matching one of its subscriptions
+ * 
+ * agent - the agent configuration object for this agent
+ * fn - pointer to the function that must be called when a notification is received
+ */
+void AP_registerDFNotificationCallback(AgentConfiguration* agent, DFNotificationReceiver fn) {
+	agent->DFNotificationFunction = fn;
+}
+
+/* Called when a user agent no longer wants to be told of notifications from the DF
+ * 
+ * agent - configuration structure for the agent
+ */
+void AP_unregisterDFNotificationCallback(AgentConfiguration* agent) {
+	agent->DFNotificationFunction = NULL;
+}
+
+/* watches for the AMS announcing that an agent has changed and removes the agent from the
+ * identifier cache.  Installed as a filter on the connection when the cache is enabled
+ * 
+ * All parameters are filled in by the underlying DBus code
+ */
+DBusHandlerResult AIDCacheFilter(DBusConnection* connection, DBusMessage *msg, void *userData) {
+	AgentConfiguration* agent = (AgentConfiguration*)userData;
+	
+	if (agent->identifierCache != NULL && dbus_message_is_signal(msg, PLATFORM_SERVICE, SIGNAL_AMS_AGENT_CHANGED)) {
+		DBusMessageIter iter;
+		dbus_message_iter_init(msg, &iter);
+		GString* name = decodeString(&iter);
+		if (name != NULL) {
+			AIDCacheRemove(agent->identifierCache, name->str);
+			g_string_free(name, TRUE);
+		}
+	}
+	
+	//let anything else that is interested in the message see it
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+/* turns on the cache of identifiers resolved through AP_searchAMS so that repeated
+ * searches for the same agent are answered without contacting the AMS.  Cached
+ * identifiers are dropped when the AMS announces that the agent has changed or left 
+ * the platform, or once they are older than the time to live
+ * 
+ * agent - the agent configuration object for this agent
+ * maxEntries - the most identifiers to hold, the least recently used is dropped when full
+ * timeToLive - the number of seconds an identifier can be used for
+ * err - the error structure that should be used for any errors
+ */
+void AP_enableAIDCache(AgentConfiguration* agent, int maxEntries, int timeToLive, APError* err) {
+	if (agent->identifierCache != NULL) AP_disableAIDCache(agent);
+	
+	//listen for the AMS announcing changes
+	DBusError error;
+	dbus_error_init(&error);
+	dbus_bus_add_match(agent->connection, AMS_CHANGE_MATCH_RULE, &error);
+	if (dbus_error_is_set(&error)) {
+		dbus_error_free(&error);
+		APSetError(err, ERROR_MESSAGE_LISTENER);
+		return;
+	}
+	if (!dbus_connection_add_filter(agent->connection, AIDCacheFilter, agent, NULL)) {
+		APSetError(err, ERROR_MESSAGE_LISTENER);
+		return;
+	}
+	
+	agent->identifierCache = AIDCacheNew(maxEntries, timeToLive);
+}
+
+/* turns off the identifier cache and releases everything held in it
+ * 
+ * agent - the agent configuration object for this agent
+ */
+void AP_disableAIDCache(AgentConfiguration* agent) {
+	if (agent->identifierCache == NULL) return;
+	dbus_connection_remove_filter(agent->connection, AIDCacheFilter, agent);
+	dbus_bus_remove_match(agent->connection, AMS_CHANGE_MATCH_RULE, NULL);
+	g_message("AID cache had %d hits and %d misses", agent->identifierCache->hits, agent->identifierCache->misses);
+	AIDCacheFree(agent->identifierCache);
+	agent->identifierCache = NULL;
+}
+
+/* runs the agents message callback on a pool of worker threads instead of on the thread
+ * that dispatches messages from the bus, so that a slow callback does not hold up the
+ * receipt of further messages.  Messages with the same conversation id are always
+ * handled by the same worker, one after the other, in the order they arrived.
+ * 
+ * agent - the agent configuration object for this agent
+ * workers - the number of worker threads
+ * maxInFlight - the most messages that can be waiting for or running in a callback, once
+ * 	reached the receipt of messages waits for a callback to finish, 0 for no limit
+ * err - the error structure that should be used for any errors
+ */
+void AP_enableWorkerPool(AgentConfiguration* agent, int workers, int maxInFlight, APError* err) {
+	if (workers < 1) {
+		APSetError(err, ERROR_REQUIRED_FIELD_MISSING);
+		return;
+	}
+	if (agent->workerPool != NULL) AP_disableWorkerPool(agent);
+	
+	//the callbacks use the connection from the worker threads, which is only safe because
+	//getDBusConnection turned on locking in libdbus before the connection was made
+	agent->workerPool = WorkerPoolNew(workers, maxInFlight);
+}
+
+/* stops the worker threads once they have finished the messages already given to them,
+ * after which callbacks are run as the messages are received again
+ * 
+ * agent - the agent configuration object for this agent
+ */
+void AP_disableWorkerPool(AgentConfiguration* agent) {
+	if (agent->workerPool == NULL) return;
+	WorkerPool* pool = agent->workerPool;
+	agent->workerPool = NULL;
+	WorkerPoolFree(pool);
+}
+
 /* Handles all messages received over the DBus message bus that are for the 
  * management of the agent, this messages are only sent by the platform itself and
  * not other agents, and are used to exert some management control over the agent.
@@ -69,35 +191,143 @@ DBusHandlerResult agentManagementHandler(DBusConnection* connection, DBusMessage
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
 
+/* tells the sender of a message that expired before it was read, with the same failure
+ * the MTS sends for a message that expires before it is delivered
+ * 
+ * agent - the configuration object for the agent the message was sent to
+ * envelope - the envelope of the expired message
+ */
+void refuseExpiredMessage(AgentConfiguration* agent, ACLEnvelope* envelope) {
+	if (envelope->from == NULL) return;
+	ACLMessage* failure = ACLMessageNew(ACL_FAILURE);
+	ACLMessageAddReceiver(failure, envelope->from);
+	GString* content = g_string_new("");
+	g_string_printf(content, "(%s %s)", MTS_MESSAGE_EXPIRED, agent->identifier->name->str);
+	ACLMessageSetContent(failure, content->str);
+	g_string_free(content, TRUE);
+	
+	APError error;
+	APErrorInit(&error);
+	AP_sendWithPriority(agent, failure, ACL_PRIORITY_CONTROL, &error);
+	if (APErrorIsSet(error)) APErrorFree(&error);
+	
+	//the identifiers in the failure belong to this agent and the expired message
+	failure->sender = NULL;
+	ACLMessageFree(*failure);
+	g_free(failure);
+}
+
 /* handles the receipt of an agent message over the transport bus.  This is called for
  * every agent message receiveced.  This method calls a registered callback function
  * or adds the message to the queue appropriately for the wishes of the agent developer.
  * 
  * agent - the configuration object managed by the API for the agent for whom the message
  * 	was sent
- * msg - the DBus message object that was received over the bus
+ * iter - iterator pointing at the agent message in the DBus message received over the bus
+ * ack - the acknowledgement of the delivery, held by the worker that runs the callback
+ * 	so that the MTS is not told the message was handled before it was, or NULL
  */
-void handleReceivedMessage(AgentConfiguration* agent, DBusMessage* msg) {
-	DBusMessageIter iter;
-	dbus_message_iter_init(msg, &iter);
+void handleReceivedMessage(AgentConfiguration* agent, DBusMessageIter* iter, WorkerAck* ack) {
+	//use the DBus codec to retrieve the content of the message, the payload is skipped
+	//if the message has expired
+	AgentMessage* message = AP_NEW(MEM_INBOX, AgentMessage, 1);
+	AgentMessageInit(message);
+	message->envelope = decodeEnvelope(iter);
+	guint64 codeTable;
+	if (ACLEnvelopeHasExpired(message->envelope)) {
+		skipPayload(iter, message->envelope, &codeTable);
+		g_atomic_int_inc(&agent->expiredMessages);
+		g_message("Expired message from %s dropped", message->envelope->from->name->str);
+		refuseExpiredMessage(agent, message->envelope);
+	}
+	else {
+		message->payload = decodePayload(iter, message->envelope, &codeTable);
+	}
 	
-	//use the DBus codec to retrieve the content of the message
-	AgentMessage* message = decodeAgentMessage(&iter);
+	//the MTS is told to start a new code table if the message was written with one we do
+	//not have, the message itself is lost
+	if (codeTable != 0) {
+		g_message("Message from %s dropped, its code table is not in step", message->envelope->from->name->str);
+		if (ack != NULL) {
+			gchar* text = g_strdup_printf(ACL_CODE_TABLE_ID_FORMAT, codeTable);
+			WorkerAckFail(ack, ERROR_NAME_CODE_TABLE, text);
+			g_free(text);
+		}
+	}
+	if (message->payload == NULL) {
+		freeDecodedAgentMessage(message);
+		return;
+	}
 	
-	//check to see if the callback function should be called
-	if (agent->callbackFunction != NULL) {
+	//check to see if the callback function should be called, either here or by one of
+	//the worker threads
+	if (agent->callbackFunction != NULL && agent->workerPool != NULL) {
+		AP_MEM_UNTAG_MESSAGE(message);
+		WorkerPoolDispatch(agent->workerPool, agent, message, ack);
+	}
+	else if (agent->callbackFunction != NULL) {
+		//a message handed to the callback belongs to the agent developer
+		AP_MEM_UNTAG_MESSAGE(message);
 		(*agent->callbackFunction)(agent, message);
 	}
 	else {
-		//add the message to the end of the queue
+		//add the message to the end of the queue, where it may stay for some time so it
+		//does not keep any shared memory its content arrived in open
 		g_message("Message received and added to queue");
-		agent->messageQueue = g_list_append(agent->messageQueue, msg);
+		ACLMessageUnshareContent(message->payload);
+		AP_MEM_MOVE_MESSAGE(message, MEM_INBOX);
+		agent->messageQueue = g_list_append(agent->messageQueue, message);
 		
 		//GString* gstr = AgentMessageToString(message);
 		//g_message("Message is %s", gstr->str);
 	}	
 }
 
+/* handles a notification pushed by the DF for one of this agents subscriptions and 
+ * passes it on to the registered callback function
+ * 
+ * agent - the configuration object managed by the API for the agent
+ * msg - the DBus message containing the notification
+ */
+void handleDFNotification(AgentConfiguration* agent, DBusMessage* msg) {
+	DBusMessageIter iter;
+	dbus_message_iter_init(msg, &iter);
+	
+	int id = decodeInt(&iter);
+	GString* event = decodeReply(&iter);
+	dbus_message_iter_next(&iter);
+	AgentDFDescription* entry = decodeDFEntry(&iter);
+	
+	if (agent->DFNotificationFunction != NULL) {
+		(*agent->DFNotificationFunction)(agent, id, event, entry);
+	}
+	else {
+		g_message("DF notification for subscription %d (%s) received with no callback registered", id, event->str);
+		g_string_free(event, TRUE);
+		DFDescFree(entry);
+	}
+}
+
+/* handles a request from the MTS to start a new code table because it could not read a
+ * message written with the current one.  Requests about a table that has already been
+ * replaced are ignored
+ * 
+ * agent - the configuration object managed by the API for the agent
+ * msg - the DBus message containing the request
+ */
+void handleCodeTableReset(AgentConfiguration* agent, DBusMessage* msg) {
+	char* text;
+	if (agent->codeTable == NULL || !dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &text, DBUS_TYPE_INVALID))
+		return;
+	
+	ACLCodeTableLock(agent->codeTable);
+	if (agent->codeTable->id == g_ascii_strtoull(text, NULL, 16)) {
+		ACLCodeTableReset(agent->codeTable);
+		g_message("The MTS could not read code table %s, a new table has been started", text);
+	}
+	ACLCodeTableUnlock(agent->codeTable);
+}
+
 /* used to handle all messages sent to this agent over the transport bus, it makes sure
  * that the appropriate handler is called depending on the type of message received/
  * 
@@ -108,19 +338,78 @@ DBusHandlerResult agentMessageHandler(DBusConnection* connection, DBusMessage *m
 	AgentConfiguration* agent = (AgentConfiguration*)userData;
 	
 	const char* method = dbus_message_get_member(msg);
-	if (g_ascii_strcasecmp(MTS_MSG, method) == 0) {		
-		handleReceivedMessage(agent, msg);
+	if (g_ascii_strcasecmp(MTS_MSG, method) == 0 || g_ascii_strcasecmp(MTS_MSG_BATCH, method) == 0) {		
+		WorkerAck* ack = NULL;
+		if (!dbus_message_get_no_reply(msg)) ack = WorkerAckNew(connection, msg);
+		
+		DBusMessageIter iter;
+		dbus_message_iter_init(msg, &iter);
+		if (g_ascii_strcasecmp(MTS_MSG, method) == 0) {
+			handleReceivedMessage(agent, &iter, ack);
+		}
+		else {
+			//the MTS delivers messages that arrived together for us in one call, each in a
+			//structure of its own
+			while (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_STRUCT) {
+				DBusMessageIter structIter;
+				dbus_message_iter_recurse(&iter, &structIter);
+				handleReceivedMessage(agent, &structIter, ack);
+				dbus_message_iter_next(&iter);
+			}
+		}
+		
+		//acknowledge the messages so that the MTS knows we are keeping up, if any were
+		//given to the worker threads this happens when the last of their callbacks ends
+		if (ack != NULL) WorkerAckRelease(ack);
 	}	
+	else if (g_ascii_strcasecmp(MSG_DF_NOTIFY, method) == 0) {
+		handleDFNotification(agent, msg);
+	}
+	else if (g_ascii_strcasecmp(MSG_CODE_TABLE_RESET, method) == 0) {
+		handleCodeTableReset(agent, msg);
+	}
 	else {
 		g_message("Unknown method called (%s)", method);
 	}	
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
 
+SharedPlatform theSharedPlatform; /* the one and only description shared by the agents in a process */
+
+//rule used to hear when the platform service is taken by a restarted platform
+#define PLATFORM_OWNER_MATCH_RULE "type='signal',sender='" DBUS_SERVICE_DBUS "',interface='" \
+	DBUS_INTERFACE_DBUS "',member='NameOwnerChanged',arg0='" PLATFORM_SERVICE "'"
+
+/* drops the shared platform description when the platform service changes owner so that
+ * the next agent to start fetches it again.  Agents that are already running still use
+ * the old description so it is not freed.  Installed as a filter on the connection the 
+ * first time the description is fetched
+ * 
+ * All parameters are filled in by the underlying DBus code
+ */
+DBusHandlerResult platformOwnerFilter(DBusConnection* connection, DBusMessage *msg, void *userData) {
+	if (dbus_message_is_signal(msg, DBUS_INTERFACE_DBUS, "NameOwnerChanged")) {
+		char* name;
+		char* oldOwner;
+		char* newOwner;
+		if (dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &name, DBUS_TYPE_STRING, &oldOwner,
+			DBUS_TYPE_STRING, &newOwner, DBUS_TYPE_INVALID) && g_ascii_strcasecmp(name, PLATFORM_SERVICE) == 0) {
+			g_mutex_lock(&theSharedPlatform.lock);
+			theSharedPlatform.description = NULL;
+			g_mutex_unlock(&theSharedPlatform.lock);
+			g_atomic_int_inc(&theSharedPlatform.generation);
+			g_message("The platform has changed, its description will be fetched again");
+		}
+	}
+	
+	//let anything else that is interested in the message see it
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
 /* used during bootstrap, this interrogates the AMS running on the agent platform
  * for a description of the platform services so that this information can be added
  * to the agents configuration strucuture.  It implements the agents side of the
- * get-description conversation protocol.
+ * get-description conversation protocol.  The AMS is only asked once per process.
  * 
  * agent - the agents configuration strucutre that is making the request, before using
  * 	this function a connection must have already been made to the DBus and 
@@ -128,30 +417,59 @@ DBusHandlerResult agentMessageHandler(DBusConnection* connection, DBusMessage *m
  * err - the structure used to report any errors
  */
 void getPlatformDescription(AgentConfiguration* agent, APError* err) {
-	DBusError error;
-	dbus_error_init(&error);
-	
-	//create a new method call that will be sent to the AMS to get the platform description
-	DBusMessage* msg = dbus_message_new_method_call(PLATFORM_SERVICE, 
-	 	AMS_SERVICE_PATH, PLATFORM_SERVICE, MSG_GET_DESCRIPTION);
-	DBusMessage* reply;
-	
-	//send the message and wait for a reply from the AMS
-	reply = dbus_connection_send_with_reply_and_block(agent->connection, msg, WAIT_TIME, &error);
-	if (reply == NULL) {
-		APSetError(err, ERROR_COULD_NOT_CONTACT_PLATFORM);
-		return;
-	}
-	
-	//get the content of the message
-	PlatformDescription* platform;
-	DBusMessageIter iter;
-	dbus_message_iter_init(reply, &iter);
-	platform = decodePlatformDescription(&iter);
+	g_mutex_lock(&theSharedPlatform.lock);
+	PlatformDescription* platform = theSharedPlatform.description;
+	g_mutex_unlock(&theSharedPlatform.lock);
 	
 	if (platform == NULL) {
-		APSetError(err, ERROR_INVALID_REPLY);
-		return;
+		DBusError error;
+		dbus_error_init(&error);
+		
+		//create a new method call that will be sent to the AMS to get the platform description
+		DBusMessage* msg = dbus_message_new_method_call(PLATFORM_SERVICE, 
+		 	AMS_SERVICE_PATH, PLATFORM_SERVICE, MSG_GET_DESCRIPTION);
+		DBusMessage* reply;
+		
+		//send the message and wait for a reply from the AMS, if nobody owns the platform
+		//service then the bus tells us so
+		reply = dbus_connection_send_with_reply_and_block(agent->connection, msg, WAIT_TIME, &error);
+		dbus_message_unref(msg);
+		if (reply == NULL) {
+			if (dbus_error_has_name(&error, DBUS_ERROR_SERVICE_UNKNOWN))
+				APSetError(err, ERROR_PLATFORM_NOT_FOUND);
+			else
+				APSetError(err, ERROR_COULD_NOT_CONTACT_PLATFORM);
+			dbus_error_free(&error);
+			return;
+		}
+		
+		//get the content of the message
+		DBusMessageIter iter;
+		dbus_message_iter_init(reply, &iter);
+		platform = decodePlatformDescription(&iter);
+		dbus_message_unref(reply);
+		
+		if (platform == NULL) {
+			APSetError(err, ERROR_INVALID_REPLY);
+			return;
+		}
+		
+		//another agent may have beaten us to it in which case use theirs
+		g_mutex_lock(&theSharedPlatform.lock);
+		if (theSharedPlatform.description == NULL) 
+			theSharedPlatform.description = platform;
+		else {
+			FreePlatformDescription(platform);
+			platform = theSharedPlatform.description;
+		}
+		
+		//the connection is shared by every agent in the process so it only needs to be
+		//watched once
+		if (!theSharedPlatform.watching) {
+			dbus_bus_add_match(agent->connection, PLATFORM_OWNER_MATCH_RULE, NULL);
+			theSharedPlatform.watching = dbus_connection_add_filter(agent->connection, platformOwnerFilter, NULL, NULL);
+		}
+		g_mutex_unlock(&theSharedPlatform.lock);
 	}
 	
 	//now extract the required information to fill in our configuration
@@ -177,28 +495,144 @@ void getPlatformDescription(AgentConfiguration* agent, APError* err) {
 	g_message("DF found at \t:\t %s", agent->DFAddress->str);
 }
 
-/* used during bootstrap to register this agent with the AMS support service. Implements
- * the agent end of the AMS register conversation protocol.
+/* used during bootstrap to ask the bus for the agents service name without waiting for
+ * the answer, so that the request overlaps with the conversations with the AMS
+ * 
+ * conn - the agents connection to the bus
+ * serviceName - the name the agent wants
+ * returns - the pending call to pass to serviceAcquired, NULL if it could not be sent
+ */
+DBusPendingCall* requestService(DBusConnection* conn, char* serviceName) {
+	DBusMessage* msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS, 
+		DBUS_INTERFACE_DBUS, "RequestName");
+	dbus_uint32_t flags = DBUS_NAME_FLAG_DO_NOT_QUEUE;
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(msg, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &serviceName);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32, &flags);
+	
+	DBusPendingCall* pending = NULL;
+	if (!dbus_connection_send_with_reply(conn, msg, &pending, WAIT_TIME)) pending = NULL;
+	dbus_message_unref(msg);
+	return pending;
+}
+
+/* gives up a service name asked for with requestService when bootstrapping fails after
+ * the request was made.  The bus handles the requests in order so the name is released
+ * even if the answer to the request has not arrived
+ * 
+ * conn - the agents connection to the bus
+ * serviceName - the name the agent asked for
+ */
+void releaseService(DBusConnection* conn, char* serviceName) {
+	DBusMessage* msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS, 
+		DBUS_INTERFACE_DBUS, "ReleaseName");
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(msg, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &serviceName);
+	dbus_connection_send(conn, msg, NULL);
+	dbus_connection_flush(conn);
+	dbus_message_unref(msg);
+}
+
+/* waits for the answer to a request made with requestService
+ * 
+ * pending - the call returned by requestService
+ * returns - TRUE if the agent now owns the service name
+ */
+gboolean serviceAcquired(DBusPendingCall* pending) {
+	if (pending == NULL) return FALSE;
+	dbus_pending_call_block(pending);
+	DBusMessage* reply = dbus_pending_call_steal_reply(pending);
+	dbus_pending_call_unref(pending);
+	if (reply == NULL) return FALSE;
+	
+	gboolean acquired = FALSE;
+	DBusMessageIter iter;
+	if (dbus_message_get_type(reply) != DBUS_MESSAGE_TYPE_ERROR && dbus_message_iter_init(reply, &iter)
+		&& dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_UINT32) {
+		dbus_uint32_t result;
+		dbus_message_iter_get_basic(&iter, &result);
+		acquired = result == DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER || result == DBUS_REQUEST_NAME_REPLY_ALREADY_OWNER;
+	}
+	dbus_message_unref(reply);
+	return acquired;
+}
+
+/* used during bootstrap to send the registration of this agent to the AMS without 
+ * waiting for the reply. Implements the agent end of the AMS register conversation 
+ * protocol together with completeRegistration.
  * 
  * agent - the agents configuration structure, before calling this function the connection
  * 	to the transport bus must have been obtained and the platform description retrieved
+ * returns - the pending call to pass to completeRegistration
+ */
+DBusPendingCall* sendRegistration(AgentConfiguration* agent) {
+	//create a new method call
+	DBusMessage* msg = dbus_message_new_method_call(PLATFORM_SERVICE, 
+	 	AMS_SERVICE_PATH, PLATFORM_SERVICE, MSG_AMS_REGISTER);
+	
+	//build the content of the message
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(msg, &iter);
+	encodeAID(&iter, agent->identifier);	
+	
+	DBusPendingCall* pending = NULL;
+	if (!dbus_connection_send_with_reply(agent->connection, msg, &pending, WAIT_TIME)) pending = NULL;
+	dbus_message_unref(msg);
+	return pending;
+}
+
+/* waits for the AMS to reply to a registration sent with sendRegistration
+ * 
+ * pending - the call returned by sendRegistration
  * err - structure used to report any errors
  */
-void registerAgent(AgentConfiguration* agent, APError* err) {
+void completeRegistration(DBusPendingCall* pending, APError* err) {
+	if (pending == NULL) {
+		APSetError(err, ERROR_COULD_NOT_CONTACT_PLATFORM);
+		return;
+	}
+	dbus_pending_call_block(pending);
+	DBusMessage* reply = dbus_pending_call_steal_reply(pending);
+	dbus_pending_call_unref(pending);
+	if (reply == NULL || dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+		APSetError(err, ERROR_COULD_NOT_CONTACT_PLATFORM);
+		if (reply != NULL) dbus_message_unref(reply);
+		return;
+	}
+	
+	//check the reply to make sure that it was successful
+	DBusMessageIter replyIter;
+	dbus_message_iter_init(reply, &replyIter);
+	GString* returnVal = decodeReply(&replyIter);
+	if (g_ascii_strcasecmp(returnVal->str, RETURN_OK) !=0) {
+		APSetError(err, returnVal->str);
+	}
+	g_string_free(returnVal, TRUE);
+	dbus_message_unref(reply);
+}
+
+/* must be called when the agent no longer wishes to use the services offered by the
+ * platform.  Performs all of the required deregistrations and disconnection from the
+ * transport bus releasing all resources is was associated with on the platform
+ * 
+ * agent - agents configuration structure that was created when the agent bootstrapped
+ * err - structure used to report all errrors
+ */
+void deRegisterAgent(AgentConfiguration* agent, APError* err) {
 	DBusError error;
 	dbus_error_init(&error);
 	
 	//create a new method call
-	DBusMessage* msg = dbus_message_new_method_call(PLATFORM_SERVICE, 
-	 	AMS_SERVICE_PATH, PLATFORM_SERVICE, MSG_AMS_REGISTER);
+	DBusMessage* msg = dbus_message_new_method_call(PLATFORM_SERVICE, AMS_SERVICE_PATH, PLATFORM_SERVICE, MSG_AMS_DEREGISTER);
 	DBusMessage* reply;
 	
 	//build the content of the message
 	DBusMessageIter iter;
 	dbus_message_iter_init_append(msg, &iter);
-	encodeAID(&iter, agent->identifier);	
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &agent->identifier->name->str);
 	
-	//send the register request and wait for a reply from the AMS
 	reply = dbus_connection_send_with_reply_and_block(agent->connection, msg, WAIT_TIME, &error);
 	if (reply == NULL) {
 		APSetError(err, ERROR_COULD_NOT_CONTACT_PLATFORM);
@@ -252,6 +686,7 @@ void setUpMessageListner(AgentConfiguration* agent, APError* err) {
  */
 AgentConfiguration* AP_newAgent(char* agentName, APError* err) {
 	g_log_set_handler(NULL,  G_LOG_LEVEL_MASK, myLogHandler, NULL);	
+	AP_MEM_INSTALL_DUMP();
 	
 	AgentConfiguration* agent = g_new(AgentConfiguration, 1);
 	AgentConfigurationInit(agent);
@@ -263,31 +698,24 @@ AgentConfiguration* AP_newAgent(char* agentName, APError* err) {
 		return NULL;
 	}
 	agent->connection = conn;	
+	enableSharedContent(dbus_connection_can_send_type(conn, DBUS_TYPE_UNIX_FD));
 	
-	//check to see if the platform service can be found
-	DBusError error;
-	dbus_error_init(&error);
-	if (!dbus_bus_name_has_owner(conn, PLATFORM_SERVICE, &error)) {
-		APSetError(err, ERROR_PLATFORM_NOT_FOUND);
-		return NULL;
-	}
+	//ask for our service on the message bus, the answer is collected once the platform
+	//has been contacted so that the two round trips overlap
+	GString* serviceName = g_string_new(SERVICE_START);
+	g_string_sprintfa(serviceName, "%s", agentName);
+	DBusPendingCall* serviceCall = requestService(conn, serviceName->str);
 	
-	//now attempt to get the platform description from the well known AMS service
+	//now attempt to get the platform description from the well known AMS service, this
+	//also tells us whether the platform is running
 	g_message("Obtaining platform description");
 	getPlatformDescription(agent, err);
-	if (APErrorIsSet(*err)) return NULL;
-	
-	//acquire our service on the message bus
-	GString* serviceName = g_string_new(SERVICE_START);
-	g_string_sprintfa(serviceName, "%s", agentName);
-	if (!getService(conn, serviceName->str)) {
+	if (APErrorIsSet(*err)) {
+		if (serviceCall != NULL) dbus_pending_call_unref(serviceCall);
+		releaseService(conn, serviceName->str);
 		g_string_free(serviceName, TRUE);
-		APSetError(err, ERROR_SERVICE_NOT_ACQUIRED);
 		return NULL;
 	}
-	else {
-		g_message("Acquired service %s", serviceName->str);
-	}
 		
 	//now build this agents identifier object	
 	AID* id = g_new(AID, 1);
@@ -298,6 +726,7 @@ AgentConfiguration* AP_newAgent(char* agentName, APError* err) {
 	GString address;
 	address = buildTransportAddress(serviceName->str, MESSAGE_PATH, MTS_MSG);
 	GString* temp = g_string_new(address.str);
+	markSharedContentAddress(temp);
 	g_array_append_val(id->addresses, temp);
 	agent->identifier = id;
 	
@@ -305,16 +734,33 @@ AgentConfiguration* AP_newAgent(char* agentName, APError* err) {
 	g_message("My identifier is\n%s", tt->str);
 	g_string_free(tt, TRUE);	
 	
-	//now we need to register with the AMS on the platform
+	//now we need to register with the AMS on the platform, which can go ahead while we
+	//wait to hear about our service
 	g_message("Registering with AMS...");
-	registerAgent(agent, err);
+	DBusPendingCall* registerCall = sendRegistration(agent);
+	
+	if (!serviceAcquired(serviceCall)) {
+		//we cannot receive messages so undo the registration if it went through
+		completeRegistration(registerCall, err);
+		if (!APErrorIsSet(*err)) deRegisterAgent(agent, err);
+		APErrorReInit(err);
+		APSetError(err, ERROR_SERVICE_NOT_ACQUIRED);
+		g_string_free(serviceName, TRUE);
+		return NULL;
+	}
+	g_message("Acquired service %s", serviceName->str);
+	
+	completeRegistration(registerCall, err);
 	if (APErrorIsSet(*err)) {
 		g_message("Registration with AMS failed");
+		releaseService(conn, serviceName->str);
+		g_string_free(serviceName, TRUE);
 		return NULL;
 	}
 	else {
 		g_message("Registration with AMS suceeded");
 	}
+	g_string_free(serviceName, TRUE);
 	
 	//now we need to set up the listeners to receive messages
 	setUpMessageListner(agent, err);
@@ -330,42 +776,6 @@ AgentConfiguration* AP_newAgent(char* agentName, APError* err) {
 	return agent;
 }
 
-/* must be called when the agent no longer wishes to use the services offered by the
- * platform.  Performs all of the required deregistrations and disconnection from the
- * transport bus releasing all resources is was associated with on the platform
- * 
- * agent - agents configuration structure that was created when the agent bootstrapped
- * err - structure used to report all errrors
- */
-void deRegisterAgent(AgentConfiguration* agent, APError* err) {
-	DBusError error;
-	dbus_error_init(&error);
-	
-	//create a new method call
-	DBusMessage* msg = dbus_message_new_method_call(PLATFORM_SERVICE, AMS_SERVICE_PATH, PLATFORM_SERVICE, MSG_AMS_DEREGISTER);
-	DBusMessage* reply;
-	
-	//build the content of the message
-	DBusMessageIter iter;
-	dbus_message_iter_init_append(msg, &iter);
-	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &agent->identifier->name->str);
-	
-	reply = dbus_connection_send_with_reply_and_block(agent->connection, msg, WAIT_TIME, &error);
-	if (reply == NULL) {
-		APSetError(err, ERROR_COULD_NOT_CONTACT_PLATFORM);
-		return;
-	}
-	
-	//check the reply to make sure that it was successful
-	DBusMessageIter replyIter;
-	dbus_message_iter_init(reply, &replyIter);
-	GString* returnVal = decodeReply(&replyIter);
-	if (g_ascii_strcasecmp(returnVal->str, RETURN_OK) !=0) {
-		APSetError(err, returnVal->str);
-		return;
-	}
-}
-
 /* removes the agents entry from the DF support service
  * 
  * agent - agent configuration structure
@@ -429,8 +839,15 @@ void AP_finish(AgentConfiguration* agent, APError* err) {
 		g_message("De-Registration from AMS successful");
 	}
 	
-	//disconnect from the DBus
-	dbus_connection_unref(agent->connection);
+	//disconnect from the DBus once any callbacks still running have finished, unless the connection belongs to a container
+	AP_disableWorkerPool(agent);
+	AP_disableAIDCache(agent);
+	g_list_free_full(agent->messageQueue, (GDestroyNotify)freeDecodedAgentMessage);
+	agent->messageQueue = NULL;
+	if (agent->container != NULL) 
+		containerRemove(agent->container, agent);
+	else
+		dbus_connection_unref(agent->connection);
 }
 
 /* Modifies the agents entry in the AMS, implementing the agent end of the AMS
@@ -485,6 +902,17 @@ GArray* AP_searchAMS(AgentConfiguration* agent, char* name, APError* err) {
 	GString* agentName = g_string_new(name);
 	if (strstr(name, "@") == NULL) g_string_sprintfa(agentName, "@%s", agent->platformName->str);
 	
+	//see if we have resolved this agent recently
+	if (agent->identifierCache != NULL) {
+		AID* cached = AIDCacheLookup(agent->identifierCache, agentName);
+		if (cached != NULL) {
+			results = g_array_new(FALSE, FALSE, sizeof(AID*));
+			g_array_append_val(results, cached);
+			g_string_free(agentName, TRUE);
+			return results;
+		}
+	}
+	
 	//create a new method call
 	DBusMessage* msg = dbus_message_new_method_call(PLATFORM_SERVICE, 
 	 	AMS_SERVICE_PATH, PLATFORM_SERVICE, MSG_AMS_SEARCH);
@@ -505,6 +933,104 @@ GArray* AP_searchAMS(AgentConfiguration* agent, char* name, APError* err) {
 	DBusMessageIter replyIter;
 	dbus_message_iter_init(reply, &replyIter);	
 	results = decodeAIDArray(&replyIter);	
+	if (agent->identifierCache != NULL && results->len == 1) 
+		AIDCacheInsert(agent->identifierCache, g_array_index(results, AID*, 0));
+	
+	return results;
+}
+
+/* resolves many agent names with a single request to the AMS
+ * 
+ * agent - the configuration strucutre for the agent performing the search
+ * names - the names of the agents to look for, these have the platform name added if
+ * 	they do not already have one
+ * count - the number of names
+ * err - the error structure that should be filled to hold any errors
+ * returns - array with an identifier for each name in the same order as the names, NULL
+ * 	is held for any name that is not registered
+ */
+GArray* AP_searchAMSBatch(AgentConfiguration* agent, char** names, int count, APError* err) {
+	DBusError error;
+	dbus_error_init(&error);
+	
+	//create a new method call
+	DBusMessage* msg = dbus_message_new_method_call(PLATFORM_SERVICE, 
+	 	AMS_SERVICE_PATH, PLATFORM_SERVICE, MSG_AMS_SEARCH_BATCH);
+	DBusMessage* reply;
+	
+	//build the content of the message
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(msg, &iter);
+	encodeInt(&iter, count);
+	int i;
+	for (i=0; i<count; i++) {
+		GString* agentName = g_string_new(names[i]);
+		if (strstr(names[i], "@") == NULL) g_string_sprintfa(agentName, "@%s", agent->platformName->str);
+		encodeString(&iter, agentName);
+		g_string_free(agentName, TRUE);
+	}
+	
+	reply = dbus_connection_send_with_reply_and_block(agent->connection, msg, WAIT_TIME, &error);
+	dbus_message_unref(msg);
+	if (reply == NULL) {
+		APSetError(err, ERROR_COULD_NOT_CONTACT_PLATFORM);
+		return NULL;
+	}
+	
+	//get the reply, the AMS sends an empty identifier for names it does not know
+	DBusMessageIter replyIter;
+	dbus_message_iter_init(reply, &replyIter);	
+	GArray* results = decodeAIDArray(&replyIter);
+	for (i=0; i<results->len; i++) {
+		AID* id = g_array_index(results, AID*, i);
+		if (id != NULL && id->name == NULL) {
+			g_array_free(id->addresses, TRUE);
+			g_free(id);
+			g_array_index(results, AID*, i) = NULL;
+		}
+	}
+	dbus_message_unref(reply);
+	
+	return results;
+}
+
+/* searches the AMS for all of the agents whose names match a pattern.  A pattern without
+ * wildcards finds every agent whose name starts with it, otherwise * and ? match any
+ * number of characters and a single character
+ * 
+ * agent - the configuration strucutre for the agent performing the search
+ * pattern - the pattern to match the names against
+ * maxResults - the most agents to return, 0 for all of them
+ * err - the error structure that should be filled to hold any errors
+ * returns - array of the identifiers of the matching agents
+ */
+GArray* AP_searchAMSPattern(AgentConfiguration* agent, char* pattern, int maxResults, APError* err) {
+	DBusError error;
+	dbus_error_init(&error);
+	
+	//create a new method call
+	DBusMessage* msg = dbus_message_new_method_call(PLATFORM_SERVICE, 
+	 	AMS_SERVICE_PATH, PLATFORM_SERVICE, MSG_AMS_SEARCH_PATTERN);
+	DBusMessage* reply;
+	
+	//build the content of the message
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(msg, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &pattern);
+	encodeInt(&iter, maxResults);
+	
+	reply = dbus_connection_send_with_reply_and_block(agent->connection, msg, WAIT_TIME, &error);
+	dbus_message_unref(msg);
+	if (reply == NULL) {
+		APSetError(err, ERROR_COULD_NOT_CONTACT_PLATFORM);
+		return NULL;
+	}
+	
+	//get the reply
+	DBusMessageIter replyIter;
+	dbus_message_iter_init(reply, &replyIter);	
+	GArray* results = decodeAIDArray(&replyIter);
+	dbus_message_unref(reply);
 	
 	return results;
 }
@@ -611,13 +1137,231 @@ GArray* AP_searchDF(AgentConfiguration* agent, AgentDFDescription* template, APE
 	return results;	
 }
 
+/* sends a batch of register, modify and de-register operations to the DF in a single
+ * request.  The DF applies them in order and the status of each operation is filled in
+ * with RETURN_OK or the error for that operation.  The error structure is only set if 
+ * the batch could not be sent at all.
+ * 
+ * agent - the configuration for the agent that is being managaed by the API
+ * operations - array of DFBatchOperation* built with DFBatchOperationNew
+ * err - the structure that should be used to fill in for errors
+ */
+void AP_DFBatch(AgentConfiguration* agent, GArray* operations, APError* err) {
+	DBusError error;
+	dbus_error_init(&error);
+	
+	//create a new method call
+	DBusMessage* msg = dbus_message_new_method_call(PLATFORM_SERVICE, 
+	 	DF_SERVICE_PATH, PLATFORM_SERVICE, MSG_DF_BATCH);
+	DBusMessage* reply;
+	
+	//build the content of the message
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(msg, &iter);
+	encodeInt(&iter, operations->len);
+	int i;
+	for (i=0; i<operations->len; i++) {
+		DFBatchOperation* op = g_array_index(operations, DFBatchOperation*, i);
+		encodeString(&iter, op->operation);
+		encodeDFEntry(&iter, op->entry);
+	}
+	
+	reply = dbus_connection_send_with_reply_and_block(agent->connection, msg, WAIT_TIME, &error);
+	dbus_message_unref(msg);
+	if (reply == NULL) {
+		APSetError(err, ERROR_COULD_NOT_CONTACT_PLATFORM);
+		return;
+	}
+	
+	//read the status of each operation
+	DBusMessageIter replyIter;
+	dbus_message_iter_init(reply, &replyIter);
+	int count = decodeInt(&replyIter);
+	if (count != operations->len) {
+		APSetError(err, ERROR_INVALID_REPLY);
+		dbus_message_unref(reply);
+		return;
+	}
+	for (i=0; i<count; i++) {
+		DFBatchOperation* op = g_array_index(operations, DFBatchOperation*, i);
+		op->status = decodeReply(&replyIter);
+		dbus_message_iter_next(&replyIter);
+	}
+	dbus_message_unref(reply);
+}
+
+/* searches the DF for a single page of entries matching the template.  The search is
+ * started with a cursor of 0 and each call moves the cursor on to the start of the next
+ * page, once there are no more pages it is set to DF_SEARCH_COMPLETE
+ * 
+ * template - the template for the search
+ * maxDepth - how far the search may be propagated to other DFs, DF_SEARCH_UNLIMITED
+ * maxResults - the most entries to return in this page, DF_SEARCH_UNLIMITED for all
+ * cursor - where to start the search and filled in with where the next page starts
+ * err  - the structure that should be used to report errors
+ * return - the array containing the matches in this page
+ */
+GArray* AP_searchDFConstrained(AgentConfiguration* agent, AgentDFDescription* template, int maxDepth, 
+	int maxResults, int* cursor, APError* err) {
+	DBusError error;
+	dbus_error_init(&error);
+	
+	//create a new method call
+	DBusMessage* msg = dbus_message_new_method_call(PLATFORM_SERVICE, 
+	 	DF_SERVICE_PATH, PLATFORM_SERVICE, MSG_DF_SEARCH);
+	DBusMessage* reply;
+	
+	//build the content of the message
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(msg, &iter);
+	encodeDFEntry(&iter, template);
+	encodeInt(&iter, maxDepth);
+	encodeInt(&iter, maxResults);
+	encodeInt(&iter, *cursor);
+	
+	reply = dbus_connection_send_with_reply_and_block(agent->connection, msg, WAIT_TIME, &error);
+	if (reply == NULL) {
+		APSetError(err, ERROR_COULD_NOT_CONTACT_PLATFORM);
+		*cursor = DF_SEARCH_COMPLETE;
+		return NULL;
+	}
+	
+	DBusMessageIter replyIter;
+	dbus_message_iter_init(reply, &replyIter);
+	GArray* results = decodeDFEntryArray(&replyIter);
+	*cursor = decodeInt(&replyIter);
+	dbus_message_unref(reply);
+	return results;	
+}
+
+/* searches the DF delivering the matches a page at a time to a callback function so that
+ * the first results can be used before the whole directory has been searched and neither
+ * the DF nor the agent ever holds more than one page of results
+ * 
+ * template - the template for the search
+ * maxResults - the most entries to deliver in total, DF_SEARCH_UNLIMITED for all
+ * pageSize - the number of entries in each page, DF_SEARCH_PAGE_SIZE is a sensible value
+ * fn - called with each page, the page is freed once the function returns
+ * err  - the structure that should be used to report errors
+ * return - the number of entries delivered
+ */
+int AP_searchDFStreamed(AgentConfiguration* agent, AgentDFDescription* template, int maxResults, 
+	int pageSize, DFSearchResultReceiver fn, APError* err) {
+	int cursor = 0;
+	int delivered = 0;
+	while (cursor != DF_SEARCH_COMPLETE) {
+		//never ask for more than are still wanted
+		int wanted = pageSize;
+		if (maxResults != DF_SEARCH_UNLIMITED && maxResults - delivered < wanted) 
+			wanted = maxResults - delivered;
+		if (wanted <= 0) break;
+		
+		GArray* page = AP_searchDFConstrained(agent, template, DF_SEARCH_UNLIMITED, wanted, &cursor, err);
+		if (APErrorIsSet(*err)) break;
+		
+		if (page->len > 0) (*fn)(agent, page);
+		delivered += page->len;
+		g_array_free(page, TRUE);
+	}
+	return delivered;
+}
+
+/* subscribes to the DF so that the agent is told whenever an entry matching the template
+ * is registered, modified or de-registered.  The notifications are passed to the function
+ * registered with AP_registerDFNotificationCallback
+ * 
+ * agent - the configuration of the agent making the subscription
+ * template - the entries that the agent is interested in, as for AP_searchDF
+ * matches - if not NULL filled in with the entries that currently match the template
+ * err - the structure that should be used to report errors
+ * returns - the identifier of the subscription which is used to cancel it
+ */
+int AP_subscribeDF(AgentConfiguration* agent, AgentDFDescription* template, GArray** matches, APError* err) {
+	DBusError error;
+	dbus_error_init(&error);
+	
+	//create a new method call
+	DBusMessage* msg = dbus_message_new_method_call(PLATFORM_SERVICE, 
+	 	DF_SERVICE_PATH, PLATFORM_SERVICE, MSG_DF_SUBSCRIBE);
+	DBusMessage* reply;
+	
+	//build the content of the message
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(msg, &iter);
+	encodeAID(&iter, agent->identifier);
+	encodeDFEntry(&iter, template);
+	
+	reply = dbus_connection_send_with_reply_and_block(agent->connection, msg, WAIT_TIME, &error);
+	if (reply == NULL) {
+		APSetError(err, ERROR_COULD_NOT_CONTACT_PLATFORM);
+		return -1;
+	}
+	
+	//check the reply to make sure that it was successful
+	DBusMessageIter replyIter;
+	dbus_message_iter_init(reply, &replyIter);
+	GString* returnVal = decodeReply(&replyIter);
+	if (g_ascii_strcasecmp(returnVal->str, RETURN_OK) !=0) {
+		APSetError(err, returnVal->str);
+		return -1;
+	}
+	dbus_message_iter_next(&replyIter);
+	int id = decodeInt(&replyIter);
+	
+	GArray* results = decodeDFEntryArray(&replyIter);
+	if (matches != NULL) 
+		*matches = results;
+	else
+		g_array_free(results, TRUE);
+	
+	return id;
+}
+
+/* cancels a subscription previously made with AP_subscribeDF
+ * 
+ * agent - the configuration of the agent that made the subscription
+ * subscription - the identifier returned by AP_subscribeDF
+ * err - the structure that should be used to report errors
+ */
+void AP_unsubscribeDF(AgentConfiguration* agent, int subscription, APError* err) {
+	DBusError error;
+	dbus_error_init(&error);
+	
+	//create a new method call
+	DBusMessage* msg = dbus_message_new_method_call(PLATFORM_SERVICE, 
+	 	DF_SERVICE_PATH, PLATFORM_SERVICE, MSG_DF_CANCEL);
+	DBusMessage* reply;
+	
+	//build the content of the message
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(msg, &iter);
+	encodeString(&iter, agent->identifier->name);
+	encodeInt(&iter, subscription);
+	
+	reply = dbus_connection_send_with_reply_and_block(agent->connection, msg, WAIT_TIME, &error);
+	if (reply == NULL) {
+		APSetError(err, ERROR_COULD_NOT_CONTACT_PLATFORM);
+		return;
+	}
+	
+	//check the reply to make sure that it was successful
+	DBusMessageIter replyIter;
+	dbus_message_iter_init(reply, &replyIter);
+	GString* returnVal = decodeReply(&replyIter);
+	if (g_ascii_strcasecmp(returnVal->str, RETURN_OK) !=0) {
+		APSetError(err, returnVal->str);
+		return;
+	}
+}
+
 /* used only within the API to build an envelope strucutre for a given message that
  * an agent wishes to send
  * 
+ * agent - sending agents configuration structure
  * msg - the message for which an envelope is to be built
  * returns - the envelope for the message
  */
-ACLEnvelope* buildEnvelope(ACLMessage* msg) {
+ACLEnvelope* buildEnvelope(AgentConfiguration* agent, ACLMessage* msg) {
 	ACLEnvelope* envelope = g_new(ACLEnvelope, 1);
 	ACLEnvelopeInit(envelope);
 	
@@ -631,70 +1375,217 @@ ACLEnvelope* buildEnvelope(ACLMessage* msg) {
 		ACLEnvelopeAddTo(envelope, id);
 	}
 	
-	//set the representation
-	ACLEnvelopeSetACLRepresentation(envelope, DBUS_ACL_REPRESENTATION);
+	//set the representation, the DBus one unless the agent has chosen another
+	if (agent->aclRepresentation != NULL)
+		ACLEnvelopeSetACLRepresentation(envelope, agent->aclRepresentation->str);
+	else
+		ACLEnvelopeSetACLRepresentation(envelope, DBUS_ACL_REPRESENTATION);
+	
+	//the message is of no use once the reply by time has passed
+	if (msg->replyBy != NULL) ACLEnvelopeSetDeadline(envelope, parseFIPADateTime(msg->replyBy->str));
 	
 	return envelope;
 }
 
-/* called to send an agent message over the transport bus to other agents.  It
- * implements the agent end of the MTS send conversation protocol
+/* checks that a message can be sent and wraps it in the envelope that the MTS will 
+ * route it by
  * 
- * agent - sending agents configuration strucutre
+ * agent - sending agents configuration strucuture
  * msg - the FIPA-ACL message that is to be sent
+ * priority - one of the ACL_PRIORITY values
  * err - structure used to hold any errors
+ * returns - the message ready to be encoded, NULL if it cannot be sent
  */
-void AP_send(AgentConfiguration* agent, ACLMessage* msg, APError* err) {
+AgentMessage* buildAgentMessage(AgentConfiguration* agent, ACLMessage* msg, int priority, APError* err) {
 	//check to make sure that there is at least one recipient for this message
 	if (msg->receivers->len == 0) {
 		APSetError(err, ERROR_MUST_HAVE_RECEIVER);
-		return;
+		return NULL;
 	}
 	
 	//make sure that the message has a performative
 	if (msg->performative == NULL) {
 		APSetError(err, ERROR_PERFORMATIVE_REQUIRED);
-		return;		
+		return NULL;		
 	}
 	if (g_ascii_strcasecmp(msg->performative->str, "") == 0) {
 		APSetError(err, ERROR_PERFORMATIVE_REQUIRED);
-		return;		
+		return NULL;		
 	}
 		
 	//set the sender to be this agent, overriding anything set by the user
 	ACLMessageSetSender(msg, agent->identifier);
 	
 	//build the envelope that will be used for this message
-	ACLEnvelope* envelope = buildEnvelope(msg);
+	ACLEnvelope* envelope = buildEnvelope(agent, msg);
+	ACLEnvelopeSetPriority(envelope, priority);
 	
 	//build the complete message
 	AgentMessage* message = g_new(AgentMessage, 1);
 	AgentMessageInit(message);
 	message->envelope = envelope;
 	message->payload = msg;
+	return message;
+}
+
+/* frees a message built by buildAgentMessage once it has been encoded.  The payload and
+ * the identifiers in the envelope belong to the caller so are left alone
+ * 
+ * message - the message to free
+ */
+void freeBuiltMessage(AgentMessage* message) {
+	if (message->envelope->aclRepresentation != NULL) g_string_free(message->envelope->aclRepresentation, TRUE);
+	g_array_free(message->envelope->to, TRUE);
+	g_free(message->envelope);
+	g_free(message);
+}
+
+/* chooses the representation the payload of the messages this agent sends is written in,
+ * either DBUS_ACL_REPRESENTATION, the default, FIPA_STRING_REPRESENTATION for the FIPA
+ * string form or BIT_EFFICIENT_REPRESENTATION for the FIPA bit-efficient form, which 
+ * sends repeated names and the like as short codes.  Messages are read in whichever 
+ * representation their envelope names so the receivers do not need to be told
+ * 
+ * agent - the agent configuration object for this agent
+ * representation - the name of the representation
+ * err - the error structure that should be used for any errors
+ */
+void AP_setACLRepresentation(AgentConfiguration* agent, char* representation, APError* err) {
+	if (representation == NULL) {
+		APSetError(err, ERROR_REQUIRED_FIELD_MISSING);
+		return;
+	}
+	gboolean bitEfficient = g_ascii_strcasecmp(representation, BIT_EFFICIENT_REPRESENTATION) == 0;
+	if (g_ascii_strcasecmp(representation, DBUS_ACL_REPRESENTATION) != 0 &&
+		g_ascii_strcasecmp(representation, FIPA_STRING_REPRESENTATION) != 0 && !bitEfficient) {
+		APSetError(err, ERROR_UNKNOWN_REPRESENTATION);
+		return;
+	}
+	
+	if (agent->aclRepresentation != NULL) g_string_free(agent->aclRepresentation, TRUE);
+	agent->aclRepresentation = g_string_new(representation);
+	
+	//everything the agent sends goes to the MTS so one code table does for all of it
+	if (bitEfficient && agent->codeTable == NULL) {
+		agent->codeTable = ACLCodeTableNew();
+		agent->codeTableGeneration = g_atomic_int_get(&theSharedPlatform.generation);
+	}
+}
+
+/* takes the lock on the agents code table, if it has one, before writing messages with
+ * it.  A new table is started if the platform has been restarted since the table was
+ * started
+ * 
+ * agent - the agent configuration object for this agent
+ */
+void lockCodeTable(AgentConfiguration* agent) {
+	if (agent->codeTable == NULL) return;
+	ACLCodeTableLock(agent->codeTable);
+	int generation = g_atomic_int_get(&theSharedPlatform.generation);
+	if (agent->codeTableGeneration != generation) {
+		ACLCodeTableReset(agent->codeTable);
+		agent->codeTableGeneration = generation;
+	}
+}
+
+/* called to send an agent message over the transport bus to other agents.  It
+ * implements the agent end of the MTS send conversation protocol
+ * 
+ * agent - sending agents configuration strucutre
+ * msg - the FIPA-ACL message that is to be sent
+ * err - structure used to hold any errors
+ */
+void AP_send(AgentConfiguration* agent, ACLMessage* msg, APError* err) {
+	AP_sendWithPriority(agent, msg, ACL_PRIORITY_NORMAL, err);
+}
+
+/* sends an agent message in the same way as AP_send but with the given priority, the MTS
+ * delivers higher priority messages ahead of lower priority ones that are waiting
+ * 
+ * agent - sending agents configuration strucuture
+ * msg - the FIPA-ACL message that is to be sent
+ * priority - one of the ACL_PRIORITY values
+ * err - structure used to hold any errors
+ */
+void AP_sendWithPriority(AgentConfiguration* agent, ACLMessage* msg, int priority, APError* err) {
+	AgentMessage* message = buildAgentMessage(agent, msg, priority, err);
+	if (message == NULL) return;
 	
 	//now print the message to the screen
 	GString* temp = AgentMessageToString(message);
 	g_message("Message is \n%s", temp->str);
 	g_string_free(temp, TRUE);
 	
-	//build the message that will be sent to the MTS service
-	DBusError error;
-	dbus_error_init(&error);
-	
-	//create a new method call
+	//create a new method call that will be sent to the MTS service
 	DBusMessage* DBusMsg = dbus_message_new_method_call(PLATFORM_SERVICE, 
 	 	MTS_SERVICE_PATH, PLATFORM_SERVICE, MTS_MSG);
 	
-	//build the content of the message
+	//build the content of the message, messages written with the agents code table must
+	//go in the order they were written
+	lockCodeTable(agent);
 	DBusMessageIter iter;
 	dbus_message_iter_init_append(DBusMsg, &iter);
-	encodeAgentMessage(&iter, message);
+	encodeAgentMessageWithTable(&iter, message, agent->codeTable, addressAcceptsSharedContent(agent->MTSAddress));
+	freeBuiltMessage(message);
 	
 	//send the message without expecting a reply
 	dbus_message_set_no_reply(DBusMsg, TRUE);
 	dbus_connection_send(agent->connection, DBusMsg, NULL);
+	ACLCodeTableUnlock(agent->codeTable);
+	dbus_connection_flush(agent->connection);
+	dbus_message_unref(DBusMsg);
+}
+
+/* sends many agent messages to the MTS in a single request, each message is routed
+ * exactly as if it had been sent with AP_send.  Nothing is sent unless every message
+ * is valid.
+ * 
+ * agent - sending agents configuration strucuture
+ * msgs - the FIPA-ACL messages that are to be sent
+ * count - the number of messages
+ * err - structure used to hold any errors
+ */
+void AP_sendBatch(AgentConfiguration* agent, ACLMessage** msgs, int count, APError* err) {
+	if (msgs == NULL || count <= 0) {
+		APSetError(err, ERROR_EMPTY_BATCH);
+		return;
+	}
+	
+	AgentMessage** messages = g_new(AgentMessage*, count);
+	int i;
+	for (i=0; i<count; i++) {
+		messages[i] = buildAgentMessage(agent, msgs[i], ACL_PRIORITY_NORMAL, err);
+		if (messages[i] == NULL) {
+			while (--i >= 0) freeBuiltMessage(messages[i]);
+			g_free(messages);
+			return;
+		}
+	}
+	
+	DBusMessage* DBusMsg = dbus_message_new_method_call(PLATFORM_SERVICE, 
+	 	MTS_SERVICE_PATH, PLATFORM_SERVICE, MTS_MSG_BATCH);
+	
+	//each message is put in a structure of its own so that the MTS can skip any it drops
+	lockCodeTable(agent);
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(DBusMsg, &iter);
+	encodeInt(&iter, count);
+	for (i=0; i<count; i++) {
+		DBusMessageIter structIter;
+		dbus_message_iter_open_container(&iter, DBUS_TYPE_STRUCT, NULL, &structIter);
+		encodeAgentMessageWithTable(&structIter, messages[i], agent->codeTable, addressAcceptsSharedContent(agent->MTSAddress));
+		dbus_message_iter_close_container(&iter, &structIter);
+		freeBuiltMessage(messages[i]);
+	}
+	g_free(messages);
+	g_message("Sending %d messages in one batch", count);
+	
+	//send the messages without expecting a reply
+	dbus_message_set_no_reply(DBusMsg, TRUE);
+	dbus_connection_send(agent->connection, DBusMsg, NULL);
+	ACLCodeTableUnlock(agent->codeTable);
 	dbus_connection_flush(agent->connection);
+	dbus_message_unref(DBusMsg);
 }
 
 /* optionally called after an agent has performed all initialisation and wishes to wait
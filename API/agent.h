@@ -14,25 +14,69 @@
 #include "../platform-defs.h"
 #include "API.h"
 
+/* the platform description is the same for every agent so the first agent in a process
+ * to fetch it shares it with every agent that is started after it, until the platform
+ * service changes hands when the platform is restarted.  The generation counts the
+ * restarts, a code table started before the latest restart is replaced as the new MTS 
+ * cannot read it
+ */
+struct stSharedPlatform {
+	GMutex lock;
+	PlatformDescription* description;
+	gboolean watching;
+	gint generation;
+};
+typedef struct stSharedPlatform SharedPlatform;
+extern SharedPlatform theSharedPlatform;
+
 /****************** STARTING AND FINISHING ************************/
 AgentConfiguration* AP_newAgent(char* agentName, APError* err);
 void AP_finish(AgentConfiguration* agent, APError* err);
 
+/****************** BOOTSTRAP STEPS SHARED WITH THE CONTAINER *******/
+void getPlatformDescription(AgentConfiguration* agent, APError* err);
+DBusPendingCall* requestService(DBusConnection* conn, char* serviceName);
+gboolean serviceAcquired(DBusPendingCall* pending);
+void releaseService(DBusConnection* conn, char* serviceName);
+DBusPendingCall* sendRegistration(AgentConfiguration* agent);
+void completeRegistration(DBusPendingCall* pending, APError* err);
+void agentUnregFunction(DBusConnection* conn, void* user_data);
+DBusHandlerResult agentMessageHandler(DBusConnection* connection, DBusMessage *msg, void *userData);
+DBusHandlerResult agentManagementHandler(DBusConnection* connection, DBusMessage *msg, void *userData);
+
 /****************** AMS FUNCTIONS ************************************/
 void AP_modifyAMSEntry(AgentConfiguration* agent, APError* err);
 GArray* AP_searchAMS(AgentConfiguration* agent, char* name, APError* error);
+void AP_enableAIDCache(AgentConfiguration* agent, int maxEntries, int timeToLive, APError* err);
+void AP_disableAIDCache(AgentConfiguration* agent);
+void AP_enableWorkerPool(AgentConfiguration* agent, int workers, int maxInFlight, APError* err);
+void AP_disableWorkerPool(AgentConfiguration* agent);
+GArray* AP_searchAMSBatch(AgentConfiguration* agent, char** names, int count, APError* err);
+GArray* AP_searchAMSPattern(AgentConfiguration* agent, char* pattern, int maxResults, APError* err);
 
 /******************* DF FUNCTIONS ************************************/
 void AP_registerWithDF(AgentConfiguration* agent, APError* err);
 void AP_modifyDFEntry(AgentConfiguration* agent, APError* err);
 GArray* AP_searchDF(AgentConfiguration* agent, AgentDFDescription* template, APError* err);
+void AP_DFBatch(AgentConfiguration* agent, GArray* operations, APError* err);
+GArray* AP_searchDFConstrained(AgentConfiguration* agent, AgentDFDescription* template, int maxDepth, 
+	int maxResults, int* cursor, APError* err);
+int AP_searchDFStreamed(AgentConfiguration* agent, AgentDFDescription* template, int maxResults, 
+	int pageSize, DFSearchResultReceiver fn, APError* err);
+int AP_subscribeDF(AgentConfiguration* agent, AgentDFDescription* template, GArray** matches, APError* err);
+void AP_unsubscribeDF(AgentConfiguration* agent, int subscription, APError* err);
 
 /****************** MTS FUNCTIONS **********************************/
 void AP_send(AgentConfiguration* agent, ACLMessage* msg, APError* err);
+void AP_sendWithPriority(AgentConfiguration* agent, ACLMessage* msg, int priority, APError* err);
+void AP_sendBatch(AgentConfiguration* agent, ACLMessage** msgs, int count, APError* err);
+void AP_setACLRepresentation(AgentConfiguration* agent, char* representation, APError* err);
 
 /***************** UTILITIES ******************************************/
 void AP_registerMessageReceiverCallback(AgentConfiguration* agent, MessageReceiver fn);
 void AP_unregisterMessageReceiverCallback(AgentConfiguration* agent);
+void AP_registerDFNotificationCallback(AgentConfiguration* agent, DFNotificationReceiver fn);
+void AP_unregisterDFNotificationCallback(AgentConfiguration* agent);
 void AP_agentSleep(AgentConfiguration* agent);
 
 /****************** UTILITIES FOR SWIG ****************************/
@@ -0,0 +1,273 @@
+/****************************************************************************************
+ * Filename:	container.c
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Lets one process host many agents using a single connection to the transport bus and
+ * a single service name.  Every agent in the container is given its own object path 
+ * under CONTAINER_PATH as its transport address and the container passes each message
+ * it receives to the agent that owns the path it was sent to.  A contained agent is 
+ * otherwise used exactly like one created with AP_newAgent.
+ * **************************************************************************************/
+
+#include "container.h"
+#include "agent.h"
+#include "../util.h"
+#include "../DBus/DBus-utils.h"
+#include "../Codec/codecs.h"
+#include "../Tracing/memstats.h"
+#include <dbus/dbus-glib-lowlevel.h>
+#include <string.h>
+
+/* builds the object path that an agent in a container receives its messages on.  Only
+ * letters and numbers are allowed in a path element so anything else in the name is
+ * written as an underscore followed by its value in hex
+ * 
+ * agentName - the name of the agent without the platform name
+ * length - the number of characters of the name to use
+ * returns - the path, which must be freed by the caller
+ */
+GString* containerPath(const char* agentName, int length) {
+	GString* path = g_string_new(CONTAINER_PATH);
+	g_string_append_c(path, '/');
+	int i;
+	for (i=0; i<length; i++) {
+		if (g_ascii_isalnum(agentName[i]))
+			g_string_append_c(path, agentName[i]);
+		else
+			g_string_append_printf(path, "_%02x", (guchar)agentName[i]);
+	}
+	return path;
+}
+
+/* passes a message sent to any path under CONTAINER_PATH to the agent that owns that
+ * path
+ * 
+ * All parameters and return values are filled in and handled by the DBus code, see
+ * their documentation for more information
+ */
+DBusHandlerResult containerMessageHandler(DBusConnection* connection, DBusMessage *msg, void *userData) {
+	AgentContainer* container = (AgentContainer*)userData;
+	
+	AgentConfiguration* agent = g_hash_table_lookup(container->agents, dbus_message_get_path(msg));
+	if (agent == NULL) {
+		g_message("CONTAINER: no agent at %s", dbus_message_get_path(msg));
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+	return agentMessageHandler(connection, msg, agent);
+}
+
+/* frees a container and what its configuration owns, the connection is left to the 
+ * caller as it has to be unreferenced after the object paths are unregistered
+ * 
+ * container - the container to free
+ */
+void freeContainer(AgentContainer* container) {
+	AgentConfiguration* configuration = container->configuration;
+	DFDescFree(configuration->DFEntry);
+	if (configuration->baseService != NULL) g_string_free(configuration->baseService, TRUE);
+	if (configuration->mainLoop != NULL) g_main_loop_unref(configuration->mainLoop);
+	g_free(configuration);
+	if (container->serviceName != NULL) g_string_free(container->serviceName, TRUE);
+	if (container->agents != NULL) g_hash_table_destroy(container->agents);
+	g_free(container);
+}
+
+/* frees an agent that could not be added to a container, the connection, main loop and
+ * platform details it uses belong to the container
+ * 
+ * agent - the agent to free
+ */
+void freeContainedAgent(AgentConfiguration* agent) {
+	agent->DFEntry->id = NULL;
+	DFDescFree(agent->DFEntry);
+	AIDFree(*agent->identifier);
+	g_free(agent->identifier);
+	g_free(agent);
+}
+
+/* connects a new container to the platform, acquiring the service name that all of the
+ * agents it will hold share
+ * 
+ * containerName - the name to use for the containers service
+ * err - the error structure that should be used for an errors
+ * returns - the container or NULL if it could not be started
+ */
+AgentContainer* AP_newContainer(char* containerName, APError* err) {
+	g_log_set_handler(NULL,  G_LOG_LEVEL_MASK, myLogHandler, NULL);	
+	AP_MEM_INSTALL_DUMP();
+	
+	AgentContainer* container = g_new(AgentContainer, 1);
+	container->configuration = g_new(AgentConfiguration, 1);
+	AgentConfigurationInit(container->configuration);
+	container->serviceName = NULL;
+	container->agents = NULL;
+	
+	//connect to the session DBus
+	DBusConnection* conn = getDBusConnection();
+	if (conn == NULL) {
+		APSetError(err, ERROR_CONNECTION_UNSUCCESSFUL);
+		freeContainer(container);
+		return NULL;
+	}
+	container->configuration->connection = conn;
+	enableSharedContent(dbus_connection_can_send_type(conn, DBUS_TYPE_UNIX_FD));
+	
+	//ask for the service while the platform description is obtained
+	container->serviceName = g_string_new(SERVICE_START);
+	g_string_sprintfa(container->serviceName, "%s", containerName);
+	DBusPendingCall* serviceCall = requestService(conn, container->serviceName->str);
+	
+	getPlatformDescription(container->configuration, err);
+	if (APErrorIsSet(*err)) {
+		if (serviceCall != NULL) dbus_pending_call_unref(serviceCall);
+		releaseService(conn, container->serviceName->str);
+		dbus_connection_unref(conn);
+		freeContainer(container);
+		return NULL;
+	}
+	if (!serviceAcquired(serviceCall)) {
+		APSetError(err, ERROR_SERVICE_NOT_ACQUIRED);
+		dbus_connection_unref(conn);
+		freeContainer(container);
+		return NULL;
+	}
+	g_message("Acquired service %s", container->serviceName->str);
+	
+	//the agents are found by the path that a message was sent to
+	container->agents = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	
+	DBusObjectPathVTable vTable;
+	vTable.unregister_function = agentUnregFunction;
+	vTable.message_function = containerMessageHandler;
+	if (!dbus_connection_register_fallback(conn, CONTAINER_PATH, &vTable, container)) {
+		APSetError(err, ERROR_MESSAGE_LISTENER);
+		releaseService(conn, container->serviceName->str);
+		dbus_connection_unref(conn);
+		freeContainer(container);
+		return NULL;
+	}
+	
+	//management calls act on the whole container
+	DBusObjectPathVTable vTable2;
+	vTable2.unregister_function = agentUnregFunction;
+	vTable2.message_function = agentManagementHandler;
+	if (!dbus_connection_register_object_path(conn, MANAGEMENT_PATH, &vTable2, container->configuration)) {
+		APSetError(err, ERROR_MESSAGE_LISTENER);
+		dbus_connection_unregister_object_path(conn, CONTAINER_PATH);
+		releaseService(conn, container->serviceName->str);
+		dbus_connection_unref(conn);
+		freeContainer(container);
+		return NULL;
+	}
+	
+	container->configuration->baseService = getBaseService(conn);
+	container->configuration->mainLoop = g_main_loop_new(NULL, FALSE);
+	dbus_connection_setup_with_g_main(conn, NULL);
+	
+	return container;
+}
+
+/* starts a new agent inside a container.  The agent is registered with the AMS in the
+ * same way as any other agent but uses the containers connection, service and main loop
+ * 
+ * container - the container that will host the agent
+ * agentName - the name that the agent wishes to be known by
+ * err - the error structure that should be used for an errors
+ * returns - the initialised agent configuration
+ */
+AgentConfiguration* AP_newContainedAgent(AgentContainer* container, char* agentName, APError* err) {
+	GString* path = containerPath(agentName, strlen(agentName));
+	if (g_hash_table_lookup(container->agents, path->str) != NULL) {
+		APSetError(err, ERROR_DUPLICATE_AGENT);
+		g_string_free(path, TRUE);
+		return NULL;
+	}
+	
+	AgentConfiguration* agent = g_new(AgentConfiguration, 1);
+	AgentConfigurationInit(agent);
+	agent->container = container;
+	agent->connection = container->configuration->connection;
+	agent->mainLoop = container->configuration->mainLoop;
+	agent->baseService = container->configuration->baseService;
+	agent->platformName = container->configuration->platformName;
+	agent->MTSAddress = container->configuration->MTSAddress;
+	agent->AMSAddress = container->configuration->AMSAddress;
+	agent->DFAddress = container->configuration->DFAddress;
+	
+	//build this agents identifier, its address is its own path within the container
+	AID* id = g_new(AID, 1);
+	AIDInit(id);
+	GString* name = g_string_new(agentName);
+	g_string_sprintfa(name, "@%s", agent->platformName->str);
+	id->name = name;
+	GString address;
+	address = buildTransportAddress(container->serviceName->str, path->str, MTS_MSG);
+	GString* temp = g_string_new(address.str);
+	markSharedContentAddress(temp);
+	g_array_append_val(id->addresses, temp);
+	agent->identifier = id;
+	agent->DFEntry->id = agent->identifier;
+	
+	completeRegistration(sendRegistration(agent), err);
+	if (APErrorIsSet(*err)) {
+		g_message("Registration of %s with AMS failed", agentName);
+		g_string_free(path, TRUE);
+		freeContainedAgent(agent);
+		return NULL;
+	}
+	
+	g_hash_table_insert(container->agents, path->str, agent);
+	g_string_free(path, FALSE);
+	return agent;
+}
+
+/* forgets an agent that is being finished so that messages are no longer passed to it.
+ * Called by AP_finish for contained agents
+ * 
+ * container - the container that hosts the agent
+ * agent - the agent that is finishing
+ */
+void containerRemove(AgentContainer* container, AgentConfiguration* agent) {
+	char* name = agent->identifier->name->str;
+	char* at = strrchr(name, '@');
+	GString* path = containerPath(name, at == NULL ? strlen(name) : at - name);
+	g_hash_table_remove(container->agents, path->str);
+	g_string_free(path, TRUE);
+}
+
+/* adds the agents of a container to a list so they can be finished */
+void collectAgent(gpointer key, gpointer value, gpointer userData) {
+	GSList** agents = (GSList**)userData;
+	*agents = g_slist_prepend(*agents, value);
+}
+
+/* runs the main loop shared by all of the agents in the container
+ * 
+ * container - the container to run
+ */
+void AP_containerSleep(AgentContainer* container) {
+	g_main_loop_run(container->configuration->mainLoop);
+}
+
+/* finishes every agent that is still in the container and then disconnects it from
+ * the transport bus
+ * 
+ * container - the container to finish
+ * err - the error structure that should be used to store the errors
+ */
+void AP_finishContainer(AgentContainer* container, APError* err) {
+	GSList* agents = NULL;
+	g_hash_table_foreach(container->agents, collectAgent, &agents);
+	GSList* current;
+	for (current = agents; current != NULL; current = current->next) {
+		AP_finish((AgentConfiguration*)current->data, err);
+		APErrorReInit(err);
+	}
+	g_slist_free(agents);
+	
+	dbus_connection_unregister_object_path(container->configuration->connection, CONTAINER_PATH);
+	dbus_connection_unregister_object_path(container->configuration->connection, MANAGEMENT_PATH);
+	dbus_connection_unref(container->configuration->connection);
+	freeContainer(container);
+}
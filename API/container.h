@@ -0,0 +1,23 @@
+/****************************************************************************************
+ * Filename:	container.h
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Declarations of the functions for hosting many agents in one process on a single
+ * connection to the transport bus
+ * **************************************************************************************/
+
+#ifndef __API_CONTAINER_H__
+#define __API_CONTAINER_H__
+
+#include <glib.h>
+#include "../platform-defs.h"
+#include "APError.h"
+
+AgentContainer* AP_newContainer(char* containerName, APError* err);
+AgentConfiguration* AP_newContainedAgent(AgentContainer* container, char* agentName, APError* err);
+void AP_containerSleep(AgentContainer* container);
+void AP_finishContainer(AgentContainer* container, APError* err);
+void containerRemove(AgentContainer* container, AgentConfiguration* agent);
+
+#endif
@@ -13,8 +13,13 @@
 #include <dbus/dbus-glib.h>
 #include <dbus/dbus-glib-lowlevel.h>
 #include <stdlib.h>
+#include <string.h>
 #include "../util.h"
 #include "API.h"
+#include "../Store/Store.h"
+#include "../Codec/codecs.h"
+#include "../DBus/epoll-loop.h"
+#include "../Tracing/memstats.h"
 
 /**********************************************************************************
  * *********** DECLARATIONS OF PLATFORM COMPONENTS ***********
@@ -23,6 +28,7 @@ Platform thePlatform; /* single configuration object for the platform */
 MTSConfiguration theMTS; /* the one and only interaction layer */
 AMSConfiguration theAMS; /* the one and only AMD */
 DFConfiguration theDF; /* the one and only DF */
+StoreConfiguration theStore; /* persistence of the AMS and DF directories */
 
 /* required by DBus but never used within this application */
 void PlatformUnregFunction(DBusConnection* conn, void* user_data) {
@@ -52,20 +58,38 @@ DBusHandlerResult TerminateHandler(DBusConnection* connection, DBusMessage *msg,
 	//we have been told to terminate so we shall do so
 	g_message("Platform : Sent terminate message from %s", dbus_message_get_sender(msg));		
 	GMainLoop* mainLoop = (GMainLoop*)userData;
-	g_main_quit(mainLoop);	
+	if (thePlatform.epollLoop != NULL) EpollLoopQuit(thePlatform.epollLoop);
+	else g_main_quit(mainLoop);	
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
 
+/* called to bootstrap the platform with the loop given by the AP_EVENT_LOOP environment
+ * variable, "epoll" selects the epoll loop and anything else the GLib main loop
+ */
+void bootstrapPlatform() {
+	const char* loopType = getenv(PLATFORM_LOOP_ENV);
+	if (loopType != NULL && strcmp(loopType, "epoll") == 0) {
+		bootstrapPlatformWithLoop(PLATFORM_LOOP_EPOLL);
+	}
+	else {
+		bootstrapPlatformWithLoop(PLATFORM_LOOP_GLIB);
+	}
+}
+
 /* called to bootstrap the platform.  It connects to the DBus and then starts up the
  * interaction layer, AMS and DF and all of the listeners for these services so
  * that any messages are handled.  The platform then goes to sleep waiting for
  * requests from agents
+ * 
+ * loopType - PLATFORM_LOOP_GLIB to dispatch the connection from a GLib main loop or
+ * 	PLATFORM_LOOP_EPOLL to dispatch it from an epoll loop
  */
-void bootstrapPlatform() {
+void bootstrapPlatformWithLoop(int loopType) {
 	//set up the default handler to just print messages to the terminal window	
 	g_log_set_handler(NULL,  G_LOG_LEVEL_MASK, myLogHandler, NULL);	
 
 	g_message("Bootstrapping platform");
+	AP_MEM_INSTALL_DUMP();
 	
 	//connect the platform to the session bus
 	GError* gError;	
@@ -79,11 +103,15 @@ void bootstrapPlatform() {
 	dbus_error_init(&error);
 	gError = NULL;
 		
-	//connect to the session bus and integrate it with a GLib
+	//the AMS and DF answer searches from their own threads, so the connection must be
+	//safe to use from them before it is made
+	if (!dbus_threads_init_default()) {
+		g_error("Unable to initialise the D-Bus thread support");
+		exit(1);
+	}
+		
+	//connect to the session bus
 	conn = dbus_bus_get(DBUS_BUS_SESSION, &error);
-	dbus_connection_setup_with_g_main(conn, NULL);
-
-	g_message("Connected DBUS with GLib");
 	if (conn == NULL) {
 		//we were unable to connect to the session bus
 		g_error("Unable to connect to the session bus %s", gError->message);
@@ -94,6 +122,23 @@ void bootstrapPlatform() {
 		g_message("Connection to D-Bus successful");
 	}		
 	
+	//integrate the connection with the chosen loop
+	if (loopType == PLATFORM_LOOP_EPOLL) {
+		thePlatform.epollLoop = EpollLoopNew(conn);
+		if (thePlatform.epollLoop == NULL) {
+			g_error("Unable to create the epoll loop for the platform");
+			exit(1);
+		}
+		g_message("Connected DBUS with epoll");
+	}
+	else {
+		dbus_connection_setup_with_g_main(conn, NULL);
+		g_message("Connected DBUS with GLib");
+	}
+	
+	//the MTS passes on content that agents send in shared memory
+	enableSharedContent(dbus_connection_can_send_type(conn, DBUS_TYPE_UNIX_FD));
+	
 	//get the base service of this connection
 	const char* baseService;
 	baseService = dbus_bus_get_unique_name(conn);
@@ -152,14 +197,23 @@ void bootstrapPlatform() {
 	AMS_register(theMTS.configuration->identifier, NULL);
 	AMS_register(theDF.configuration->identifier, NULL);	
 	
+	//bring back the directories as they were when the platform last stopped
+	Store_start(NULL);
+	
 	//now that all the handlers are registered we can start the main loop with the 
 	//help of GLib
 	g_message("Platform sleeping...");
-	g_main_loop_run(mainLoop);
+	if (thePlatform.epollLoop != NULL) EpollLoopRun(thePlatform.epollLoop);
+	else g_main_loop_run(mainLoop);
 	g_message("Platform Terminating...");
 	
 	//perform all of the required clean up
+	Store_end();
 	MTS_end();	
 	AMS_end();
 	DF_end();
+	if (thePlatform.epollLoop != NULL) {
+		EpollLoopFree(thePlatform.epollLoop);
+		thePlatform.epollLoop = NULL;
+	}
 }
@@ -13,6 +13,12 @@
 #include "../DF/DF.h"
 #include "../MTS/MTS.h"
 
+//the loops that the platform can dispatch its connection from
+#define PLATFORM_LOOP_GLIB 0
+#define PLATFORM_LOOP_EPOLL 1
+#define PLATFORM_LOOP_ENV "AP_EVENT_LOOP"
+
 void bootstrapPlatform();
+void bootstrapPlatformWithLoop(int loopType);
 
 #endif
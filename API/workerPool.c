@@ -0,0 +1,185 @@
+/****************************************************************************************
+ * Filename:	workerPool.c
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Pool of threads that run the message callbacks of an agent.  Each worker has its own
+ * queue and a message is always put on the queue chosen by its conversation id, so the
+ * messages of one conversation are handled one at a time in the order they arrived
+ * while different conversations are handled at the same time.  The number of messages 
+ * given to the pool but not yet finished with can be capped, in which case handing over
+ * a message waits until a callback finishes.
+ * **************************************************************************************/
+
+#include "workerPool.h"
+#include "API.h"
+
+/* a message waiting for a worker, a task with no message tells the worker to stop */
+struct stWorkerTask {
+	WorkerPool* pool;
+	AgentConfiguration* agent;
+	AgentMessage* message;
+	WorkerAck* ack;
+};
+typedef struct stWorkerTask WorkerTask;
+
+/* creates the acknowledgement of a delivery, it is sent when it has been released as
+ * many times as it has been held plus once by the caller
+ * 
+ * connection - the connection the delivery arrived on
+ * call - the delivery
+ * returns - the acknowledgement, held once for the caller
+ */
+WorkerAck* WorkerAckNew(DBusConnection* connection, DBusMessage* call) {
+	WorkerAck* ack = g_new(WorkerAck, 1);
+	ack->connection = connection;
+	ack->reply = dbus_message_new_method_return(call);
+	ack->remaining = 1;
+	return ack;
+}
+
+/* stops an acknowledgement from being sent until it is released again
+ * 
+ * ack - the acknowledgement
+ */
+void WorkerAckHold(WorkerAck* ack) {
+	g_atomic_int_inc(&ack->remaining);
+}
+
+/* turns an acknowledgement into an error, which is sent in its place when it is released.
+ * Only the first error is kept.  Must be called before the caller releases its hold
+ * 
+ * ack - the acknowledgement
+ * name - the name of the error
+ * text - the message that goes with it
+ */
+void WorkerAckFail(WorkerAck* ack, const char* name, const char* text) {
+	if (dbus_message_get_type(ack->reply) == DBUS_MESSAGE_TYPE_ERROR) return;
+	DBusMessage* error = dbus_message_new(DBUS_MESSAGE_TYPE_ERROR);
+	dbus_message_set_error_name(error, name);
+	dbus_message_set_reply_serial(error, dbus_message_get_reply_serial(ack->reply));
+	dbus_message_set_destination(error, dbus_message_get_destination(ack->reply));
+	dbus_message_append_args(error, DBUS_TYPE_STRING, &text, DBUS_TYPE_INVALID);
+	dbus_message_unref(ack->reply);
+	ack->reply = error;
+}
+
+/* releases an acknowledgement, sending and freeing it if it is no longer held.  Called
+ * from whichever thread finishes with the delivery last
+ * 
+ * ack - the acknowledgement
+ */
+void WorkerAckRelease(WorkerAck* ack) {
+	if (!g_atomic_int_dec_and_test(&ack->remaining)) return;
+	dbus_connection_send(ack->connection, ack->reply, NULL);
+	dbus_connection_flush(ack->connection);
+	dbus_message_unref(ack->reply);
+	g_free(ack);
+}
+
+/* the body of each worker thread, runs the callback for each message on its queue until
+ * it is told to stop
+ * 
+ * data - the workers queue
+ */
+gpointer workerRun(gpointer data) {
+	GAsyncQueue* queue = (GAsyncQueue*)data;
+	while (TRUE) {
+		WorkerTask* task = (WorkerTask*)g_async_queue_pop(queue);
+		if (task->message == NULL) {
+			g_free(task);
+			break;
+		}
+		
+		MessageReceiver callback = task->agent->callbackFunction;
+		if (callback != NULL) (*callback)(task->agent, task->message);
+		if (task->ack != NULL) WorkerAckRelease(task->ack);
+		
+		//let anybody waiting to hand over a message know there is room
+		g_mutex_lock(&task->pool->lock);
+		task->pool->inFlight--;
+		g_cond_signal(&task->pool->slotFree);
+		g_mutex_unlock(&task->pool->lock);
+		g_free(task);
+	}
+	return NULL;
+}
+
+/* creates a pool and starts its worker threads
+ * 
+ * size - the number of workers
+ * maxInFlight - the most messages that can be held by the pool at once, 0 for no limit
+ * returns - the new pool
+ */
+WorkerPool* WorkerPoolNew(int size, int maxInFlight) {
+	WorkerPool* pool = g_new(WorkerPool, 1);
+	pool->size = size;
+	pool->maxInFlight = maxInFlight;
+	pool->inFlight = 0;
+	g_mutex_init(&pool->lock);
+	g_cond_init(&pool->slotFree);
+	pool->workers = g_new(GThread*, size);
+	pool->queues = g_new(GAsyncQueue*, size);
+	
+	int i;
+	for (i=0; i<size; i++) {
+		pool->queues[i] = g_async_queue_new();
+		pool->workers[i] = g_thread_new("agent-worker", workerRun, pool->queues[i]);
+	}
+	return pool;
+}
+
+/* stops the workers once they have handled every message already on their queues and
+ * then frees the pool
+ * 
+ * pool - the pool to free
+ */
+void WorkerPoolFree(WorkerPool* pool) {
+	int i;
+	for (i=0; i<pool->size; i++) {
+		WorkerTask* stop = g_new0(WorkerTask, 1);
+		g_async_queue_push(pool->queues[i], stop);
+	}
+	for (i=0; i<pool->size; i++) {
+		g_thread_join(pool->workers[i]);
+		g_async_queue_unref(pool->queues[i]);
+	}
+	g_free(pool->workers);
+	g_free(pool->queues);
+	g_mutex_clear(&pool->lock);
+	g_cond_clear(&pool->slotFree);
+	g_free(pool);
+}
+
+/* hands a received message to the worker responsible for its conversation, messages
+ * without a conversation id are kept in order by the sender instead
+ * 
+ * pool - the pool of the receiving agent
+ * agent - the receiving agent
+ * message - the message that was received
+ * ack - the acknowledgement of the delivery the message arrived in, held until the
+ * 	callback has finished, or NULL if none is wanted
+ */
+void WorkerPoolDispatch(WorkerPool* pool, AgentConfiguration* agent, AgentMessage* message, WorkerAck* ack) {
+	guint shard = 0;
+	ACLMessage* payload = message->payload;
+	if (payload != NULL && payload->conversationID != NULL && payload->conversationID->len > 0)
+		shard = g_str_hash(payload->conversationID->str) % pool->size;
+	else if (payload != NULL && payload->sender != NULL && payload->sender->name != NULL)
+		shard = g_str_hash(payload->sender->name->str) % pool->size;
+	
+	//wait for room if the pool is holding as many messages as it is allowed
+	g_mutex_lock(&pool->lock);
+	while (pool->maxInFlight > 0 && pool->inFlight >= pool->maxInFlight)
+		g_cond_wait(&pool->slotFree, &pool->lock);
+	pool->inFlight++;
+	g_mutex_unlock(&pool->lock);
+	
+	WorkerTask* task = g_new(WorkerTask, 1);
+	task->pool = pool;
+	task->agent = agent;
+	task->message = message;
+	task->ack = ack;
+	if (ack != NULL) WorkerAckHold(ack);
+	g_async_queue_push(pool->queues[shard], task);
+}
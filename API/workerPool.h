@@ -0,0 +1,24 @@
+/****************************************************************************************
+ * Filename:	workerPool.h
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Declarations of the functions for the pool of threads that run agent message callbacks
+ * **************************************************************************************/
+
+#ifndef __API_WORKERPOOL_H__
+#define __API_WORKERPOOL_H__
+
+#include <glib.h>
+#include "../platform-defs.h"
+
+WorkerPool* WorkerPoolNew(int size, int maxInFlight);
+void WorkerPoolFree(WorkerPool* pool);
+void WorkerPoolDispatch(WorkerPool* pool, AgentConfiguration* agent, AgentMessage* message, WorkerAck* ack);
+
+WorkerAck* WorkerAckNew(DBusConnection* connection, DBusMessage* call);
+void WorkerAckHold(WorkerAck* ack);
+void WorkerAckFail(WorkerAck* ack, const char* name, const char* text);
+void WorkerAckRelease(WorkerAck* ack);
+
+#endif
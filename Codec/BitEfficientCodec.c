@@ -0,0 +1,665 @@
+/****************************************************************************************
+ * Filename:	BitEfficientCodec.c
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Writes and reads FIPA-ACL messages in the FIPA bit-efficient representation.  The
+ * performatives and message parameters are given the single byte codes of FIPA00069 and
+ * strings are sent with their length in front.  Names, addresses, ontologies and the like
+ * are put in a dynamic code table the first time they are sent over a hop and sent as a
+ * two byte index into it after that, so a conversation between the same agents soon sends
+ * little more than its content.  The hops of the platform share one bus so the header of
+ * a message that uses a code table names the table with a 64 bit identifier, the decoder
+ * keeps a table for every identifier it has been sent.  The header also gives the slot the
+ * encoder will fill next, so a decoder that has lost the table or fallen out of step with
+ * it refuses the message rather than reading the wrong strings, and the sender is told to
+ * start a new table.  Content and reply by times are never put in a table as they seldom
+ * repeat.
+ * **************************************************************************************/
+
+#include "BitEfficientCodec.h"
+#include "../API/API.h"
+#include "../Tracing/memstats.h"
+#include <string.h>
+
+//message headers without and with a code table, followed by the version
+#define BE_HEADER 0xFA
+#define BE_HEADER_CODE_TABLE 0xFB
+#define BE_VERSION 0x10
+
+//ends a message, an agent identifier or a collection
+#define BE_END 0x01
+//a performative or parameter that is not one of the predefined ones
+#define BE_USER_DEFINED 0x00
+
+//the predefined message parameters
+#define BE_SENDER 0x02
+#define BE_RECEIVER 0x03
+#define BE_CONTENT 0x04
+#define BE_REPLY_WITH 0x05
+#define BE_REPLY_BY 0x06
+#define BE_IN_REPLY_TO 0x07
+#define BE_REPLY_TO 0x08
+#define BE_LANGUAGE 0x09
+#define BE_ENCODING 0x0A
+#define BE_ONTOLOGY 0x0B
+#define BE_PROTOCOL 0x0C
+#define BE_CONVERSATION_ID 0x0D
+
+//agent identifiers and the addresses within them
+#define BE_AGENT_IDENTIFIER 0x02
+#define BE_ADDRESSES 0x02
+
+//a new null terminated string that goes in the code table, an index into the code table
+//and strings with an 8, 16 or 32 bit length in front
+#define BE_NEW_WORD 0x10
+#define BE_CODED_WORD 0x11
+#define BE_BYTES8 0x16
+#define BE_BYTES16 0x17
+#define BE_BYTES32 0x19
+
+//strings this short cost no more to send than an index so are never put in a table
+#define BE_MIN_CODED_LENGTH 4
+
+//the most code tables a process reads with, the least recently used is dropped to make
+//room and its sender has to start a new one
+#define BE_MAX_DECODE_TABLES 4096
+
+//the predefined performatives, each is coded as its position in the list counting from 1
+static const char* performatives[] = {ACL_ACCEPT_PROPOSAL, ACL_AGREE, ACL_CANCEL,
+	ACL_CALL_FOR_PROPOSAL, ACL_CONFIRM, ACL_DISCONFIRM, ACL_FAILURE, ACL_INFORM, ACL_INFORM_IF,
+	ACL_INFOEM_REF, ACL_NOT_UNDERSTOOD, ACL_PROPAGATE, ACL_PROPOSE, ACL_PROXY, ACL_QUERY_IF,
+	ACL_QUERY_REF, ACL_REFUSE, ACL_REJECT_PROPOSAL, ACL_REQUEST, ACL_REQUEST_WHEN, ACL_WHENEVER,
+	ACL_SUBSCRIBE};
+
+//the parameters of a message that are held as a single string and whether they are coded
+static const struct {
+	guint8 code;
+	glong offset;
+	gboolean coded;
+} stringParameters[] = {
+	{BE_REPLY_WITH, G_STRUCT_OFFSET(ACLMessage, replyWith), TRUE},
+	{BE_REPLY_BY, G_STRUCT_OFFSET(ACLMessage, replyBy), FALSE},
+	{BE_IN_REPLY_TO, G_STRUCT_OFFSET(ACLMessage, inReplyTo), TRUE},
+	{BE_LANGUAGE, G_STRUCT_OFFSET(ACLMessage, language), TRUE},
+	{BE_ENCODING, G_STRUCT_OFFSET(ACLMessage, encoding), TRUE},
+	{BE_ONTOLOGY, G_STRUCT_OFFSET(ACLMessage, ontology), TRUE},
+	{BE_PROTOCOL, G_STRUCT_OFFSET(ACLMessage, protocol), TRUE},
+	{BE_CONVERSATION_ID, G_STRUCT_OFFSET(ACLMessage, conversationID), TRUE}
+};
+
+BEDecodeState theDecodeTables; /* the one and only set of tables used to read messages */
+
+/* position in the message being read */
+struct stBEReader {
+	const guint8* position;
+	const guint8* end;
+	ACLCodeTable* table;
+};
+typedef struct stBEReader BEReader;
+
+/************** CODE TABLES ****************************************/
+/* makes an identifier for a new code table, random so that tables made by different
+ * processes do not share one.  It is never 0, which stands for no table */
+guint64 newTableID() {
+	guint64 id = 0;
+	while (id == 0) id = ((guint64)g_random_int() << 32) | g_random_int();
+	return id;
+}
+
+/* makes an empty code table
+ * 
+ * encoder - TRUE if the table will be used to write messages, which needs a lookup from
+ * 	string to index
+ * returns - the table
+ */
+ACLCodeTable* newTable(gboolean encoder) {
+	ACLCodeTable* table = g_new(ACLCodeTable, 1);
+	table->id = newTableID();
+	table->entries = g_new0(GString*, ACL_CODE_TABLE_SIZE);
+	table->lookup = encoder ? g_hash_table_new(g_str_hash, g_str_equal) : NULL;
+	table->next = 0;
+	g_mutex_init(&table->lock);
+	table->recent = NULL;
+	return table;
+}
+
+/* makes an empty code table for writing messages over one hop, such as from an agent to
+ * the MTS or from the MTS to one receiver
+ * 
+ * returns - the table
+ */
+ACLCodeTable* ACLCodeTableNew() {
+	return newTable(TRUE);
+}
+
+/* frees a code table and all of the strings in it
+ * 
+ * table - the table
+ */
+void ACLCodeTableFree(ACLCodeTable* table) {
+	if (table == NULL) return;
+	int i;
+	for (i=0; i<ACL_CODE_TABLE_SIZE; i++) {
+		if (table->entries[i] != NULL) g_string_free(table->entries[i], TRUE);
+	}
+	g_free(table->entries);
+	if (table->lookup != NULL) g_hash_table_destroy(table->lookup);
+	g_mutex_clear(&table->lock);
+	g_free(table);
+}
+
+/* empties a code table and gives it a new identifier, so that the other end starts a new
+ * table too.  Used when messages written with the table may not have arrived
+ * 
+ * table - the table
+ */
+void ACLCodeTableReset(ACLCodeTable* table) {
+	if (table == NULL) return;
+	int i;
+	for (i=0; i<ACL_CODE_TABLE_SIZE; i++) {
+		if (table->entries[i] != NULL) g_string_free(table->entries[i], TRUE);
+		table->entries[i] = NULL;
+	}
+	if (table->lookup != NULL) g_hash_table_remove_all(table->lookup);
+	table->next = 0;
+	table->id = newTableID();
+}
+
+/* messages written with a table must be sent in the order they were written, so anybody
+ * writing from more than one thread holds the lock from writing until sending
+ * 
+ * table - the table, may be NULL
+ */
+void ACLCodeTableLock(ACLCodeTable* table) {
+	if (table != NULL) g_mutex_lock(&table->lock);
+}
+
+void ACLCodeTableUnlock(ACLCodeTable* table) {
+	if (table != NULL) g_mutex_unlock(&table->lock);
+}
+
+/* puts a string in the next slot of a table, replacing whatever was there
+ * 
+ * table - the table
+ * text - the string
+ * length - the number of bytes in the string
+ */
+void codeTableAdd(ACLCodeTable* table, const char* text, gsize length) {
+	GString* old = table->entries[table->next];
+	if (old != NULL) {
+		if (table->lookup != NULL) g_hash_table_remove(table->lookup, old->str);
+		g_string_free(old, TRUE);
+	}
+
+	GString* entry = g_string_new_len(text, length);
+	table->entries[table->next] = entry;
+	if (table->lookup != NULL) g_hash_table_insert(table->lookup, entry->str, GINT_TO_POINTER(table->next + 1));
+	table->next = (table->next + 1) % ACL_CODE_TABLE_SIZE;
+}
+
+/* throws away a table used to read messages, any later message written with it is
+ * refused.  The decode tables lock must be held
+ * 
+ * table - the table
+ */
+void dropDecodeTable(ACLCodeTable* table) {
+	g_queue_delete_link(theDecodeTables.order, table->recent);
+	g_hash_table_remove(theDecodeTables.tables, &table->id);
+	ACLCodeTableFree(table);
+}
+
+/* finds the table to read messages written with the given table, making one if this is
+ * the first message.  The decode tables lock must be held
+ * 
+ * id - the identifier of the table the message was written with
+ * slot - the slot the encoder will fill next, which is where the table must be
+ * returns - the table, NULL if there is no table in step with the encoders
+ */
+ACLCodeTable* findDecodeTable(guint64 id, guint64 slot) {
+	if (theDecodeTables.tables == NULL) {
+		theDecodeTables.tables = g_hash_table_new(g_int64_hash, g_int64_equal);
+		theDecodeTables.order = g_queue_new();
+	}
+
+	ACLCodeTable* table = g_hash_table_lookup(theDecodeTables.tables, &id);
+	if (table != NULL) {
+		if (table->next != slot) {
+			dropDecodeTable(table);
+			return NULL;
+		}
+		g_queue_unlink(theDecodeTables.order, table->recent);
+		g_queue_push_tail_link(theDecodeTables.order, table->recent);
+		return table;
+	}
+
+	//a table that is not known must be new, otherwise it has been dropped
+	if (slot != 0) return NULL;
+	if (g_queue_get_length(theDecodeTables.order) >= BE_MAX_DECODE_TABLES)
+		dropDecodeTable(g_queue_peek_head(theDecodeTables.order));
+	table = newTable(FALSE);
+	table->id = id;
+	g_hash_table_insert(theDecodeTables.tables, &table->id, table);
+	g_queue_push_tail(theDecodeTables.order, table);
+	table->recent = g_queue_peek_tail_link(theDecodeTables.order);
+	return table;
+}
+
+/************** WRITING ****************************************/
+/* appends a single byte */
+void putByte(GString* buffer, guint8 value) {
+	g_string_append_c(buffer, (char)value);
+}
+
+/* appends a value of the given number of bytes, most significant byte first */
+void putNumber(GString* buffer, guint64 value, int bytes) {
+	while (bytes-- > 0) putByte(buffer, (guint8)(value >> (bytes * 8)));
+}
+
+/* writes a string with its length in front, it is not put in the code table
+ * 
+ * buffer - where to write the string
+ * text - the string
+ * length - the number of bytes in the string
+ */
+void putBytes(GString* buffer, const char* text, gsize length) {
+	if (length <= G_MAXUINT8) {
+		putByte(buffer, BE_BYTES8);
+		putNumber(buffer, length, 1);
+	}
+	else if (length <= G_MAXUINT16) {
+		putByte(buffer, BE_BYTES16);
+		putNumber(buffer, length, 2);
+	}
+	else {
+		putByte(buffer, BE_BYTES32);
+		putNumber(buffer, length, 4);
+	}
+	g_string_append_len(buffer, text, length);
+}
+
+/* writes a string as an index into the code table if it is there, otherwise writes it in
+ * full and adds it to the table.  Strings that are short or hold a null are always
+ * written in full
+ * 
+ * buffer - where to write the string
+ * table - the code table, NULL if there is none
+ * value - the string
+ */
+void putCoded(GString* buffer, ACLCodeTable* table, GString* value) {
+	if (table == NULL || value->len < BE_MIN_CODED_LENGTH || memchr(value->str, '\0', value->len) != NULL) {
+		putBytes(buffer, value->str, value->len);
+		return;
+	}
+
+	gpointer slot = g_hash_table_lookup(table->lookup, value->str);
+	if (slot != NULL) {
+		putByte(buffer, BE_CODED_WORD);
+		putNumber(buffer, GPOINTER_TO_INT(slot) - 1, 2);
+		return;
+	}
+
+	//the terminating null is written along with the string
+	putByte(buffer, BE_NEW_WORD);
+	g_string_append_len(buffer, value->str, value->len + 1);
+	codeTableAdd(table, value->str, value->len);
+}
+
+/* writes an agent identifier
+ * 
+ * buffer - where to write the identifier
+ * table - the code table, NULL if there is none
+ * id - the identifier
+ */
+void putAID(GString* buffer, ACLCodeTable* table, AID* id) {
+	putByte(buffer, BE_AGENT_IDENTIFIER);
+	if (id->name != NULL)
+		putCoded(buffer, table, id->name);
+	else
+		putBytes(buffer, "", 0);
+
+	if (id->addresses->len > 0) {
+		putByte(buffer, BE_ADDRESSES);
+		int i;
+		for (i=0; i<id->addresses->len; i++) {
+			putCoded(buffer, table, g_array_index(id->addresses, GString*, i));
+		}
+		putByte(buffer, BE_END);
+	}
+	putByte(buffer, BE_END);
+}
+
+/* writes a set of agent identifiers as a parameter of a message
+ * 
+ * buffer - where to write the set
+ * table - the code table, NULL if there is none
+ * code - the code of the parameter
+ * ids - the identifiers
+ */
+void putAIDSet(GString* buffer, ACLCodeTable* table, guint8 code, GArray* ids) {
+	putByte(buffer, code);
+	int i;
+	for (i=0; i<ids->len; i++) {
+		putAID(buffer, table, g_array_index(ids, AID*, i));
+	}
+	putByte(buffer, BE_END);
+}
+
+/* writes a message in the bit-efficient representation onto the end of a buffer.  If a
+ * code table is given the message must be read by the other end before any message that
+ * is written with the table after it
+ * 
+ * buffer - where to write the message
+ * msg - the message
+ * table - the code table for the hop the message is sent over, NULL to use no table
+ */
+void BitEfficientEncode(GString* buffer, ACLMessage* msg, ACLCodeTable* table) {
+	if (table != NULL) {
+		putByte(buffer, BE_HEADER_CODE_TABLE);
+		putByte(buffer, BE_VERSION);
+		putNumber(buffer, table->id, 8);
+		putNumber(buffer, table->next, 2);
+	}
+	else {
+		putByte(buffer, BE_HEADER);
+		putByte(buffer, BE_VERSION);
+	}
+
+	//the performative is coded if it is one of the predefined ones
+	int code = 0;
+	int i;
+	for (i=0; msg->performative != NULL && i<G_N_ELEMENTS(performatives); i++) {
+		if (g_ascii_strcasecmp(msg->performative->str, performatives[i]) == 0) {
+			code = i + 1;
+			break;
+		}
+	}
+	putByte(buffer, code);
+	if (code == BE_USER_DEFINED) {
+		if (msg->performative != NULL)
+			putCoded(buffer, table, msg->performative);
+		else
+			putBytes(buffer, "", 0);
+	}
+
+	if (msg->sender != NULL) {
+		putByte(buffer, BE_SENDER);
+		putAID(buffer, table, msg->sender);
+	}
+	if (msg->receivers->len > 0) putAIDSet(buffer, table, BE_RECEIVER, msg->receivers);
+	if (msg->replyTo->len > 0) putAIDSet(buffer, table, BE_REPLY_TO, msg->replyTo);
+
+	GString* content = ACLMessageGetContent(msg);
+	if (content != NULL) {
+		putByte(buffer, BE_CONTENT);
+		putBytes(buffer, content->str, content->len);
+	}
+
+	for (i=0; i<G_N_ELEMENTS(stringParameters); i++) {
+		GString* value = G_STRUCT_MEMBER(GString*, msg, stringParameters[i].offset);
+		if (value == NULL) continue;
+		putByte(buffer, stringParameters[i].code);
+		if (stringParameters[i].coded)
+			putCoded(buffer, table, value);
+		else
+			putBytes(buffer, value->str, value->len);
+	}
+	putByte(buffer, BE_END);
+}
+
+/************** READING ****************************************/
+/* reads a single byte
+ * 
+ * reader - the position in the message
+ * value - set to the byte read
+ * returns - FALSE if the message has ended
+ */
+gboolean getByte(BEReader* reader, guint8* value) {
+	if (reader->position >= reader->end) return FALSE;
+	*value = *reader->position++;
+	return TRUE;
+}
+
+/* reads the next byte only if it is the one given
+ * 
+ * reader - the position in the message
+ * value - the byte expected
+ * returns - TRUE if the byte was there and has been read
+ */
+gboolean nextIs(BEReader* reader, guint8 value) {
+	if (reader->position >= reader->end || *reader->position != value) return FALSE;
+	reader->position++;
+	return TRUE;
+}
+
+/* reads a value of the given number of bytes, most significant byte first
+ * 
+ * reader - the position in the message
+ * bytes - the number of bytes in the value
+ * value - set to the value read
+ * returns - FALSE if the message has ended
+ */
+gboolean getNumber(BEReader* reader, int bytes, guint64* value) {
+	if (reader->end - reader->position < bytes) return FALSE;
+	*value = 0;
+	while (bytes-- > 0) *value = (*value << 8) | *reader->position++;
+	return TRUE;
+}
+
+/* reads a string written in full, with its length in front, or from the code table
+ * 
+ * reader - the position in the message
+ * returns - a new string, NULL if the message is badly formed
+ */
+GString* getExpression(BEReader* reader) {
+	guint8 token;
+	guint64 length;
+	if (!getByte(reader, &token)) return NULL;
+
+	if (token == BE_NEW_WORD) {
+		const guint8* end = memchr(reader->position, '\0', reader->end - reader->position);
+		if (end == NULL || reader->table == NULL) return NULL;
+		GString* value = g_string_new_len((const char*)reader->position, end - reader->position);
+		codeTableAdd(reader->table, value->str, value->len);
+		reader->position = end + 1;
+		return value;
+	}
+	if (token == BE_CODED_WORD) {
+		if (!getNumber(reader, 2, &length) || reader->table == NULL || length >= ACL_CODE_TABLE_SIZE) return NULL;
+		GString* entry = reader->table->entries[length];
+		return entry != NULL ? g_string_new_len(entry->str, entry->len) : NULL;
+	}
+
+	gboolean ok;
+	if (token == BE_BYTES8) ok = getNumber(reader, 1, &length);
+	else if (token == BE_BYTES16) ok = getNumber(reader, 2, &length);
+	else if (token == BE_BYTES32) ok = getNumber(reader, 4, &length);
+	else ok = FALSE;
+	if (!ok || (guint64)(reader->end - reader->position) < length) return NULL;
+
+	GString* value = g_string_new_len((const char*)reader->position, length);
+	reader->position += length;
+	return value;
+}
+
+/* reads a string into a field of a message
+ * 
+ * reader - the position in the message
+ * field - the field to fill in, any value it already has is freed
+ * returns - TRUE if the string was well formed
+ */
+gboolean getField(BEReader* reader, GString** field) {
+	GString* value = getExpression(reader);
+	if (value == NULL) return FALSE;
+	if (*field != NULL) g_string_free(*field, TRUE);
+	*field = value;
+	return TRUE;
+}
+
+/* reads an agent identifier
+ * 
+ * reader - the position in the message
+ * returns - the identifier, NULL if it was badly formed
+ */
+AID* getAID(BEReader* reader) {
+	if (!nextIs(reader, BE_AGENT_IDENTIFIER)) return NULL;
+	AID* id = AP_NEW(MEM_CODEC, AID, 1);
+	AIDInit(id);
+	id->name = getExpression(reader);
+
+	gboolean ok = id->name != NULL;
+	while (ok && !nextIs(reader, BE_END)) {
+		ok = nextIs(reader, BE_ADDRESSES);
+		while (ok && !nextIs(reader, BE_END)) {
+			GString* address = getExpression(reader);
+			if (address == NULL)
+				ok = FALSE;
+			else
+				g_array_append_val(id->addresses, address);
+		}
+	}
+
+	if (!ok) {
+		AIDFree(*id);
+		AP_FREE(id);
+		return NULL;
+	}
+	return id;
+}
+
+/* reads a set of agent identifiers onto the end of an array
+ * 
+ * reader - the position in the message
+ * ids - the array to add the identifiers to
+ * returns - TRUE if the set was well formed
+ */
+gboolean getAIDSet(BEReader* reader, GArray* ids) {
+	while (!nextIs(reader, BE_END)) {
+		AID* id = getAID(reader);
+		if (id == NULL) return FALSE;
+		g_array_append_val(ids, id);
+	}
+	return TRUE;
+}
+
+/* reads the value of one parameter of a message, user defined parameters are skipped
+ * 
+ * reader - the position in the message
+ * msg - the message to fill in
+ * code - the code of the parameter, already read
+ * returns - TRUE if the value was well formed
+ */
+gboolean getParameter(BEReader* reader, ACLMessage* msg, guint8 code) {
+	if (code == BE_SENDER) {
+		AID* id = getAID(reader);
+		if (id == NULL) return FALSE;
+		if (msg->sender != NULL) {
+			AIDFree(*msg->sender);
+			g_free(msg->sender);
+		}
+		msg->sender = id;
+		return TRUE;
+	}
+	if (code == BE_RECEIVER) return getAIDSet(reader, msg->receivers);
+	if (code == BE_REPLY_TO) return getAIDSet(reader, msg->replyTo);
+	if (code == BE_CONTENT) return getField(reader, &msg->content);
+
+	int i;
+	for (i=0; i<G_N_ELEMENTS(stringParameters); i++) {
+		if (stringParameters[i].code == code) {
+			return getField(reader, G_STRUCT_MEMBER_P(msg, stringParameters[i].offset));
+		}
+	}
+
+	//a user defined parameter is a name followed by its value, both are still read so
+	//that anything they add to the code table is added
+	if (code == BE_USER_DEFINED) {
+		GString* name = getExpression(reader);
+		GString* value = name != NULL ? getExpression(reader) : NULL;
+		if (name != NULL) g_string_free(name, TRUE);
+		if (value == NULL) return FALSE;
+		g_string_free(value, TRUE);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* reads everything in a message after the header
+ * 
+ * reader - the position in the message
+ * returns - the message, NULL if it was badly formed
+ */
+ACLMessage* getMessage(BEReader* reader) {
+	guint8 code;
+	if (!getByte(reader, &code)) return NULL;
+
+	ACLMessage* msg = AP_NEW(MEM_CODEC, ACLMessage, 1);
+	ACLMessageInit(msg);
+	if (code == BE_USER_DEFINED)
+		msg->performative = getExpression(reader);
+	else if (code <= G_N_ELEMENTS(performatives))
+		msg->performative = g_string_new(performatives[code - 1]);
+
+	gboolean ok = msg->performative != NULL;
+	while (ok && !nextIs(reader, BE_END)) {
+		ok = getByte(reader, &code) && getParameter(reader, msg, code);
+	}
+
+	if (!ok) {
+		ACLMessageFree(*msg);
+		AP_FREE(msg);
+		return NULL;
+	}
+	return msg;
+}
+
+/* reads a message written in the bit-efficient representation.  Messages written with a
+ * code table must be read in the order they were written.  If one of them cannot be read
+ * the table is thrown away, as it may no longer be in step with the encoders, and every
+ * later message written with it is refused until the encoder is reset
+ * 
+ * data - the message
+ * length - the number of bytes in the message
+ * codeTable - set to the identifier of the code table the message was written with if it
+ * 	could not be read, the sender must reset the table.  Otherwise set to 0
+ * returns - the message, NULL if it was badly formed or written with a code table that
+ * 	is not in step with the one here
+ */
+ACLMessage* BitEfficientDecode(const guint8* data, gsize length, guint64* codeTable) {
+	BEReader reader;
+	reader.position = data;
+	reader.end = data + length;
+	reader.table = NULL;
+	*codeTable = 0;
+
+	guint8 header, version;
+	if (!getByte(&reader, &header) || !getByte(&reader, &version) || version != BE_VERSION) return NULL;
+	if (header == BE_HEADER) return getMessage(&reader);
+	if (header != BE_HEADER_CODE_TABLE) return NULL;
+
+	//the table is used by one message at a time
+	guint64 id, slot;
+	if (!getNumber(&reader, 8, &id) || !getNumber(&reader, 2, &slot)) return NULL;
+	g_mutex_lock(&theDecodeTables.lock);
+	ACLMessage* msg = NULL;
+	reader.table = findDecodeTable(id, slot);
+	if (reader.table != NULL) {
+		msg = getMessage(&reader);
+		if (msg == NULL) dropDecodeTable(reader.table);
+	}
+	g_mutex_unlock(&theDecodeTables.lock);
+	
+	if (msg == NULL) *codeTable = id;
+	return msg;
+}
+
+/* whether the payload of a message in the given envelope is in the bit-efficient
+ * representation
+ * 
+ * envelope - the envelope
+ * returns - TRUE if the envelope names the bit-efficient representation
+ */
+gboolean isBitEfficientRepresentation(ACLEnvelope* envelope) {
+	return envelope != NULL && envelope->aclRepresentation != NULL &&
+		g_ascii_strcasecmp(envelope->aclRepresentation->str, BIT_EFFICIENT_REPRESENTATION) == 0;
+}
@@ -0,0 +1,36 @@
+/****************************************************************************************
+ * Filename:	BitEfficientCodec.h
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Declarations of the functions that write and read FIPA-ACL messages in the FIPA
+ * bit-efficient representation (fipa.acl.rep.bitefficient.std) and manage the dynamic
+ * code tables it uses
+ * **************************************************************************************/
+
+#ifndef __CODEC__BITEFFICIENTCODEC_H__
+#define __CODEC__BITEFFICIENTCODEC_H__
+
+#include <glib.h>
+#include "../platform-defs.h"
+
+/* the tables used to read messages, by identifier, and the order they were last used in */
+struct stBEDecodeState {
+	GHashTable* tables;
+	GQueue* order;
+	GMutex lock;
+};
+typedef struct stBEDecodeState BEDecodeState;
+extern BEDecodeState theDecodeTables;
+
+ACLCodeTable* ACLCodeTableNew();
+void ACLCodeTableFree(ACLCodeTable* table);
+void ACLCodeTableReset(ACLCodeTable* table);
+void ACLCodeTableLock(ACLCodeTable* table);
+void ACLCodeTableUnlock(ACLCodeTable* table);
+
+void BitEfficientEncode(GString* buffer, ACLMessage* msg, ACLCodeTable* table);
+ACLMessage* BitEfficientDecode(const guint8* data, gsize length, guint64* codeTable);
+gboolean isBitEfficientRepresentation(ACLEnvelope* envelope);
+
+#endif
@@ -10,6 +10,13 @@
 
 #include "DBusCodec.h"
 #include "../API/API.h"
+#include "../Tracing/probes.h"
+#include "../Tracing/memstats.h"
+#include "compression.h"
+#include "sharedContent.h"
+#include "StringCodec.h"
+#include "BitEfficientCodec.h"
+#include <unistd.h>
 #include <string.h>
 
 /************** UTIL FUNCTIONS ****************************************/
@@ -95,7 +102,7 @@ GString* decodeString(DBusMessageIter* iter) {
 	if (g_ascii_strcasecmp("", value) == 0)
 		return NULL;
 	else
-		gstr = g_string_new(value);
+		gstr = AP_STRING_NEW(MEM_CODEC, value);
 	return gstr;
 }
 
@@ -230,7 +237,7 @@ void encodeAID(DBusMessageIter* iter, AID* aid) {
  * returns - the agent identifier read, if an error occurs it returns NULL
  */
 AID* decodeAID(DBusMessageIter* iter) {
-	AID* id = g_new(AID, 1);
+	AID* id = AP_NEW(MEM_CODEC, AID, 1);
 	AIDInit(id);	
 	
 	//get the name of the agent
@@ -248,6 +255,16 @@ AID* decodeAID(DBusMessageIter* iter) {
 	return id;	
 }
 
+/* frees an identifier read off by decodeAID
+ * 
+ * id - the identifier, may be NULL
+ */
+void freeDecodedAID(AID* id) {
+	if (id == NULL) return;
+	AIDFree(*id);
+	AP_FREE(id);
+}
+
 /************ REPLIES *******************************/
 /* creates the contents of a simple reply message that only has a single string
  * denoting success or not
@@ -273,6 +290,54 @@ GString* decodeReply(DBusMessageIter* iter) {
 	
 }
 
+/************ INTEGERS *******************************/
+/* adds a single integer to a message
+ * 
+ * iter - the iterator for the message
+ * value - the integer to be added
+ */
+void encodeInt(DBusMessageIter* iter, int value) {
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_INT32, &value);
+}
+
+/* reads an integer from a message.  Once complete the iterator points to the next item
+ * in the message
+ * 
+ * iter - the iterator for the message
+ * returns - the integer read, or -1 if the next item is not an integer
+ */
+int decodeInt(DBusMessageIter* iter) {
+	int value;
+	if (!checkType(iter, DBUS_TYPE_INT32)) return -1;
+	dbus_message_iter_get_basic(iter, &value);
+	dbus_message_iter_next(iter);
+	return value;
+}
+
+/* adds a 64 bit integer to a message
+ * 
+ * iter - the iterator for the message
+ * value - the integer to add
+ */
+void encodeInt64(DBusMessageIter* iter, gint64 value) {
+	dbus_int64_t temp = value;
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_INT64, &temp);
+}
+
+/* reads a 64 bit integer from a message.  Once complete the iterator points to the next
+ * item in the message
+ * 
+ * iter - the iterator for the message
+ * returns - the integer read, or 0 if the next item is not a 64 bit integer
+ */
+gint64 decodeInt64(DBusMessageIter* iter) {
+	dbus_int64_t value;
+	if (!checkType(iter, DBUS_TYPE_INT64)) return 0;
+	dbus_message_iter_get_basic(iter, &value);
+	dbus_message_iter_next(iter);
+	return value;
+}
+
 /******************* AID ARRAYS *************************************/
 /* adds an array of AIDs to a message using the encoding mechanism for arrays
  * of complex types that has been built on top of the DBus sending mechanism
@@ -391,7 +456,7 @@ void encodeDFService(DBusMessageIter* iter, DFServiceDescription* service) {
  * returns - the DF service description read from the message
  */
 DFServiceDescription* decodeDFService(DBusMessageIter* iter) {
-	DFServiceDescription* value = g_new(DFServiceDescription, 1);
+	DFServiceDescription* value = AP_NEW(MEM_CODEC, DFServiceDescription, 1);
 	DFServiceDescriptionInit(value);
 	
 	//read off the name of the service
@@ -444,7 +509,7 @@ void encodeDFEntry(DBusMessageIter* iter, AgentDFDescription* entry) {
  * returns - the DF description read from the message
  */
 AgentDFDescription* decodeDFEntry(DBusMessageIter* iter) {
-	AgentDFDescription* entry = g_new(AgentDFDescription, 1);
+	AgentDFDescription* entry = AP_NEW(MEM_CODEC, AgentDFDescription, 1);
 	AgentDFDescriptionInit(entry);
 	
 	//first of all read off the agent identifier
@@ -525,6 +590,10 @@ void encodeACLEnvelope(DBusMessageIter* iter, ACLEnvelope* envelope) {
 	
 	//add the intended receiver
 	encodeAID(iter, envelope->intendedReceiver);
+	
+	//add the priority and the deadline
+	encodeInt(iter, envelope->priority);
+	encodeInt64(iter, envelope->deadline);
 }
 
 /* reads off an envelope from a message. Once complete the iterator points to the next
@@ -534,13 +603,14 @@ void encodeACLEnvelope(DBusMessageIter* iter, ACLEnvelope* envelope) {
  * returns - the envelope read
  */
 ACLEnvelope* decodeEnvelope(DBusMessageIter* iter) {
-	ACLEnvelope* envelope = g_new(ACLEnvelope, 1);
+	ACLEnvelope* envelope = AP_NEW(MEM_CODEC, ACLEnvelope, 1);
 	ACLEnvelopeInit(envelope);
 	
 	//get the from field
 	envelope->from = decodeAID(iter);
 	
 	//get the to fields
+	g_array_free(envelope->to, TRUE);
 	envelope->to = decodeAIDArray(iter);
 	
 	//get the acl representation
@@ -550,18 +620,92 @@ ACLEnvelope* decodeEnvelope(DBusMessageIter* iter) {
 	//get the intended receiver
 	envelope->intendedReceiver = decodeAID(iter);
 	//check to see if there is no intended receiver
-	if (envelope->intendedReceiver->name == NULL && envelope->intendedReceiver->addresses->len ==0)
+	if (envelope->intendedReceiver != NULL && envelope->intendedReceiver->name == NULL 
+		&& envelope->intendedReceiver->addresses->len ==0) {
+		freeDecodedAID(envelope->intendedReceiver);
 		envelope->intendedReceiver = NULL;
+	}
+	
+	//get the priority, envelopes without one are of normal priority
+	int priority = decodeInt(iter);
+	if (priority >= 0) ACLEnvelopeSetPriority(envelope, priority);
+	envelope->deadline = decodeInt64(iter);
 	
 	return envelope;
 }
 
-/* adds a FIPA-ACL message to a message
+/* frees an envelope read off by decodeEnvelope along with the identifiers in it.  The 
+ * intended receiver is only freed if it is not also the sender or one of the receivers
+ * 
+ * envelope - the envelope, may be NULL
+ */
+void freeDecodedEnvelope(ACLEnvelope* envelope) {
+	if (envelope == NULL) return;
+	AID* intended = envelope->intendedReceiver;
+	int i;
+	for (i=0; i<envelope->to->len; i++) {
+		AID* id = g_array_index(envelope->to, AID*, i);
+		if (id == intended) intended = NULL;
+		freeDecodedAID(id);
+	}
+	g_array_free(envelope->to, TRUE);
+	if (intended == envelope->from) intended = NULL;
+	freeDecodedAID(intended);
+	freeDecodedAID(envelope->from);
+	if (envelope->aclRepresentation != NULL) AP_STRING_FREE(envelope->aclRepresentation, TRUE);
+	AP_FREE(envelope);
+}
+
+/* adds the encoding of a message with a flag on the end that says how the content 
+ * has been sent
+ * 
+ * iter - the iterator for the message
+ * encoding - the encoding of the message, may be NULL
+ * flag - the flag to add
+ */
+void encodeFlaggedEncoding(DBusMessageIter* iter, GString* encoding, char* flag) {
+	GString* flagged = g_string_new(encoding == NULL ? "" : encoding->str);
+	g_string_append(flagged, flag);
+	encodeString(iter, flagged);
+	g_string_free(flagged, TRUE);
+}
+
+/* checks whether a decoded encoding ends with a flag and if so removes it
+ * 
+ * encoding - the encoding read from the message, set to NULL if only the flag was sent
+ * flag - the flag to look for
+ * returns - TRUE if the flag was found
+ */
+gboolean takeEncodingFlag(GString** encoding, char* flag) {
+	int flagLength = strlen(flag);
+	if (*encoding == NULL || (*encoding)->len < flagLength) return FALSE;
+	if (strcmp((*encoding)->str + (*encoding)->len - flagLength, flag) != 0) return FALSE;
+	
+	g_string_truncate(*encoding, (*encoding)->len - flagLength);
+	if ((*encoding)->len == 0) {
+		g_string_free(*encoding, TRUE);
+		*encoding = NULL;
+	}
+	return TRUE;
+}
+
+/* adds a FIPA-ACL message to a message, very large content is passed in shared memory if
+ * this process is able to
  * 
  * iter - the iterator for the message
  * msg - the message to be added
  */
 void encodeACLMessage(DBusMessageIter* iter, ACLMessage* msg) {
+	encodeACLMessageSharing(iter, msg, sharedContentEnabled());
+}
+
+/* adds a FIPA-ACL message to a message
+ * 
+ * iter - the iterator for the message
+ * msg - the message to be added
+ * share - TRUE if the receiver can be passed the content in shared memory
+ */
+void encodeACLMessageSharing(DBusMessageIter* iter, ACLMessage* msg, gboolean share) {
 	//encode the performative
 	encodeString(iter, msg->performative);
 	
@@ -582,8 +726,40 @@ void encodeACLMessage(DBusMessageIter* iter, ACLMessage* msg) {
 	encodeString(iter, msg->inReplyTo);
 	encodeString(iter, msg->replyBy);
 	
-	//encode the content
-	encodeString(iter, msg->content);
+	//encode the encoding and the content.  Very large content is passed in shared memory
+	//and large content is compressed and sent as bytes, in both cases the encoding is 
+	//flagged to say so.  Content that has not been read since it arrived, as when the MTS
+	//passes a message on, is sent on as it arrived unless the receiver cannot be passed it
+	int fd = -1;
+	if (!share && msg->content == NULL && msg->contentFd >= 0)
+		ACLMessageGetContent(msg);
+	if (share && msg->content == NULL && msg->contentFd >= 0) 
+		fd = msg->contentFd;
+	else if (share && msg->content != NULL && msg->content->len >= SHARED_CONTENT_THRESHOLD)
+		fd = shareContent(msg->content);
+	if (fd >= 0) {
+		encodeFlaggedEncoding(iter, msg->encoding, SHARED_CONTENT_FLAG);
+		dbus_message_iter_append_basic(iter, DBUS_TYPE_UNIX_FD, &fd);
+		//the message holds its own copy of the descriptor
+		if (fd != msg->contentFd) close(fd);
+		return;
+	}
+	
+	GByteArray* compressed = msg->compressedContent;
+	if (msg->content != NULL) compressed = compressContent(msg->content);
+	if (compressed == NULL) {
+		encodeString(iter, msg->encoding);
+		encodeString(iter, msg->content);
+	}
+	else {
+		encodeFlaggedEncoding(iter, msg->encoding, COMPRESSION_FLAG);
+		
+		DBusMessageIter bytesIter;
+		dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE_AS_STRING, &bytesIter);
+		dbus_message_iter_append_fixed_array(&bytesIter, DBUS_TYPE_BYTE, &compressed->data, compressed->len);
+		dbus_message_iter_close_container(iter, &bytesIter);
+		if (compressed != msg->compressedContent) g_byte_array_free(compressed, TRUE);
+	}
 }
 
 /* reads off a FIPA-ACL message from a message.  Once complete the iterator points
@@ -593,7 +769,7 @@ void encodeACLMessage(DBusMessageIter* iter, ACLMessage* msg) {
  * returns - the message read off
  */
 ACLMessage* decodeACLMessage(DBusMessageIter* iter) {
-	ACLMessage* msg = g_new(ACLMessage, 1);
+	ACLMessage* msg = AP_NEW(MEM_CODEC, ACLMessage, 1);
 	ACLMessageInit(msg);
 	
 	//decode the performative
@@ -602,8 +778,10 @@ ACLMessage* decodeACLMessage(DBusMessageIter* iter) {
 	
 	//get the sender
 	msg->sender = decodeAID(iter);
-	if (msg->sender->name == NULL && msg->sender->addresses->len ==0)
+	if (msg->sender != NULL && msg->sender->name == NULL && msg->sender->addresses->len ==0) {
+		freeDecodedAID(msg->sender);
 		msg->sender = NULL;
+	}
 		
 	//get the receivers
 	msg->receivers = decodeAIDArray(iter);
@@ -626,41 +804,202 @@ ACLMessage* decodeACLMessage(DBusMessageIter* iter) {
 	msg->replyBy = decodeString(iter);
 	dbus_message_iter_next(iter);
 	
-	//get the content of the message
-	msg->content = decodeString(iter);
+	//get the encoding, removing any flag that says how the content was sent
+	msg->encoding = decodeString(iter);
+	dbus_message_iter_next(iter);
+	
+	//get the content of the message, content passed in shared memory or compressed is 
+	//kept as it arrived until it is read
+	if (takeEncodingFlag(&msg->encoding, SHARED_CONTENT_FLAG) && checkType(iter, DBUS_TYPE_UNIX_FD)) {
+		dbus_message_iter_get_basic(iter, &msg->contentFd);
+	}
+	else if (takeEncodingFlag(&msg->encoding, COMPRESSION_FLAG) && checkType(iter, DBUS_TYPE_ARRAY)) {
+		DBusMessageIter bytesIter;
+		guint8* bytes;
+		int length;
+		dbus_message_iter_recurse(iter, &bytesIter);
+		dbus_message_iter_get_fixed_array(&bytesIter, &bytes, &length);
+		msg->compressedContent = g_byte_array_sized_new(length);
+		g_byte_array_append(msg->compressedContent, bytes, length);
+	}
+	else
+		msg->content = decodeString(iter);
 	dbus_message_iter_next(iter);
 	
 	return msg;
 }
 
+/* frees the representation buffer of a thread when the thread ends */
+void freeStringBuffer(gpointer buffer) {
+	g_string_free((GString*)buffer, TRUE);
+}
+
+DBusCodecState theDBusCodec = {G_PRIVATE_INIT(freeStringBuffer)}; /* the one and only codec state */
+
+/* adds the payload of an agent message in the representation named by its envelope.  The
+ * FIPA string and bit-efficient representations are sent as bytes
+ * 
+ * iter - the iterator for the message
+ * envelope - the envelope of the message
+ * msg - the payload to be added
+ * table - the code table for the hop the message is sent over, only used by the 
+ * 	bit-efficient representation, may be NULL
+ * share - TRUE if the receiver can be passed the content in shared memory
+ */
+void encodePayload(DBusMessageIter* iter, ACLEnvelope* envelope, ACLMessage* msg, ACLCodeTable* table,
+	gboolean share) {
+	gboolean bitEfficient = isBitEfficientRepresentation(envelope);
+	if (!bitEfficient && !isStringRepresentation(envelope)) {
+		encodeACLMessageSharing(iter, msg, share);
+		return;
+	}
+	
+	GString* buffer = g_private_get(&theDBusCodec.stringBuffer);
+	if (buffer == NULL) {
+		buffer = g_string_sized_new(1024);
+		g_private_set(&theDBusCodec.stringBuffer, buffer);
+	}
+	g_string_truncate(buffer, 0);
+	if (bitEfficient)
+		BitEfficientEncode(buffer, msg, table);
+	else
+		ACLStringEncode(buffer, msg);
+	
+	DBusMessageIter bytesIter;
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE_AS_STRING, &bytesIter);
+	dbus_message_iter_append_fixed_array(&bytesIter, DBUS_TYPE_BYTE, &buffer->str, buffer->len);
+	dbus_message_iter_close_container(iter, &bytesIter);
+}
+
+/* reads off the payload of an agent message in the representation named by its envelope.
+ * Once complete the iterator points to the next item in the message
+ * 
+ * iter - the iterator for the message
+ * envelope - the envelope of the message, already read off
+ * codeTable - set to the identifier of the code table a bit-efficient payload was written
+ * 	with if it could not be read, the sender must be told to reset the table.  Otherwise
+ * 	set to 0
+ * returns - the payload, NULL if it was written with a code table that is not in step 
+ * 	with the one here, an empty message if it could not be read for any other reason
+ */
+ACLMessage* decodePayload(DBusMessageIter* iter, ACLEnvelope* envelope, guint64* codeTable) {
+	*codeTable = 0;
+	gboolean bitEfficient = isBitEfficientRepresentation(envelope);
+	if (!bitEfficient && !isStringRepresentation(envelope)) return decodeACLMessage(iter);
+	
+	ACLMessage* msg = NULL;
+	if (checkType(iter, DBUS_TYPE_ARRAY)) {
+		DBusMessageIter bytesIter;
+		char* text;
+		int length;
+		dbus_message_iter_recurse(iter, &bytesIter);
+		dbus_message_iter_get_fixed_array(&bytesIter, &text, &length);
+		if (bitEfficient)
+			msg = BitEfficientDecode((const guint8*)text, length, codeTable);
+		else
+			msg = ACLStringDecode(text, length);
+		dbus_message_iter_next(iter);
+	}
+	
+	if (msg == NULL && *codeTable != 0) {
+		g_message("CODEC: message written with code table " ACL_CODE_TABLE_ID_FORMAT " could not be read", *codeTable);
+	}
+	else if (msg == NULL) {
+		g_message("CODEC: badly formed message in the %s representation", envelope->aclRepresentation->str);
+		msg = AP_NEW(MEM_CODEC, ACLMessage, 1);
+		ACLMessageInit(msg);
+	}
+	return msg;
+}
+
+/* moves the iterator past the payload of a message that is being dropped unread.  A
+ * bit-efficient payload is still read, and thrown away, so that the code table it was 
+ * written with stays in step with the one it is read with
+ * 
+ * iter - the iterator for the message
+ * envelope - the envelope of the message, already read off
+ * codeTable - set as by decodePayload
+ */
+void skipPayload(DBusMessageIter* iter, ACLEnvelope* envelope, guint64* codeTable) {
+	*codeTable = 0;
+	if (!isBitEfficientRepresentation(envelope)) return;
+	freeDecodedPayload(decodePayload(iter, envelope, codeTable));
+}
+
+/* frees a payload read off by decodePayload or decodeACLMessage, every identifier in it
+ * was read off with it and is freed as well
+ * 
+ * msg - the payload, may be NULL
+ */
+void freeDecodedPayload(ACLMessage* msg) {
+	if (msg == NULL) return;
+	int i;
+	for (i=0; i<msg->receivers->len; i++) freeDecodedAID(g_array_index(msg->receivers, AID*, i));
+	for (i=0; i<msg->replyTo->len; i++) freeDecodedAID(g_array_index(msg->replyTo, AID*, i));
+	ACLMessageFree(*msg);
+	if (msg->sender != NULL) AP_FREE(msg->sender);
+	AP_FREE(msg);
+}
+
+/* frees an agent message whose envelope and payload were read off a DBus message
+ * 
+ * message - the message, the payload may not have been read
+ */
+void freeDecodedAgentMessage(AgentMessage* message) {
+	freeDecodedEnvelope(message->envelope);
+	freeDecodedPayload(message->payload);
+	AP_FREE(message);
+}
+
 /* adds an entire agent message to a DBus message
  * 
  * iter - the iterator for the message
  * msg - the agent message to be added
  */
 void encodeAgentMessage(DBusMessageIter* iter, AgentMessage* msg) {
+	encodeAgentMessageWithTable(iter, msg, NULL, sharedContentEnabled());
+}
+
+/* adds an entire agent message to a DBus message, a payload in the bit-efficient 
+ * representation is written with the given code table
+ * 
+ * iter - the iterator for the message
+ * msg - the agent message to be added
+ * table - the code table for the hop the message is sent over, may be NULL
+ * share - TRUE if the receiver can be passed the content in shared memory, see
+ * 	addressAcceptsSharedContent
+ */
+void encodeAgentMessageWithTable(DBusMessageIter* iter, AgentMessage* msg, ACLCodeTable* table, gboolean share) {
+	AP_PROBE(codec_encode_entry);
+	
 	//enocde the envelope
 	encodeACLEnvelope(iter, msg->envelope);
 	
 	//encode the payload
-	encodeACLMessage(iter, msg->payload);	
+	encodePayload(iter, msg->envelope, msg->payload, table, share);
+	
+	AP_PROBE(codec_encode_return);
 }
 
 /* reads off an agent message from a message. Once complete the iterator points
  * to the next item in the message
  * 
  * iter - the iterator for the message
- * returns - the agent message read
+ * returns - the agent message read, the payload is NULL if it was written with a code
+ * 	table that is not in step with the one here
  */
 AgentMessage* decodeAgentMessage(DBusMessageIter* iter) {
-	AgentMessage* message = g_new(AgentMessage, 1);
+	AP_PROBE(codec_decode_entry);
+	AgentMessage* message = AP_NEW(MEM_CODEC, AgentMessage, 1);
 	AgentMessageInit(message);
 	
 	//decode the envelope
 	message->envelope = decodeEnvelope(iter);
 	
 	//decode the payload
-	message->payload = decodeACLMessage(iter);
+	guint64 codeTable;
+	message->payload = decodePayload(iter, message->envelope, &codeTable);
 	
+	AP_PROBE(codec_decode_return);
 	return message;
 }
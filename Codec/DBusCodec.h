@@ -14,11 +14,22 @@
 #include <dbus/dbus.h>
 #include "../platform-defs.h"
 
+/* the buffer each thread writes messages in the string and bit-efficient representations
+ * into, kept from message to message so that it only grows to the size of the largest */
+struct stDBusCodecState {
+	GPrivate stringBuffer;
+};
+typedef struct stDBusCodecState DBusCodecState;
+extern DBusCodecState theDBusCodec;
+
+void freeStringBuffer(gpointer buffer);
+
 void encodePlatformDescription(DBusMessageIter* iter, PlatformDescription* desc);
 PlatformDescription* decodePlatformDescription(DBusMessageIter* iter);
 
 void encodeAID(DBusMessageIter* iter, AID* aid);
 AID* decodeAID(DBusMessageIter* iter);
+void freeDecodedAID(AID* id);
 
 void encodeReply(DBusMessageIter* iter, char* message);
 GString* decodeReply(DBusMessageIter* iter);
@@ -35,11 +46,27 @@ DFServiceDescription* decodeDFService(DBusMessageIter* iter);
 void encodeString(DBusMessageIter* iter, GString* str);
 GString* decodeString(DBusMessageIter* iter);
 
+void encodeInt(DBusMessageIter* iter, int value);
+int decodeInt(DBusMessageIter* iter);
+void encodeInt64(DBusMessageIter* iter, gint64 value);
+gint64 decodeInt64(DBusMessageIter* iter);
+
 void encodeDFEntryArray(DBusMessageIter* iter, GArray* array);
 GArray* decodeDFEntryArray(DBusMessageIter* iter);
 
 void encodeAgentMessage(DBusMessageIter* iter, AgentMessage* msg);
+void encodeAgentMessageWithTable(DBusMessageIter* iter, AgentMessage* msg, ACLCodeTable* table, gboolean share);
 AgentMessage* decodeAgentMessage(DBusMessageIter* iter);
+ACLEnvelope* decodeEnvelope(DBusMessageIter* iter);
+void encodeACLMessage(DBusMessageIter* iter, ACLMessage* msg);
+void encodeACLMessageSharing(DBusMessageIter* iter, ACLMessage* msg, gboolean share);
+ACLMessage* decodeACLMessage(DBusMessageIter* iter);
+void encodePayload(DBusMessageIter* iter, ACLEnvelope* envelope, ACLMessage* msg, ACLCodeTable* table, gboolean share);
+ACLMessage* decodePayload(DBusMessageIter* iter, ACLEnvelope* envelope, guint64* codeTable);
+void skipPayload(DBusMessageIter* iter, ACLEnvelope* envelope, guint64* codeTable);
+void freeDecodedEnvelope(ACLEnvelope* envelope);
+void freeDecodedPayload(ACLMessage* msg);
+void freeDecodedAgentMessage(AgentMessage* message);
 
 
 #endif
@@ -0,0 +1,530 @@
+/****************************************************************************************
+ * Filename:	StringCodec.c
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Writes and reads FIPA-ACL messages in the FIPA string representation so that the
+ * platform can exchange messages with agents outside of it.  Messages are written into a
+ * buffer supplied by the caller so that it can be reused from message to message.  The
+ * tokenizer never copies the text it is given, tokens point straight into it and text is
+ * only copied when a field of the message is filled in.  Finding the end of words and
+ * quoted strings is done sixteen bytes at a time with SSE2 where it is available.
+ * **************************************************************************************/
+
+#include "StringCodec.h"
+#include "../API/API.h"
+#include "../Tracing/memstats.h"
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+typedef enum {
+	TOKEN_OPEN,
+	TOKEN_CLOSE,
+	TOKEN_WORD,
+	TOKEN_STRING,
+	TOKEN_END,
+	TOKEN_ERROR
+} ACLTokenType;
+
+/* a token points into the text being read, escaped is set for a quoted string that has
+ * backslashes in it that need to be taken out when it is copied */
+struct stACLToken {
+	ACLTokenType type;
+	const char* start;
+	gsize length;
+	gboolean escaped;
+};
+typedef struct stACLToken ACLToken;
+
+struct stACLTokenizer {
+	const char* position;
+	const char* end;
+};
+typedef struct stACLTokenizer ACLTokenizer;
+
+//the parameters of a message that are held as a single string, in the order they are written
+static const struct {
+	const char* name;
+	glong offset;
+} stringParameters[] = {
+	{":language", G_STRUCT_OFFSET(ACLMessage, language)},
+	{":encoding", G_STRUCT_OFFSET(ACLMessage, encoding)},
+	{":ontology", G_STRUCT_OFFSET(ACLMessage, ontology)},
+	{":protocol", G_STRUCT_OFFSET(ACLMessage, protocol)},
+	{":conversation-id", G_STRUCT_OFFSET(ACLMessage, conversationID)},
+	{":reply-with", G_STRUCT_OFFSET(ACLMessage, replyWith)},
+	{":in-reply-to", G_STRUCT_OFFSET(ACLMessage, inReplyTo)},
+	{":reply-by", G_STRUCT_OFFSET(ACLMessage, replyBy)}
+};
+
+gboolean isExpression(GString* value);
+
+/************** SCANNING ****************************************/
+/* finds the end of a word, which is the first space or control character, bracket or quote
+ * 
+ * p - where the word starts
+ * end - the end of the text
+ * returns - the first character that is not part of the word
+ */
+const char* scanWord(const char* p, const char* end) {
+#ifdef __SSE2__
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i open = _mm_set1_epi8('(');
+	const __m128i close = _mm_set1_epi8(')');
+	const __m128i quote = _mm_set1_epi8('"');
+	while (end - p >= 16) {
+		__m128i block = _mm_loadu_si128((const __m128i*)p);
+		//a byte is no greater than a space when the larger of the two is the space
+		__m128i hits = _mm_cmpeq_epi8(_mm_max_epu8(block, space), space);
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, open));
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, close));
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, quote));
+		int mask = _mm_movemask_epi8(hits);
+		if (mask != 0) return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#endif
+	while (p < end && (guchar)*p > ' ' && *p != '(' && *p != ')' && *p != '"') p++;
+	return p;
+}
+
+/* finds the next quote or backslash, which is either the end of a quoted string or a
+ * character that has been escaped
+ * 
+ * p - where to start looking
+ * end - the end of the text
+ * returns - the quote or backslash, or end if there is neither
+ */
+const char* scanQuote(const char* p, const char* end) {
+#ifdef __SSE2__
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	while (end - p >= 16) {
+		__m128i block = _mm_loadu_si128((const __m128i*)p);
+		__m128i hits = _mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash));
+		int mask = _mm_movemask_epi8(hits);
+		if (mask != 0) return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#endif
+	while (p < end && *p != '"' && *p != '\\') p++;
+	return p < end ? p : end;
+}
+
+/************** WRITING ****************************************/
+/* writes text as a string, text with no quotes or backslashes in it is quoted and anything
+ * else is written with its length in front so that it never has to be escaped
+ * 
+ * buffer - where to write the string
+ * text - the text
+ * length - the number of bytes of text
+ */
+void appendString(GString* buffer, const char* text, gsize length) {
+	if (scanQuote(text, text + length) == text + length) {
+		g_string_append_c(buffer, '"');
+		g_string_append_len(buffer, text, length);
+		g_string_append_c(buffer, '"');
+	}
+	else {
+		g_string_append_printf(buffer, "#%lu\"", (unsigned long)length);
+		g_string_append_len(buffer, text, length);
+	}
+}
+
+/* writes a value as a word or bracketed expression when it can be read back as one,
+ * otherwise as a string.  A word may not start with ':' or '?', which would be read back
+ * as a parameter name or a variable
+ * 
+ * buffer - where to write the value
+ * value - the value
+ */
+void appendExpression(GString* buffer, GString* value) {
+	const char* first = value->str;
+	gboolean word = value->len > 0 && strchr("#0123456789-@:?", *first) == NULL &&
+		scanWord(first, first + value->len) == first + value->len;
+	if (word || (value->len > 0 && *first == '(' && isExpression(value)))
+		g_string_append_len(buffer, value->str, value->len);
+	else
+		appendString(buffer, value->str, value->len);
+}
+
+/* writes an agent identifier
+ * 
+ * buffer - where to write the identifier
+ * id - the identifier
+ */
+void appendAID(GString* buffer, AID* id) {
+	g_string_append(buffer, "(agent-identifier :name ");
+	if (id->name != NULL)
+		appendExpression(buffer, id->name);
+	else
+		g_string_append(buffer, "\"\"");
+
+	if (id->addresses->len > 0) {
+		g_string_append(buffer, " :addresses (sequence");
+		int i;
+		for (i=0; i<id->addresses->len; i++) {
+			g_string_append_c(buffer, ' ');
+			appendExpression(buffer, g_array_index(id->addresses, GString*, i));
+		}
+		g_string_append_c(buffer, ')');
+	}
+	g_string_append_c(buffer, ')');
+}
+
+/* writes a set of agent identifiers as a parameter of a message
+ * 
+ * buffer - where to write the set
+ * name - the name of the parameter
+ * ids - the identifiers
+ */
+void appendAIDSet(GString* buffer, const char* name, GArray* ids) {
+	g_string_append_printf(buffer, " %s (set", name);
+	int i;
+	for (i=0; i<ids->len; i++) {
+		g_string_append_c(buffer, ' ');
+		appendAID(buffer, g_array_index(ids, AID*, i));
+	}
+	g_string_append_c(buffer, ')');
+}
+
+/* writes a message in the FIPA string representation onto the end of a buffer, the buffer
+ * can be truncated and used again for the next message
+ * 
+ * buffer - where to write the message
+ * msg - the message, which must have a performative
+ */
+void ACLStringEncode(GString* buffer, ACLMessage* msg) {
+	g_string_append_c(buffer, '(');
+	if (msg->performative != NULL) g_string_append_len(buffer, msg->performative->str, msg->performative->len);
+
+	if (msg->sender != NULL) {
+		g_string_append(buffer, " :sender ");
+		appendAID(buffer, msg->sender);
+	}
+	if (msg->receivers->len > 0) appendAIDSet(buffer, ":receiver", msg->receivers);
+	if (msg->replyTo->len > 0) appendAIDSet(buffer, ":reply-to", msg->replyTo);
+
+	GString* content = ACLMessageGetContent(msg);
+	if (content != NULL) {
+		g_string_append(buffer, " :content ");
+		appendString(buffer, content->str, content->len);
+	}
+
+	int i;
+	for (i=0; i<G_N_ELEMENTS(stringParameters); i++) {
+		GString* value = G_STRUCT_MEMBER(GString*, msg, stringParameters[i].offset);
+		if (value == NULL) continue;
+		g_string_append_printf(buffer, " %s ", stringParameters[i].name);
+		appendExpression(buffer, value);
+	}
+	g_string_append_c(buffer, ')');
+}
+
+/************** READING ****************************************/
+/* reads the next token, moving the tokenizer past it
+ * 
+ * tokenizer - the tokenizer
+ * returns - the token, TOKEN_ERROR if the text is badly formed
+ */
+ACLToken nextToken(ACLTokenizer* tokenizer) {
+	ACLToken token;
+	const char* p = tokenizer->position;
+	const char* end = tokenizer->end;
+	token.escaped = FALSE;
+	token.length = 0;
+
+	while (p < end && (guchar)*p <= ' ') p++;
+	token.start = p;
+	if (p >= end) {
+		token.type = TOKEN_END;
+	}
+	else if (*p == '(' || *p == ')') {
+		token.type = *p == '(' ? TOKEN_OPEN : TOKEN_CLOSE;
+		token.length = 1;
+		p++;
+	}
+	else if (*p == '"') {
+		//a quoted string ends at the first quote that has not been escaped
+		const char* q = scanQuote(p + 1, end);
+		while (q < end && *q == '\\') {
+			token.escaped = TRUE;
+			q = q + 2 < end ? scanQuote(q + 2, end) : end;
+		}
+		if (q >= end) {
+			token.type = TOKEN_ERROR;
+			p = end;
+		}
+		else {
+			token.type = TOKEN_STRING;
+			token.start = p + 1;
+			token.length = q - (p + 1);
+			p = q + 1;
+		}
+	}
+	else if (*p == '#') {
+		//a string given by its length, #<digits>" followed by that many bytes
+		const char* q = p + 1;
+		gsize length = 0;
+		while (q < end && g_ascii_isdigit(*q) && length < G_MAXUINT32) length = length * 10 + (*q++ - '0');
+		if (q == p + 1 || q >= end || *q != '"' || (gsize)(end - q - 1) < length) {
+			token.type = TOKEN_ERROR;
+			p = end;
+		}
+		else {
+			token.type = TOKEN_STRING;
+			token.start = q + 1;
+			token.length = length;
+			p = q + 1 + length;
+		}
+	}
+	else {
+		const char* q = scanWord(p, end);
+		token.type = q == p ? TOKEN_ERROR : TOKEN_WORD;
+		token.length = q - p;
+		p = q == p ? end : q;
+	}
+
+	tokenizer->position = p;
+	return token;
+}
+
+/* whether a word token is the given word, ignoring case
+ * 
+ * token - the token
+ * word - the word
+ * returns - TRUE if they are the same
+ */
+gboolean tokenIs(ACLToken token, const char* word) {
+	return token.type == TOKEN_WORD && token.length == strlen(word) &&
+		g_ascii_strncasecmp(token.start, word, token.length) == 0;
+}
+
+/* copies the text of a word or string token, taking out any escaping
+ * 
+ * token - the token
+ * returns - a new string holding the text
+ */
+GString* tokenString(ACLToken token) {
+	if (!token.escaped) return g_string_new_len(token.start, token.length);
+
+	GString* value = g_string_sized_new(token.length);
+	const char* p = token.start;
+	const char* end = token.start + token.length;
+	while (p < end) {
+		const char* q = scanQuote(p, end);
+		g_string_append_len(value, p, q - p);
+		if (q >= end) break;
+		//keep the character after the backslash whatever it is
+		if (q + 1 < end) g_string_append_c(value, q[1]);
+		p = q + 2;
+	}
+	return value;
+}
+
+/* moves the tokenizer past an expression, which is a word, a string or anything in
+ * brackets
+ * 
+ * tokenizer - the tokenizer
+ * first - the first token of the expression, which has already been read
+ * returns - TRUE if the expression was well formed
+ */
+gboolean skipExpression(ACLTokenizer* tokenizer, ACLToken first) {
+	if (first.type == TOKEN_WORD || first.type == TOKEN_STRING) return TRUE;
+	if (first.type != TOKEN_OPEN) return FALSE;
+
+	int depth = 1;
+	while (depth > 0) {
+		ACLToken token = nextToken(tokenizer);
+		if (token.type == TOKEN_OPEN) depth++;
+		else if (token.type == TOKEN_CLOSE) depth--;
+		else if (token.type == TOKEN_END || token.type == TOKEN_ERROR) return FALSE;
+	}
+	return TRUE;
+}
+
+/* whether a value is exactly one bracketed expression, so that it can be written as it is
+ * 
+ * value - the value
+ * returns - TRUE if the value is a single well formed expression
+ */
+gboolean isExpression(GString* value) {
+	ACLTokenizer tokenizer;
+	tokenizer.position = value->str;
+	tokenizer.end = value->str + value->len;
+	ACLToken first = nextToken(&tokenizer);
+	return first.type == TOKEN_OPEN && skipExpression(&tokenizer, first) &&
+		nextToken(&tokenizer).type == TOKEN_END;
+}
+
+/* reads an expression into a field of a message.  Words and strings are held as their
+ * text and anything in brackets is held as it was written
+ * 
+ * tokenizer - the tokenizer
+ * field - the field to fill in, any value it already has is freed
+ * returns - TRUE if the expression was well formed
+ */
+gboolean readExpression(ACLTokenizer* tokenizer, GString** field) {
+	ACLToken token = nextToken(tokenizer);
+	GString* value;
+	if (token.type == TOKEN_WORD || token.type == TOKEN_STRING) {
+		value = tokenString(token);
+	}
+	else if (skipExpression(tokenizer, token)) {
+		value = g_string_new_len(token.start, tokenizer->position - token.start);
+	}
+	else {
+		return FALSE;
+	}
+
+	if (*field != NULL) g_string_free(*field, TRUE);
+	*field = value;
+	return TRUE;
+}
+
+/* reads an agent identifier, parameters other than the name and addresses are skipped
+ * 
+ * tokenizer - the tokenizer
+ * first - the token that opens the identifier, which has already been read
+ * returns - the identifier or NULL if it was badly formed or has no name
+ */
+AID* readAID(ACLTokenizer* tokenizer, ACLToken first) {
+	if (first.type != TOKEN_OPEN || !tokenIs(nextToken(tokenizer), "agent-identifier")) return NULL;
+
+	AID* id = AP_NEW(MEM_CODEC, AID, 1);
+	AIDInit(id);
+	gboolean ok = TRUE;
+	while (ok) {
+		ACLToken token = nextToken(tokenizer);
+		if (token.type == TOKEN_CLOSE) break;
+
+		if (tokenIs(token, ":name")) {
+			ok = readExpression(tokenizer, &id->name);
+		}
+		else if (tokenIs(token, ":addresses")) {
+			ok = nextToken(tokenizer).type == TOKEN_OPEN && tokenIs(nextToken(tokenizer), "sequence");
+			while (ok) {
+				token = nextToken(tokenizer);
+				if (token.type == TOKEN_CLOSE) break;
+				if (token.type != TOKEN_WORD && token.type != TOKEN_STRING) {
+					ok = FALSE;
+				}
+				else {
+					GString* address = tokenString(token);
+					g_array_append_val(id->addresses, address);
+				}
+			}
+		}
+		else if (token.type == TOKEN_WORD && token.start[0] == ':') {
+			ok = skipExpression(tokenizer, nextToken(tokenizer));
+		}
+		else {
+			ok = FALSE;
+		}
+	}
+
+	if (!ok || id->name == NULL) {
+		AIDFree(*id);
+		AP_FREE(id);
+		return NULL;
+	}
+	return id;
+}
+
+/* reads a set of agent identifiers onto the end of an array
+ * 
+ * tokenizer - the tokenizer
+ * ids - the array to add the identifiers to
+ * returns - TRUE if the set was well formed
+ */
+gboolean readAIDSet(ACLTokenizer* tokenizer, GArray* ids) {
+	if (nextToken(tokenizer).type != TOKEN_OPEN || !tokenIs(nextToken(tokenizer), "set")) return FALSE;
+
+	for (;;) {
+		ACLToken token = nextToken(tokenizer);
+		if (token.type == TOKEN_CLOSE) return TRUE;
+		AID* id = readAID(tokenizer, token);
+		if (id == NULL) return FALSE;
+		g_array_append_val(ids, id);
+	}
+}
+
+/* reads the value of one parameter of a message, parameters that are not part of the
+ * message structure are skipped
+ * 
+ * tokenizer - the tokenizer
+ * msg - the message to fill in
+ * name - the token holding the name of the parameter
+ * returns - TRUE if the value was well formed
+ */
+gboolean readParameter(ACLTokenizer* tokenizer, ACLMessage* msg, ACLToken name) {
+	if (tokenIs(name, ":sender")) {
+		AID* id = readAID(tokenizer, nextToken(tokenizer));
+		if (id == NULL) return FALSE;
+		if (msg->sender != NULL) {
+			AIDFree(*msg->sender);
+			g_free(msg->sender);
+		}
+		msg->sender = id;
+		return TRUE;
+	}
+	if (tokenIs(name, ":receiver")) return readAIDSet(tokenizer, msg->receivers);
+	if (tokenIs(name, ":reply-to")) return readAIDSet(tokenizer, msg->replyTo);
+	if (tokenIs(name, ":content")) return readExpression(tokenizer, &msg->content);
+
+	int i;
+	for (i=0; i<G_N_ELEMENTS(stringParameters); i++) {
+		if (tokenIs(name, stringParameters[i].name)) {
+			return readExpression(tokenizer, G_STRUCT_MEMBER_P(msg, stringParameters[i].offset));
+		}
+	}
+	return skipExpression(tokenizer, nextToken(tokenizer));
+}
+
+/* reads a message written in the FIPA string representation
+ * 
+ * text - the text of the message, it does not need to be null terminated
+ * length - the number of bytes of text
+ * returns - the message or NULL if the text is not a well formed message
+ */
+ACLMessage* ACLStringDecode(const char* text, gsize length) {
+	ACLTokenizer tokenizer;
+	tokenizer.position = text;
+	tokenizer.end = text + length;
+
+	ACLToken token = nextToken(&tokenizer);
+	if (token.type != TOKEN_OPEN) return NULL;
+	token = nextToken(&tokenizer);
+	if (token.type != TOKEN_WORD) return NULL;
+
+	ACLMessage* msg = AP_NEW(MEM_CODEC, ACLMessage, 1);
+	ACLMessageInit(msg);
+	msg->performative = tokenString(token);
+
+	gboolean ok = TRUE;
+	while (ok) {
+		token = nextToken(&tokenizer);
+		if (token.type == TOKEN_CLOSE) break;
+		ok = token.type == TOKEN_WORD && token.start[0] == ':' && readParameter(&tokenizer, msg, token);
+	}
+
+	if (!ok) {
+		ACLMessageFree(*msg);
+		AP_FREE(msg);
+		return NULL;
+	}
+	return msg;
+}
+
+/* whether the payload of a message in the given envelope is in the FIPA string
+ * representation
+ * 
+ * envelope - the envelope
+ * returns - TRUE if the envelope names the string representation
+ */
+gboolean isStringRepresentation(ACLEnvelope* envelope) {
+	return envelope != NULL && envelope->aclRepresentation != NULL &&
+		g_ascii_strcasecmp(envelope->aclRepresentation->str, FIPA_STRING_REPRESENTATION) == 0;
+}
@@ -0,0 +1,20 @@
+/****************************************************************************************
+ * Filename:	StringCodec.h
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Declarations of the functions that write and read FIPA-ACL messages in the FIPA string
+ * representation (fipa.acl.rep.string.std)
+ * **************************************************************************************/
+
+#ifndef __CODEC__STRINGCODEC_H__
+#define __CODEC__STRINGCODEC_H__
+
+#include <glib.h>
+#include "../platform-defs.h"
+
+void ACLStringEncode(GString* buffer, ACLMessage* msg);
+ACLMessage* ACLStringDecode(const char* text, gsize length);
+gboolean isStringRepresentation(ACLEnvelope* envelope);
+
+#endif
@@ -10,5 +10,9 @@
 #define __CODEC__CODECS_H__
 
 #include "DBusCodec.h"
+#include "compression.h"
+#include "sharedContent.h"
+#include "StringCodec.h"
+#include "BitEfficientCodec.h"
 
 #endif
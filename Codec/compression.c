@@ -0,0 +1,80 @@
+/****************************************************************************************
+ * Filename:	compression.c
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Compression of the content of large messages using zlib through the GIO converters.
+ * The codec compresses content over COMPRESSION_THRESHOLD bytes when it is encoded and
+ * marks the encoding of the message with COMPRESSION_FLAG.  The content is only 
+ * decompressed when an agent asks for it so the MTS never has to.
+ * **************************************************************************************/
+
+#include "compression.h"
+#include <gio/gio.h>
+
+/* runs all of the data through a converter
+ * 
+ * converter - the compressor or decompressor to use
+ * data - the data to convert
+ * length - the number of bytes of data
+ * returns - the converted data, or NULL if the data could not be converted
+ */
+GByteArray* convertAll(GConverter* converter, const guint8* data, gsize length) {
+	GByteArray* result = g_byte_array_sized_new(length / 2 + 64);
+	guint8 buffer[16384];
+	gsize read, written;
+	GConverterResult status;
+	
+	do {
+		GError* error = NULL;
+		status = g_converter_convert(converter, data, length, buffer, sizeof(buffer), 
+			G_CONVERTER_INPUT_AT_END, &read, &written, &error);
+		if (status == G_CONVERTER_ERROR) {
+			g_message("CODEC: unable to convert content - %s", error->message);
+			g_error_free(error);
+			g_byte_array_free(result, TRUE);
+			return NULL;
+		}
+		g_byte_array_append(result, buffer, written);
+		data += read;
+		length -= read;
+	} while (status != G_CONVERTER_FINISHED);
+	
+	return result;
+}
+
+/* compresses the content of a message if it is large enough to be worth it
+ * 
+ * content - the content of the message
+ * returns - the compressed content, or NULL if the content should be sent as it is
+ */
+GByteArray* compressContent(GString* content) {
+	if (content == NULL || content->len < COMPRESSION_THRESHOLD) return NULL;
+	
+	GZlibCompressor* compressor = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB, -1);
+	GByteArray* compressed = convertAll(G_CONVERTER(compressor), (guint8*)content->str, content->len);
+	g_object_unref(compressor);
+	
+	//some content does not get any smaller
+	if (compressed != NULL && compressed->len >= content->len) {
+		g_byte_array_free(compressed, TRUE);
+		return NULL;
+	}
+	return compressed;
+}
+
+/* decompresses content that was compressed by compressContent
+ * 
+ * data - the compressed content, which is left as it is
+ * returns - the content, or NULL if it could not be decompressed
+ */
+GString* decompressContent(GByteArray* data) {
+	GZlibDecompressor* decompressor = g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB);
+	GByteArray* decompressed = convertAll(G_CONVERTER(decompressor), data->data, data->len);
+	g_object_unref(decompressor);
+	if (decompressed == NULL) return NULL;
+	
+	GString* content = g_string_new_len((gchar*)decompressed->data, decompressed->len);
+	g_byte_array_free(decompressed, TRUE);
+	return content;
+}
@@ -0,0 +1,23 @@
+/****************************************************************************************
+ * Filename:	compression.h
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Declarations of the functions used by the codecs to compress large message content
+ * **************************************************************************************/
+
+#ifndef __CODEC__COMPRESSION_H__
+#define __CODEC__COMPRESSION_H__
+
+#include <glib.h>
+
+//content smaller than this many bytes is always sent as it is
+#define COMPRESSION_THRESHOLD 4096
+
+//added to the end of the encoding of a message whose content has been compressed
+#define COMPRESSION_FLAG "+zlib"
+
+GByteArray* compressContent(GString* content);
+GString* decompressContent(GByteArray* data);
+
+#endif
@@ -0,0 +1,119 @@
+/****************************************************************************************
+ * Filename:	sharedContent.c
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Passing of very large message content in shared memory.  The content is written once
+ * to a sealed memfd and only the file descriptor is put in the message, so neither the
+ * bus nor the MTS, which passes the descriptor on, ever copies the content.  Receivers 
+ * map the content read only when it is first read, and only once they have checked that
+ * it is sealed so the sender cannot change it underneath them.  This can only be used 
+ * when the connections to the bus at both ends are able to pass file descriptors.  Each
+ * process says whether its own can with enableSharedContent once it has connected, and
+ * says so to the others by marking its transport address.
+ * **************************************************************************************/
+
+#define _GNU_SOURCE
+#include "sharedContent.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+//the seals that stop shared content from being changed once it has been sent
+#define SHARED_CONTENT_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+SharedContentState theSharedContent; /* the one and only record of whether content is shared */
+
+/* says whether content can be passed in shared memory by this process
+ * 
+ * enabled - TRUE if the connection to the bus can pass file descriptors
+ */
+void enableSharedContent(gboolean enabled) {
+	theSharedContent.enabled = enabled;
+}
+
+/* returns - TRUE if content can be passed in shared memory */
+gboolean sharedContentEnabled() {
+	return theSharedContent.enabled;
+}
+
+/* adds the mark to a transport address that says the agent it belongs to can be sent
+ * content in shared memory, if this process can pass file descriptors
+ * 
+ * address - the transport address of an agent in this process
+ */
+void markSharedContentAddress(GString* address) {
+	if (theSharedContent.enabled) g_string_append(address, ":" SHARED_CONTENT_ADDRESS_MARK);
+}
+
+/* says whether content can be passed in shared memory to an address
+ * 
+ * address - the transport address of the receiver
+ * returns - TRUE if this process and the receiver can both pass file descriptors
+ */
+gboolean addressAcceptsSharedContent(GString* address) {
+	if (!theSharedContent.enabled || address == NULL) return FALSE;
+	gchar** parts = g_strsplit(address->str, ":", 5);
+	gboolean accepts = g_strv_length(parts) == 5 && strcmp(parts[4], SHARED_CONTENT_ADDRESS_MARK) == 0;
+	g_strfreev(parts);
+	return accepts;
+}
+
+/* writes content to a new memfd and seals it so that it can no longer be changed
+ * 
+ * content - the content to share
+ * returns - the file descriptor, or -1 if the content could not be shared
+ */
+int shareContent(GString* content) {
+	int fd = memfd_create("ap-content", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd == -1) return -1;
+	
+	gsize written = 0;
+	while (written < content->len) {
+		ssize_t count = write(fd, content->str + written, content->len - written);
+		if (count <= 0) {
+			close(fd);
+			return -1;
+		}
+		written += count;
+	}
+	
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* maps shared content read only.  Content that the sender could still change is refused,
+ * as it could shrink the file while it is being read
+ * 
+ * fd - the file descriptor the content was passed in
+ * mapping - set to the start of the content
+ * length - set to the number of bytes of content
+ * returns - TRUE if the content was mapped
+ */
+gboolean mapSharedContent(int fd, gpointer* mapping, gsize* length) {
+	int seals = fcntl(fd, F_GET_SEALS);
+	if (seals == -1 || (seals & SHARED_CONTENT_SEALS) != SHARED_CONTENT_SEALS) {
+		g_message("CODEC: refusing shared content that has not been sealed");
+		return FALSE;
+	}
+	
+	struct stat info;
+	if (fstat(fd, &info) == -1) return FALSE;
+	
+	*length = info.st_size;
+	if (*length == 0) {
+		*mapping = NULL;
+		return TRUE;
+	}
+	*mapping = mmap(NULL, *length, PROT_READ, MAP_SHARED, fd, 0);
+	if (*mapping == MAP_FAILED) {
+		*mapping = NULL;
+		return FALSE;
+	}
+	return TRUE;
+}
@@ -0,0 +1,38 @@
+/****************************************************************************************
+ * Filename:	sharedContent.h
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Declarations of the functions used by the codecs to pass very large message content 
+ * in shared memory rather than in the body of the message
+ * **************************************************************************************/
+
+#ifndef __CODEC__SHAREDCONTENT_H__
+#define __CODEC__SHAREDCONTENT_H__
+
+#include <glib.h>
+
+//content of at least this many bytes is passed in shared memory when the bus allows it
+#define SHARED_CONTENT_THRESHOLD 65536
+
+//added to the end of the encoding of a message whose content is passed in shared memory
+#define SHARED_CONTENT_FLAG "+memfd"
+
+//added to the end of the transport address of an agent that can be passed file descriptors
+#define SHARED_CONTENT_ADDRESS_MARK "memfd"
+
+/* whether this process can pass content in shared memory */
+struct stSharedContentState {
+	gboolean enabled;
+};
+typedef struct stSharedContentState SharedContentState;
+extern SharedContentState theSharedContent;
+
+void enableSharedContent(gboolean enabled);
+gboolean sharedContentEnabled();
+void markSharedContentAddress(GString* address);
+gboolean addressAcceptsSharedContent(GString* address);
+int shareContent(GString* content);
+gboolean mapSharedContent(int fd, gpointer* mapping, gsize* length);
+
+#endif
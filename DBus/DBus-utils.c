@@ -52,6 +52,13 @@ DBusConnection* getDBusConnection() {
 	DBusConnection* conn;
 	dbus_error_init(&error);	
 	
+	//libdbus only locks its connections if this is called before any other dbus call,
+	//and the connection may be used by worker threads and directory readers
+	if (!dbus_threads_init_default()) {
+		g_error("Unable to initialise DBus threading");
+		return NULL;
+	}
+	
 	//connect to the session bus and integrate it with a GLib
 	conn = dbus_bus_get(DBUS_BUS_SESSION, &error);
 	if (conn == NULL) {
@@ -83,3 +90,17 @@ GString* getBaseService(DBusConnection* conn) {
 	GString* str = g_string_new((char*)baseService);
 	return str;	
 }
+
+/* creates a reply to a method call from the reply that was sent to an earlier call, so
+ * that an encoded reply can be sent again without rebuilding its contents
+ * 
+ * reply - the earlier reply
+ * request - the method call that the new reply is for
+ * return - the new reply which should be sent and then unreferenced
+ */
+DBusMessage* copyReply(DBusMessage* reply, DBusMessage* request) {
+	DBusMessage* copy = dbus_message_copy(reply);
+	dbus_message_set_reply_serial(copy, dbus_message_get_serial(request));
+	dbus_message_set_destination(copy, dbus_message_get_sender(request));
+	return copy;
+}
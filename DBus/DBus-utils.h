@@ -16,5 +16,6 @@ GString buildTransportAddress(char* service, char* path, char* method);
 gboolean getService(DBusConnection* conn, char* serviceName);
 GString* getBaseService(DBusConnection* conn);
 DBusConnection* getDBusConnection();
+DBusMessage* copyReply(DBusMessage* reply, DBusMessage* request);
 
 #endif
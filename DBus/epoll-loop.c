@@ -0,0 +1,455 @@
+/****************************************************************************************
+ * Filename:	epoll-loop.c
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ *
+ * A dispatcher for the platform process built directly on epoll.  The D-Bus connection
+ * hands over its watches and timeouts, watches are waited on as descriptors and each
+ * timeout gets a timerfd, so a wakeup costs one epoll_wait rather than rebuilding the
+ * poll array of a GMainLoop.  The idle and timeout sources that the platform services
+ * add to the default GLib context are still run once per wakeup, and the descriptors 
+ * the context waits on are kept in the epoll set so that they wake the loop as well
+ * **************************************************************************************/
+
+#include "epoll-loop.h"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+
+#define EPOLL_LOOP_MAX_EVENTS 64
+
+//the number of GLib descriptors there is room for at first, more room is made if needed
+#define EPOLL_LOOP_GLIB_FDS 16
+
+typedef enum { LOOP_SOURCE_WATCH, LOOP_SOURCE_TIMEOUT, LOOP_SOURCE_WAKEUP, LOOP_SOURCE_GLIB } LoopSourceType;
+
+/* something registered with epoll.  Every watch waits on its own duplicate of the
+ * descriptor because D-Bus gives out a read and a write watch for the same socket and
+ * epoll will only take a descriptor once.  A GLib descriptor is only there to wake the
+ * loop, the context is asked what is ready on it afterwards */
+typedef struct {
+	LoopSourceType type;
+	int fd;
+	gboolean edgeTriggered;
+	DBusWatch* watch;
+	DBusTimeout* timeout;
+	gushort glibEvents;
+	gboolean seen;
+} LoopSource;
+
+struct stEpollLoop {
+	int epfd;
+	DBusConnection* connection;
+	LoopSource wakeup;
+	GSList* removed;
+	GHashTable* glibSources;
+	gboolean running;
+};
+
+/* works out what epoll should report for a watch, reads are edge triggered and drained
+ * completely when they fire whilst writes are level triggered as D-Bus only writes so
+ * much each time it is handled
+ *
+ * source - the watch
+ * returns - the epoll events to wait for
+ */
+uint32_t watchEvents(LoopSource* source) {
+	if (!dbus_watch_get_enabled(source->watch)) return 0;
+
+	uint32_t events = 0;
+	unsigned int flags = dbus_watch_get_flags(source->watch);
+	if (flags & DBUS_WATCH_READABLE) events |= EPOLLIN | EPOLLRDHUP;
+	if (flags & DBUS_WATCH_WRITABLE) events |= EPOLLOUT;
+	if (source->edgeTriggered) events |= EPOLLET;
+	return events;
+}
+
+/* puts the given source into the epoll set or changes what it is waiting for
+ *
+ * loop - the loop
+ * source - the source
+ * op - EPOLL_CTL_ADD or EPOLL_CTL_MOD
+ * events - the events to wait for
+ * returns - TRUE if epoll accepted the source
+ */
+gboolean registerSource(EpollLoop* loop, LoopSource* source, int op, uint32_t events) {
+	struct epoll_event event;
+	event.events = events;
+	event.data.ptr = source;
+	if (epoll_ctl(loop->epfd, op, source->fd, &event) < 0) {
+		g_message("LOOP: Unable to register descriptor %d (%s)", source->fd, g_strerror(errno));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* takes a source out of the epoll set.  The source itself is freed once the current
+ * batch of events has been handled as one of them may still refer to it
+ *
+ * loop - the loop
+ * source - the source
+ */
+void unregisterSource(EpollLoop* loop, LoopSource* source) {
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, source->fd, NULL);
+	close(source->fd);
+	source->watch = NULL;
+	source->timeout = NULL;
+	loop->removed = g_slist_prepend(loop->removed, source);
+}
+
+/* called by D-Bus when the connection needs a descriptor watched
+ *
+ * all parameters and the return value are defined by D-Bus, see their documentation
+ */
+dbus_bool_t addWatch(DBusWatch* watch, void* data) {
+	EpollLoop* loop = (EpollLoop*)data;
+	LoopSource* source = g_new0(LoopSource, 1);
+	source->type = LOOP_SOURCE_WATCH;
+	source->watch = watch;
+	source->edgeTriggered = dbus_watch_get_flags(watch) == DBUS_WATCH_READABLE;
+	source->fd = dup(dbus_watch_get_unix_fd(watch));
+	if (source->fd < 0 || !registerSource(loop, source, EPOLL_CTL_ADD, watchEvents(source))) {
+		if (source->fd >= 0) close(source->fd);
+		g_free(source);
+		return FALSE;
+	}
+
+	dbus_watch_set_data(watch, source, NULL);
+	return TRUE;
+}
+
+/* called by D-Bus when a descriptor no longer needs to be watched
+ *
+ * all parameters are defined by D-Bus, see their documentation
+ */
+void removeWatch(DBusWatch* watch, void* data) {
+	LoopSource* source = (LoopSource*)dbus_watch_get_data(watch);
+	if (source == NULL) return;
+
+	dbus_watch_set_data(watch, NULL, NULL);
+	unregisterSource((EpollLoop*)data, source);
+}
+
+/* called by D-Bus when a watch is enabled or disabled
+ *
+ * all parameters are defined by D-Bus, see their documentation
+ */
+void watchToggled(DBusWatch* watch, void* data) {
+	LoopSource* source = (LoopSource*)dbus_watch_get_data(watch);
+	if (source == NULL) return;
+
+	//re-arming an edge triggered read reports anything already waiting on the socket
+	registerSource((EpollLoop*)data, source, EPOLL_CTL_MOD, watchEvents(source));
+}
+
+/* starts or stops the timerfd behind a D-Bus timeout to match the timeout, D-Bus
+ * timeouts keep firing at their interval until they are removed
+ *
+ * source - the timeout
+ */
+void armTimeout(LoopSource* source) {
+	struct itimerspec spec = {{0, 0}, {0, 0}};
+	if (dbus_timeout_get_enabled(source->timeout)) {
+		int interval = dbus_timeout_get_interval(source->timeout);
+		spec.it_value.tv_sec = interval / 1000;
+		spec.it_value.tv_nsec = (interval % 1000) * 1000000L;
+		spec.it_interval = spec.it_value;
+	}
+	timerfd_settime(source->fd, 0, &spec, NULL);
+}
+
+/* called by D-Bus when the connection needs a timeout
+ *
+ * all parameters and the return value are defined by D-Bus, see their documentation
+ */
+dbus_bool_t addTimeout(DBusTimeout* timeout, void* data) {
+	EpollLoop* loop = (EpollLoop*)data;
+	LoopSource* source = g_new0(LoopSource, 1);
+	source->type = LOOP_SOURCE_TIMEOUT;
+	source->timeout = timeout;
+	source->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (source->fd < 0 || !registerSource(loop, source, EPOLL_CTL_ADD, EPOLLIN)) {
+		if (source->fd >= 0) close(source->fd);
+		g_free(source);
+		return FALSE;
+	}
+
+	armTimeout(source);
+	dbus_timeout_set_data(timeout, source, NULL);
+	return TRUE;
+}
+
+/* called by D-Bus when a timeout is no longer needed
+ *
+ * all parameters are defined by D-Bus, see their documentation
+ */
+void removeTimeout(DBusTimeout* timeout, void* data) {
+	LoopSource* source = (LoopSource*)dbus_timeout_get_data(timeout);
+	if (source == NULL) return;
+
+	dbus_timeout_set_data(timeout, NULL, NULL);
+	unregisterSource((EpollLoop*)data, source);
+}
+
+/* called by D-Bus when a timeout is enabled, disabled or has its interval changed
+ *
+ * all parameters are defined by D-Bus, see their documentation
+ */
+void timeoutToggled(DBusTimeout* timeout, void* data) {
+	LoopSource* source = (LoopSource*)dbus_timeout_get_data(timeout);
+	if (source != NULL) armTimeout(source);
+}
+
+/* called by D-Bus when something has been queued from another thread, and used to stop
+ * the loop, it simply makes the loop wake up
+ *
+ * data - the loop
+ */
+void wakeUpLoop(void* data) {
+	EpollLoop* loop = (EpollLoop*)data;
+	uint64_t one = 1;
+	if (write(loop->wakeup.fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+		g_message("LOOP: Unable to wake up the loop (%s)", g_strerror(errno));
+	}
+}
+
+/* dispatches messages on the connection until there are none left in its queue
+ *
+ * loop - the loop
+ */
+void dispatchConnection(EpollLoop* loop) {
+	while (dbus_connection_dispatch(loop->connection) == DBUS_DISPATCH_DATA_REMAINS);
+}
+
+/* whether there is still data to read on a socket without taking any of it
+ *
+ * fd - the socket
+ * returns - TRUE if a read would not block
+ */
+gboolean socketHasData(int fd) {
+	char byte;
+	return recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+}
+
+/* works out what epoll should wait for on a descriptor of the GLib context
+ *
+ * events - the GLib events
+ * returns - the epoll events
+ */
+uint32_t glibEvents(gushort events) {
+	uint32_t result = 0;
+	if (events & G_IO_IN) result |= EPOLLIN;
+	if (events & G_IO_OUT) result |= EPOLLOUT;
+	if (events & G_IO_PRI) result |= EPOLLPRI;
+	return result;
+}
+
+/* removes a GLib descriptor from the epoll set, GLib may already have closed it */
+gboolean removeGlibSource(gpointer key, gpointer value, gpointer data) {
+	EpollLoop* loop = (EpollLoop*)data;
+	LoopSource* source = (LoopSource*)value;
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, source->fd, NULL);
+	g_free(source);
+	return TRUE;
+}
+
+/* removes a GLib descriptor the context no longer waits on, and gets those it does wait
+ * on ready to be looked for again on the next wakeup */
+gboolean dropGlibSource(gpointer key, gpointer value, gpointer data) {
+	LoopSource* source = (LoopSource*)value;
+	if (!source->seen) return removeGlibSource(key, value, data);
+	source->seen = FALSE;
+	return FALSE;
+}
+
+/* makes the epoll set hold the descriptors the GLib context is waiting on, so that the
+ * GLib wakeup and signal sources wake the loop.  Descriptors the context keeps from one
+ * wakeup to the next are only registered once
+ *
+ * loop - the loop
+ * fds - the descriptors from g_main_context_query
+ * nfds - the number of descriptors
+ */
+void syncGlibSources(EpollLoop* loop, GPollFD* fds, gint nfds) {
+	int i;
+	for (i=0; i<nfds; i++) {
+		LoopSource* source = g_hash_table_lookup(loop->glibSources, GINT_TO_POINTER(fds[i].fd));
+		if (source == NULL) {
+			source = g_new0(LoopSource, 1);
+			source->type = LOOP_SOURCE_GLIB;
+			source->fd = fds[i].fd;
+			source->glibEvents = fds[i].events;
+			if (!registerSource(loop, source, EPOLL_CTL_ADD, glibEvents(source->glibEvents))) {
+				g_free(source);
+				continue;
+			}
+			g_hash_table_insert(loop->glibSources, GINT_TO_POINTER(source->fd), source);
+		}
+		else if (source->glibEvents != fds[i].events) {
+			source->glibEvents = fds[i].events;
+			registerSource(loop, source, EPOLL_CTL_MOD, glibEvents(source->glibEvents));
+		}
+		source->seen = TRUE;
+	}
+	g_hash_table_foreach_remove(loop->glibSources, dropGlibSource, loop);
+}
+
+/* handles a single event reported by epoll
+ *
+ * loop - the loop
+ * event - the event
+ */
+void handleEvent(EpollLoop* loop, struct epoll_event* event) {
+	LoopSource* source = (LoopSource*)event->data.ptr;
+	uint64_t count;
+
+	switch (source->type) {
+		case LOOP_SOURCE_WAKEUP:
+			while (read(source->fd, &count, sizeof(count)) > 0);
+			break;
+		case LOOP_SOURCE_GLIB:
+			//the context is polled for what is ready once the events have been handled
+			break;
+		case LOOP_SOURCE_TIMEOUT:
+			if (source->timeout == NULL) break;
+			if (read(source->fd, &count, sizeof(count)) > 0) dbus_timeout_handle(source->timeout);
+			break;
+		case LOOP_SOURCE_WATCH: {
+			if (source->watch == NULL || !dbus_watch_get_enabled(source->watch)) break;
+			unsigned int flags = 0;
+			if (event->events & EPOLLIN) flags |= DBUS_WATCH_READABLE;
+			if (event->events & EPOLLOUT) flags |= DBUS_WATCH_WRITABLE;
+			if (event->events & EPOLLERR) flags |= DBUS_WATCH_ERROR;
+			if (event->events & (EPOLLHUP | EPOLLRDHUP)) flags |= DBUS_WATCH_HANGUP;
+			dbus_watch_handle(source->watch, flags);
+
+			//D-Bus reads a limited amount each time so an edge triggered read has to be
+			//repeated until the socket is empty, or there will be no further event for it
+			while (source->edgeTriggered && source->watch != NULL &&
+				dbus_watch_get_enabled(source->watch) && socketHasData(source->fd)) {
+				dbus_watch_handle(source->watch, DBUS_WATCH_READABLE);
+			}
+			break;
+		}
+	}
+}
+
+/* creates a loop that dispatches the given connection.  The connection must not also
+ * be set up with a GLib main loop
+ *
+ * conn - the connection to dispatch
+ * returns - the loop or NULL if it could not be created
+ */
+EpollLoop* EpollLoopNew(DBusConnection* conn) {
+	EpollLoop* loop = g_new0(EpollLoop, 1);
+	loop->connection = conn;
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	loop->wakeup.type = LOOP_SOURCE_WAKEUP;
+	loop->wakeup.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (loop->epfd < 0 || loop->wakeup.fd < 0 ||
+		!registerSource(loop, &loop->wakeup, EPOLL_CTL_ADD, EPOLLIN)) {
+		g_message("LOOP: Unable to create the epoll loop (%s)", g_strerror(errno));
+		if (loop->epfd >= 0) close(loop->epfd);
+		if (loop->wakeup.fd >= 0) close(loop->wakeup.fd);
+		g_free(loop);
+		return NULL;
+	}
+	loop->glibSources = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	dbus_connection_ref(conn);
+	dbus_connection_set_watch_functions(conn, addWatch, removeWatch, watchToggled, loop, NULL);
+	dbus_connection_set_timeout_functions(conn, addTimeout, removeTimeout, timeoutToggled,
+		loop, NULL);
+	dbus_connection_set_wakeup_main_function(conn, wakeUpLoop, loop, NULL);
+	return loop;
+}
+
+/* runs the loop until EpollLoopQuit is called.  Each wakeup handles whatever epoll
+ * reported, dispatches the connection until its queue is empty and then runs any GLib
+ * sources that are ready.  The wait is no longer than the next GLib timeout and the
+ * descriptors of the GLib context are waited on along with those of the connection
+ *
+ * loop - the loop to run
+ */
+void EpollLoopRun(EpollLoop* loop) {
+	GMainContext* context = g_main_context_default();
+	struct epoll_event events[EPOLL_LOOP_MAX_EVENTS];
+	gint allocatedFds = EPOLL_LOOP_GLIB_FDS;
+	GPollFD* glibFds = g_new(GPollFD, allocatedFds);
+
+	g_main_context_acquire(context);
+	loop->running = TRUE;
+
+	//messages may already have been read whilst the platform was starting
+	dispatchConnection(loop);
+	while (loop->running) {
+		gint priority, timeout, nfds;
+		gboolean ready = g_main_context_prepare(context, &priority);
+		nfds = g_main_context_query(context, priority, &timeout, glibFds, allocatedFds);
+		while (nfds > allocatedFds) {
+			allocatedFds = nfds;
+			glibFds = g_renew(GPollFD, glibFds, allocatedFds);
+			nfds = g_main_context_query(context, priority, &timeout, glibFds, allocatedFds);
+		}
+		syncGlibSources(loop, glibFds, nfds);
+		if (ready) timeout = 0;
+
+		int count = epoll_wait(loop->epfd, events, EPOLL_LOOP_MAX_EVENTS, timeout);
+		if (count < 0 && errno != EINTR) {
+			g_message("LOOP: epoll_wait failed (%s)", g_strerror(errno));
+			break;
+		}
+
+		int i;
+		for (i=0; i<count; i++) {
+			handleEvent(loop, &events[i]);
+		}
+		dispatchConnection(loop);
+
+		//sources that D-Bus removed whilst the events were handled can go now
+		g_slist_foreach(loop->removed, (GFunc)g_free, NULL);
+		g_slist_free(loop->removed);
+		loop->removed = NULL;
+
+		//GLib sources never block the loop, anything they send goes out on the next pass
+		g_poll(glibFds, nfds, 0);
+		if (g_main_context_check(context, priority, glibFds, nfds)) {
+			g_main_context_dispatch(context);
+		}
+	}
+
+	g_free(glibFds);
+	g_main_context_release(context);
+}
+
+/* makes EpollLoopRun return once the current wakeup has been handled
+ *
+ * loop - the loop to stop
+ */
+void EpollLoopQuit(EpollLoop* loop) {
+	loop->running = FALSE;
+	wakeUpLoop(loop);
+}
+
+/* hands the watches and timeouts back from the connection and frees the loop
+ *
+ * loop - the loop to free
+ */
+void EpollLoopFree(EpollLoop* loop) {
+	dbus_connection_set_watch_functions(loop->connection, NULL, NULL, NULL, NULL, NULL);
+	dbus_connection_set_timeout_functions(loop->connection, NULL, NULL, NULL, NULL, NULL);
+	dbus_connection_set_wakeup_main_function(loop->connection, NULL, NULL, NULL);
+	dbus_connection_unref(loop->connection);
+
+	g_slist_foreach(loop->removed, (GFunc)g_free, NULL);
+	g_slist_free(loop->removed);
+	g_hash_table_foreach_remove(loop->glibSources, removeGlibSource, loop);
+	g_hash_table_destroy(loop->glibSources);
+	close(loop->wakeup.fd);
+	close(loop->epfd);
+	g_free(loop);
+}
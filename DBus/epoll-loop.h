@@ -0,0 +1,23 @@
+/****************************************************************************************
+ * Filename:	epoll-loop.h
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Declarations for the epoll based dispatcher that the platform process can use in place
+ * of the GLib main loop
+ * **************************************************************************************/
+
+#ifndef __DBUS_EPOLL_LOOP_H__
+#define __DBUS_EPOLL_LOOP_H__
+
+#include <glib.h>
+#include <dbus/dbus.h>
+
+typedef struct stEpollLoop EpollLoop;
+
+EpollLoop* EpollLoopNew(DBusConnection* conn);
+void EpollLoopRun(EpollLoop* loop);
+void EpollLoopQuit(EpollLoop* loop);
+void EpollLoopFree(EpollLoop* loop);
+
+#endif
@@ -9,12 +9,18 @@
  * **************************************************************************************/
 
 #include "DF.h"
+#include "DFSubscription.h"
+#include "DFCache.h"
 #include "../platform-defs.h"
 #include "../util.h"
 #include "../DBus/DBus-utils.h"
 #include "../API/API.h"
 #include "../Codec/codecs.h"
 #include "../AMS/AMS.h"
+#include "../Tracing/probes.h"
+#include "../Tracing/memstats.h"
+#include "../Store/Store.h"
+#include "../Snapshot/snapshot.h"
 #include <stdlib.h>
 
 /* Function required by the D-Bus protocol but is not used in this apllication
@@ -23,8 +29,86 @@ void DFUnregFunction(DBusConnection* conn, void* user_data) {
 	g_message("DF Unregister function called");
 }
 
+GArray* searchDirectory(GArray* directory, AgentDFDescription* template, int maxResults, int cursor, int* nextCursor);
+
+/* a search that missed the cache waiting for a thread of the reader pool, and its reply
+ * on the way back to the main loop to be cached */
+struct stDFSearchRequest {
+	DBusMessage* msg;
+	AgentDFDescription* template;
+	int maxResults;
+	int cursor;
+	GString* key;
+	DBusMessage* reply;
+	guint generation;
+};
+typedef struct stDFSearchRequest DFSearchRequest;
+
+/* builds the reply to a search, the matching entries followed by where the next page 
+ * starts
+ * 
+ * msg - the search request
+ * directory - the registry to search, either the live one or a published copy
+ * template - the search criteria
+ * maxResults - the most matches to return, DF_SEARCH_UNLIMITED for all of them
+ * cursor - the position in the registry to start from
+ * returns - the reply to send
+ */
+DBusMessage* buildSearchReply(DBusMessage* msg, GArray* directory, AgentDFDescription* template, int maxResults, int cursor) {
+	int nextCursor;
+	GArray* matches = searchDirectory(directory, template, maxResults, cursor, &nextCursor);
+	
+	DBusMessage* reply = dbus_message_new_method_return(msg);
+	DBusMessageIter replyIter;
+	dbus_message_iter_init_append(reply, &replyIter);
+	encodeDFEntryArray(&replyIter, matches);
+	encodeInt(&replyIter, nextCursor);
+	g_array_free(matches, TRUE);
+	return reply;
+}
+
+/* run from the main loop to cache the reply to a search made on the reader pool.  The
+ * reply is dropped if the registry has changed since the copy it was built from
+ * 
+ * data - the finished search
+ * returns - FALSE so that it is only run once
+ */
+gboolean DFCacheSearch(gpointer data) {
+	DFSearchRequest* request = (DFSearchRequest*)data;
+	if (request->generation == theDF.generation)
+		DF_cacheInsert(request->key, request->reply);
+	else
+		g_string_free(request->key, TRUE);
+	
+	dbus_message_unref(request->reply);
+	dbus_message_unref(request->msg);
+	DFDescFree(request->template);
+	g_free(request);
+	return FALSE;
+}
+
+/* run by a thread of the reader pool to answer a search from the published copy of the
+ * registry, without holding up the main loop thread or the other searches
+ * 
+ * data - the search to answer
+ * userData - not used
+ */
+void DFReaderThread(gpointer data, gpointer userData) {
+	DFSearchRequest* request = (DFSearchRequest*)data;
+	int epoch = SnapshotReadBegin();
+	DFSnapshot* snapshot = DF_snapshot();
+	request->reply = buildSearchReply(request->msg, snapshot->entries, request->template, 
+		request->maxResults, request->cursor);
+	request->generation = snapshot->generation;
+	SnapshotReadEnd(epoch);
+	
+	dbus_connection_send(theAMS.configuration->connection, request->reply, NULL);
+	dbus_connection_flush(theAMS.configuration->connection);
+	g_idle_add(DFCacheSearch, request);
+}
+
 /* handles search requests from agents.  The reply is sent within this function depending
- * on the results of the search
+ * on the results of the search, or by the reader pool if the search has to be made
  * 
  * msg - the message that was sent from an agent to the serach listener that contains
  * 	the search criteria
@@ -40,20 +124,49 @@ void DFHandleSearch(DBusMessage* msg) {
 	g_message("%s", gstr->str);
 	g_string_free(gstr, TRUE);
 	
-	//perform the search
-	APError error;
-	APErrorInit(&error);
-	GArray* matches = DF_search(template, &error);
+	//the search constraints are optional, older agents only send the template.  There is
+	//no federation of DFs so the maximum depth is read but has no effect
+	int maxDepth = decodeInt(&iter);
+	int maxResults = decodeInt(&iter);
+	int cursor = decodeInt(&iter);
+	if (maxResults <= 0) maxResults = DF_SEARCH_UNLIMITED;
+	if (cursor < 0) cursor = 0;
 	
-	//send back the reply to the user	
-	reply = dbus_message_new_method_return(msg);
-	DBusMessageIter replyIter;
-	dbus_message_iter_init_append(reply, &replyIter);
-	encodeDFEntryArray(&replyIter, matches);
+	//an identical search since the directory last changed can be answered with the
+	//same reply
+	GString* key = DF_cacheKey(template, maxResults, cursor);
+	DBusMessage* cached = DF_cacheLookup(key);
+	if (cached != NULL) {
+		g_message("DF: answering search from the cache");
+		reply = copyReply(cached, msg);
+		g_string_free(key, TRUE);
+	}
+	else if (theDF.readerPool != NULL) {
+		//the search must see every change that was made before it was received, so if the
+		//published copy is older it waits for the next one rather than making a copy itself
+		DFSearchRequest* request = g_new(DFSearchRequest, 1);
+		request->msg = dbus_message_ref(msg);
+		request->template = template;
+		request->maxResults = maxResults;
+		request->cursor = cursor;
+		request->key = key;
+		if (theDF.snapshot->generation != theDF.generation)
+			g_queue_push_tail(theDF.waitingSearches, request);
+		else
+			g_thread_pool_push(theDF.readerPool, request, NULL);
+		return;
+	}
+	else {
+		//perform the search
+		reply = buildSearchReply(msg, theDF.agentDirectory, template, maxResults, cursor);
+		DF_cacheInsert(key, reply);
+	}
+	DFDescFree(template);
 	
-	//send the reply back
+	//send the reply back, the cache holds its own reference to a reply it keeps
 	dbus_connection_send(theAMS.configuration->connection, reply, NULL);
 	dbus_connection_flush(theAMS.configuration->connection);	
+	dbus_message_unref(reply);
 }
 
 /* handles modify requests from agents.  The reply is built appropraitely and sent within
@@ -72,27 +185,17 @@ void DFhandleModify(DBusMessage* msg) {
 	g_message("%s", gstr->str);
 	g_string_free(gstr, TRUE);
 	
-	//check to make sure that the entry exists
+	//replace the existing entry
+	APError error;
+	APErrorInit(&error);
+	DF_modifyEntry(entry, &error);
 	GString* retVal;
-	int index = DF_entryExists(entry->id->name);
-	if (index == -1) {
-		retVal = g_string_new(ERROR_ENTRY_NOT_FOUND);
+	if (APErrorIsSet(error)) {
+		retVal = g_string_new(error.message->str);
+		APErrorFree(&error);
 	}
 	else {
-		//remove the old entry
-		g_array_remove_index(theDF.agentDirectory, index);
-		
-		//now add the entry to the directory
-		APError error;
-		APErrorInit(&error);
-		DF_registerEntry(entry, &error);
-		if (APErrorIsSet(error)) {
-			retVal = g_string_new(error.message->str);
-			APErrorFree(&error);
-		}
-		else {
-			retVal = g_string_new(RETURN_OK);
-		}		
+		retVal = g_string_new(RETURN_OK);
 	}
 	
 	//build the reply to the message
@@ -119,14 +222,16 @@ void DFhandleDeRegister(DBusMessage* msg) {
 	GString* name = decodeString(&iter);
 	g_message("DF: de-registering %s", name->str);
 	
-	//check to make sure that the entry exists
+	//remove the entry
+	APError error;
+	APErrorInit(&error);
+	DF_deRegisterEntry(name, &error);
 	GString* retVal;
-	int index = DF_entryExists(name);
-	if (index == -1) {
-		retVal = g_string_new(ERROR_ENTRY_NOT_FOUND);
+	if (APErrorIsSet(error)) {
+		retVal = g_string_new(error.message->str);
+		APErrorFree(&error);
 	}
 	else {
-		g_array_remove_index(theDF.agentDirectory, index);
 		retVal = g_string_new(RETURN_OK);
 	}
 	
@@ -183,6 +288,194 @@ void DFhandleRegister(DBusMessage* msg) {
 	g_string_free(retVal, TRUE);	
 }
 
+/* applies a single operation from a batch request
+ * 
+ * operation - the name of the operation
+ * entry - the entry that the operation applies to
+ * error - structure used to report all errors
+ */
+void applyBatchOperation(GString* operation, AgentDFDescription* entry, APError* error) {
+	if (operation == NULL || entry->id == NULL || entry->id->name == NULL) {
+		APSetError(error, ERROR_REQUIRED_FIELD_MISSING);
+	}
+	else if (g_ascii_strcasecmp(operation->str, MSG_DF_REGISTER) == 0) {
+		DF_registerEntry(entry, error);
+	}
+	else if (g_ascii_strcasecmp(operation->str, MSG_DF_MODIFY) == 0) {
+		DF_modifyEntry(entry, error);
+	}
+	else if (g_ascii_strcasecmp(operation->str, MSG_DF_DEREGISTER) == 0) {
+		DF_deRegisterEntry(entry->id->name, error);
+	}
+	else {
+		APSetError(error, ERROR_UNKNOWN_OPERATION);
+	}
+}
+
+/* handles a batch of register, modify and de-register operations sent in a single 
+ * request.  The operations are applied in order and the reply holds the result of 
+ * each one, a failed operation does not stop the rest from being applied.  The count
+ * sent at the front of the batch is not trusted, reading stops at the end of the
+ * operations that are actually in the message
+ * 
+ * msg - the message containing the operations
+ */
+void DFhandleBatch(DBusMessage* msg) {
+	DBusMessageIter iter;
+	DBusMessage* reply;
+	dbus_message_iter_init(msg, &iter);
+	
+	int count = decodeInt(&iter);
+	if (count < 0) count = 0;
+	g_message("DF: applying a batch of %d operations", count);
+	
+	//the results are kept until the number of operations read is known
+	GPtrArray* results = g_ptr_array_new();
+	int i;
+	for (i=0; i<count; i++) {
+		if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_STRING) break;
+		GString* operation = decodeString(&iter);
+		dbus_message_iter_next(&iter);
+		if (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_INVALID) {
+			if (operation != NULL) g_string_free(operation, TRUE);
+			break;
+		}
+		AgentDFDescription* entry = decodeDFEntry(&iter);
+		
+		APError error;
+		APErrorInit(&error);
+		applyBatchOperation(operation, entry, &error);
+		if (APErrorIsSet(error)) {
+			g_ptr_array_add(results, g_strdup(error.message->str));
+			APErrorFree(&error);
+			DFDescFree(entry);
+		}
+		else {
+			g_ptr_array_add(results, g_strdup(RETURN_OK));
+			//a de-registration only uses the name so the entry is not kept
+			if (g_ascii_strcasecmp(operation->str, MSG_DF_DEREGISTER) == 0) DFDescFree(entry);
+		}
+		if (operation != NULL) g_string_free(operation, TRUE);
+	}
+	if (i < count) g_message("DF: batch held only %d of %d operations", i, count);
+	
+	//build the reply to the message
+	reply = dbus_message_new_method_return(msg);
+	DBusMessageIter replyIter;
+	dbus_message_iter_init_append(reply, &replyIter);
+	encodeInt(&replyIter, results->len);
+	for (i=0; i<results->len; i++) {
+		encodeReply(&replyIter, g_ptr_array_index(results, i));
+		g_free(g_ptr_array_index(results, i));
+	}
+	g_ptr_array_free(results, TRUE);
+	
+	//send the reply back
+	dbus_connection_send(theAMS.configuration->connection, reply, NULL);
+	dbus_connection_flush(theAMS.configuration->connection);
+	dbus_message_unref(reply);
+}
+
+/* handles a subscribe request from an agent.  The reply holds the result, the identifier
+ * of the new subscription and the entries that currently match the template so that the
+ * agent does not need to perform a separate search
+ * 
+ * msg - the message containing the subscriber and the template
+ */
+void DFhandleSubscribe(DBusMessage* msg) {
+	DBusMessageIter iter;
+	DBusMessage* reply;
+	dbus_message_iter_init(msg, &iter);
+	
+	AID* subscriber = decodeAID(&iter);
+	AgentDFDescription* template = decodeDFEntry(&iter);
+	
+	//add the subscription
+	APError error;
+	APErrorInit(&error);
+	int id = DF_subscribe(subscriber, template, &error);
+	GString* retVal;
+	GArray* matches;
+	if (APErrorIsSet(error)) {
+		retVal = g_string_new(error.message->str);
+		matches = g_array_new(FALSE, FALSE, sizeof(AgentDFDescription*));
+		APErrorFree(&error);
+		
+		//the subscription was not added so the subscriber and template are still ours
+		if (subscriber != NULL) {
+			AIDFree(*subscriber);
+			AP_FREE(subscriber);
+		}
+		DFDescFree(template);
+	}
+	else {
+		retVal = g_string_new(RETURN_OK);
+		matches = DF_search(template, &error);
+		g_message("DF: subscription %d added for %s", id, subscriber->name->str);
+	}
+	
+	//build the reply to the message
+	reply = dbus_message_new_method_return(msg);
+	DBusMessageIter replyIter;
+	dbus_message_iter_init_append(reply, &replyIter);
+	encodeReply(&replyIter, retVal->str);
+	encodeInt(&replyIter, id);
+	encodeDFEntryArray(&replyIter, matches);
+	
+	//send the reply back
+	dbus_connection_send(theAMS.configuration->connection, reply, NULL);
+	dbus_connection_flush(theAMS.configuration->connection);
+	dbus_message_unref(reply);
+	
+	g_array_free(matches, TRUE);
+	g_string_free(retVal, TRUE);
+}
+
+/* handles the cancellation of a subscription by the agent that made it
+ * 
+ * msg - the message containing the name of the agent and the subscription identifier
+ */
+void DFhandleCancel(DBusMessage* msg) {
+	DBusMessageIter iter;
+	DBusMessage* reply;
+	dbus_message_iter_init(msg, &iter);
+	
+	GString* name = decodeString(&iter);
+	dbus_message_iter_next(&iter);
+	int id = decodeInt(&iter);
+	
+	//remove the subscription
+	APError error;
+	APErrorInit(&error);
+	GString* retVal;
+	if (name == NULL) {
+		retVal = g_string_new(ERROR_REQUIRED_FIELD_MISSING);
+	}
+	else {
+		DF_unsubscribe(name, id, &error);
+		if (APErrorIsSet(error)) {
+			retVal = g_string_new(error.message->str);
+			APErrorFree(&error);
+		}
+		else {
+			retVal = g_string_new(RETURN_OK);
+		}
+		g_string_free(name, TRUE);
+	}
+	
+	//build the reply to the message
+	reply = dbus_message_new_method_return(msg);
+	DBusMessageIter replyIter;
+	dbus_message_iter_init_append(reply, &replyIter);
+	encodeReply(&replyIter, retVal->str);
+	
+	//send the reply back
+	dbus_connection_send(theAMS.configuration->connection, reply, NULL);
+	dbus_connection_flush(theAMS.configuration->connection);
+	
+	g_string_free(retVal, TRUE);
+}
+
 /* This function is called whenever a message is sent to the AMS service that is running
  * on the platform. No user data is passed into this function
  */
@@ -218,12 +511,31 @@ DBusHandlerResult DFMessageHandler(DBusConnection* connection, DBusMessage *msg,
 		g_message("DF: de-register request received from %s", dbus_message_get_sender(msg));
 		DFhandleDeRegister(msg);
 	}	
+	else if (g_ascii_strcasecmp(MSG_DF_BATCH, method) == 0) {
+		//just output that we have received the message
+		g_message("DF: batch request received from %s", dbus_message_get_sender(msg));
+		DFhandleBatch(msg);
+	}
+	else if (g_ascii_strcasecmp(MSG_DF_SUBSCRIBE, method) == 0) {
+		//just output that we have received the message
+		g_message("DF: subscribe request received from %s", dbus_message_get_sender(msg));
+		DFhandleSubscribe(msg);
+	}
+	else if (g_ascii_strcasecmp(MSG_DF_CANCEL, method) == 0) {
+		//just output that we have received the message
+		g_message("DF: cancel request received from %s", dbus_message_get_sender(msg));
+		DFhandleCancel(msg);
+	}
 	else {
 		g_message("DF: Unknown method called (%s)", method);
 	}	
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
 
+void searchChunk(gpointer data, gpointer userData);
+void DFReaderThread(gpointer data, gpointer userData);
+void freeDFSnapshot(gpointer data);
+
 /* Called during bootstrapping of the platform.  It sets up the object path that is used
  * to receive all messages for the MTS service
  * 
@@ -271,19 +583,98 @@ void DF_start(DBusConnection* conn, GMainLoop* mainLoop, gchar* baseService) {
 		g_message("DF: Listening on %s", DF_SERVICE_PATH);
 	}	
 	
-	//initialise the agent directory
+	//initialise the agent directory and the subscriptions made against it
 	theDF.agentDirectory = g_array_new(FALSE, FALSE, sizeof(AgentDFDescription*));
+	theDF.subscriptions = g_array_new(FALSE, FALSE, sizeof(DFSubscription*));
+	theDF.subscriptionCounter = 0;
+	DF_cacheStart();
+	theDF.snapshot = NULL;
+	theDF.publishSource = 0;
+	theDF.waitingSearches = g_queue_new();
+	DF_publish();
+	
+	//large searches are shared between a thread for each processor
+	theDF.searchPool = NULL;
+	DF_setSearchThreads(g_get_num_processors());
+	DF_setParallelSearch(DF_PARALLEL_SEARCH_THRESHOLD);
+	
+	//searches that miss the cache are made on a published copy of the registry by a 
+	//thread for each processor, so that they run alongside each other and the changes
+	theDF.readerPool = NULL;
+	if (g_get_num_processors() > 1)
+		theDF.readerPool = g_thread_pool_new(DFReaderThread, NULL, g_get_num_processors(), FALSE, NULL);
 }
 
 /* Called when the platform has been told to terminate.  Disconnects the AMS from
  * the D-Bus
  */
 void DF_end() {
+	DF_publish();
+	if (theDF.readerPool != NULL) g_thread_pool_free(theDF.readerPool, FALSE, TRUE);
+	theDF.readerPool = NULL;
+	if (theDF.publishSource != 0) g_source_remove(theDF.publishSource);
+	theDF.publishSource = 0;
+	SnapshotRetire(theDF.snapshot, freeDFSnapshot);
+	theDF.snapshot = NULL;
+	SnapshotSynchronize();
+	
+	DF_cacheEnd();
+	if (theDF.searchPool != NULL) g_thread_pool_free(theDF.searchPool, FALSE, TRUE);
+	theDF.searchPool = NULL;
 	g_message("DF: disconnecting from the DBus");
 	dbus_connection_unref(theDF.configuration->connection);
 	g_string_free(theDF.configuration->baseService, TRUE);
 }
 
+/************** PUBLISHED COPIES ********************************************/
+/* frees a copy of the registry once no reader can be using it */
+void freeDFSnapshot(gpointer data) {
+	DFSnapshot* snapshot = (DFSnapshot*)data;
+	g_array_free(snapshot->entries, TRUE);
+	AP_FREE(snapshot);
+}
+
+/* publishes a copy of the registry if it has changed since the last one was made, and
+ * passes the searches that were waiting for it to the reader pool.  Must only be called
+ * from the main loop thread
+ */
+void DF_publish() {
+	if (theDF.snapshot == NULL || theDF.snapshot->generation != theDF.generation) {
+		DFSnapshot* snapshot = AP_NEW(MEM_DF, DFSnapshot, 1);
+		snapshot->generation = theDF.generation;
+		snapshot->entries = g_array_sized_new(FALSE, FALSE, sizeof(AgentDFDescription*), theDF.agentDirectory->len);
+		g_array_append_vals(snapshot->entries, theDF.agentDirectory->data, theDF.agentDirectory->len);
+		SnapshotPublish((gpointer*)&theDF.snapshot, snapshot, freeDFSnapshot);
+	}
+	
+	while (!g_queue_is_empty(theDF.waitingSearches))
+		g_thread_pool_push(theDF.readerPool, g_queue_pop_head(theDF.waitingSearches), NULL);
+}
+
+/* returns the current published copy of the registry, which stays valid until the 
+ * matching call to SnapshotReadEnd.  Can be called from any thread
+ */
+DFSnapshot* DF_snapshot() {
+	return (DFSnapshot*)g_atomic_pointer_get(&theDF.snapshot);
+}
+
+/* publishes from the main loop a short while after a change, so that a run of changes
+ * is copied once however busy the main loop is */
+gboolean DFPublishTimeout(gpointer data) {
+	theDF.publishSource = 0;
+	DF_publish();
+	return FALSE;
+}
+
+/* records that the registry has changed, which empties the search cache and has a new
+ * copy published
+ */
+void registryChanged() {
+	theDF.generation++;
+	if (theDF.publishSource == 0) 
+		theDF.publishSource = g_timeout_add(SNAPSHOT_PUBLISH_INTERVAL, DFPublishTimeout, NULL);
+}
+
 /* adds an entry to the DFs database
  * 
  * entry - the DF entry to be added to the databse
@@ -291,7 +682,7 @@ void DF_end() {
  */
 void DF_registerEntry(AgentDFDescription* entry, APError* error) {
 	//check to make sure that the agent is registered with the AMS
-	if (AMS_agentExists(entry->id->name) == -1) {
+	if (AMS_lookup(entry->id->name) == NULL) {
 		APSetError(error, ERROR_UNAUTHORISED_AMS);
 		return;
 	}
@@ -304,6 +695,65 @@ void DF_registerEntry(AgentDFDescription* entry, APError* error) {
 	
 	//add the entry to the agent directory
 	g_array_append_val(theDF.agentDirectory, entry);
+	AP_MEM_MOVE(entry, MEM_DF);
+	AP_MEM_MOVE_AID(entry->id, MEM_DF);
+	registryChanged();
+	Store_journalDF(STORE_OP_REGISTER, entry);
+	DF_notifySubscribers(NULL, entry);
+}
+
+/* replaces the entry in the DFs database belonging to the same agent as the given entry
+ * 
+ * entry - the new DF entry for the agent
+ * error - structure used to report all errors
+ */
+void DF_modifyEntry(AgentDFDescription* entry, APError* error) {
+	//check to make sure that the entry exists
+	int index = DF_entryExists(entry->id->name);
+	if (index == -1) {
+		APSetError(error, ERROR_ENTRY_NOT_FOUND);
+		return;
+	}
+	
+	//check to make sure that the agent is still registered with the AMS
+	if (AMS_lookup(entry->id->name) == NULL) {
+		APSetError(error, ERROR_UNAUTHORISED_AMS);
+		return;
+	}
+	
+	//remove the old entry and add the new one
+	AgentDFDescription* oldEntry = g_array_index(theDF.agentDirectory, AgentDFDescription*, index);
+	g_array_remove_index(theDF.agentDirectory, index);
+	g_array_append_val(theDF.agentDirectory, entry);
+	AP_MEM_MOVE(entry, MEM_DF);
+	AP_MEM_MOVE_AID(entry->id, MEM_DF);
+	registryChanged();
+	Store_journalDF(STORE_OP_MODIFY, entry);
+	DF_notifySubscribers(oldEntry, entry);
+	
+	//the published copy may still hold the old entry
+	SnapshotRetire(oldEntry, (GDestroyNotify)DFDescFree);
+}
+
+/* removes the entry for an agent from the DFs database
+ * 
+ * name - the name of the agent whose entry should be removed
+ * error - structure used to report all errors
+ */
+void DF_deRegisterEntry(GString* name, APError* error) {
+	//check to make sure that the entry exists
+	int index = DF_entryExists(name);
+	if (index == -1) {
+		APSetError(error, ERROR_ENTRY_NOT_FOUND);
+		return;
+	}
+	
+	AgentDFDescription* oldEntry = g_array_index(theDF.agentDirectory, AgentDFDescription*, index);
+	g_array_remove_index(theDF.agentDirectory, index);
+	registryChanged();
+	Store_journalDFDeRegister(name);
+	DF_notifySubscribers(oldEntry, NULL);
+	SnapshotRetire(oldEntry, (GDestroyNotify)DFDescFree);
 }
 
 /* searhces the database to see if an entry exists for an agent with a given name
@@ -491,6 +941,129 @@ gboolean matches(AgentDFDescription* entry, AgentDFDescription* template) {
 		return FALSE;
 }
 
+/* part of the registry searched by one of the threads of the search pool, the matches are
+ * kept as positions in the registry so that the chunks can be put back in order */
+struct stDFSearchChunk {
+	GArray* directory;
+	AgentDFDescription* template;
+	int start;
+	int end;
+	int maxResults;
+	GArray* matches;
+	struct stDFSearchJob* job;
+};
+typedef struct stDFSearchChunk DFSearchChunk;
+
+/* a search shared out between the search pool, finished once no chunks remain */
+struct stDFSearchJob {
+	GMutex lock;
+	GCond done;
+	int remaining;
+};
+typedef struct stDFSearchJob DFSearchJob;
+
+/* sets how large a search must be before it is shared between the search pool, searches
+ * of fewer entries are made on the main loop thread as before
+ * 
+ * threshold - the fewest entries to share out, 0 to always search on one thread
+ */
+void DF_setParallelSearch(int threshold) {
+	theDF.parallelThreshold = threshold;
+}
+
+/* sets the number of threads in the search pool.  Must not be called while a search may
+ * be being made, such as by the reader pool
+ * 
+ * threads - the number of threads, with fewer than 2 every search is made on one thread
+ */
+void DF_setSearchThreads(int threads) {
+	if (theDF.searchPool != NULL) g_thread_pool_free(theDF.searchPool, FALSE, TRUE);
+	theDF.searchPool = NULL;
+	if (threads > 1) theDF.searchPool = g_thread_pool_new(searchChunk, NULL, threads, FALSE, NULL);
+}
+
+/* run by a thread of the search pool to search one chunk of the registry.  The thread 
+ * that made the search waits for it to finish, and neither the live registry nor a 
+ * published copy can change underneath it while it does
+ * 
+ * data - the chunk to search
+ * userData - not used
+ */
+void searchChunk(gpointer data, gpointer userData) {
+	DFSearchChunk* chunk = (DFSearchChunk*)data;
+	int i;
+	for (i=chunk->start; i<chunk->end; i++) {
+		//no chunk can give more than the search needs
+		if (chunk->maxResults != DF_SEARCH_UNLIMITED && chunk->matches->len >= chunk->maxResults) break;
+		AgentDFDescription* entry = g_array_index(chunk->directory, AgentDFDescription*, i);
+		if (matches(entry, chunk->template))
+			g_array_append_val(chunk->matches, i);
+	}
+	
+	DFSearchJob* job = chunk->job;
+	g_mutex_lock(&job->lock);
+	job->remaining--;
+	if (job->remaining == 0) g_cond_signal(&job->done);
+	g_mutex_unlock(&job->lock);
+}
+
+/* searches the registry from the cursor onwards on the search pool, giving exactly the 
+ * results and next cursor that searching on one thread would
+ * 
+ * directory - the registry to search, either the live one or a published copy
+ * template - the search criteria
+ * maxResults - the most matches to return, DF_SEARCH_UNLIMITED for all of them
+ * cursor - the position in the registry to start from
+ * nextCursor - if not NULL filled in with the position to continue from
+ * return - array of entries in the database that met the criteria
+ */
+GArray* searchParallel(GArray* directory, AgentDFDescription* template, int maxResults, int cursor, int* nextCursor) {
+	int length = directory->len;
+	int count = (length - cursor + DF_PARALLEL_SEARCH_CHUNK - 1) / DF_PARALLEL_SEARCH_CHUNK;
+	DFSearchChunk* chunks = g_new(DFSearchChunk, count);
+	DFSearchJob job;
+	g_mutex_init(&job.lock);
+	g_cond_init(&job.done);
+	job.remaining = count;
+	
+	int i;
+	for (i=0; i<count; i++) {
+		chunks[i].directory = directory;
+		chunks[i].template = template;
+		chunks[i].start = cursor + i * DF_PARALLEL_SEARCH_CHUNK;
+		chunks[i].end = MIN(chunks[i].start + DF_PARALLEL_SEARCH_CHUNK, length);
+		chunks[i].maxResults = maxResults;
+		chunks[i].matches = g_array_new(FALSE, FALSE, sizeof(int));
+		chunks[i].job = &job;
+		g_thread_pool_push(theDF.searchPool, &chunks[i], NULL);
+	}
+	g_mutex_lock(&job.lock);
+	while (job.remaining > 0) g_cond_wait(&job.done, &job.lock);
+	g_mutex_unlock(&job.lock);
+	
+	//put the matches together in registry order, stopping where one thread would have
+	GArray* results = g_array_new(FALSE, FALSE, sizeof(AgentDFDescription*));
+	int last = -1;
+	gboolean full = FALSE;
+	for (i=0; i<count; i++) {
+		int j;
+		for (j=0; j<chunks[i].matches->len && !full; j++) {
+			last = g_array_index(chunks[i].matches, int, j);
+			AgentDFDescription* entry = g_array_index(directory, AgentDFDescription*, last);
+			g_array_append_val(results, entry);
+			full = maxResults != DF_SEARCH_UNLIMITED && results->len >= maxResults;
+		}
+		g_array_free(chunks[i].matches, TRUE);
+	}
+	if (nextCursor != NULL)
+		*nextCursor = full && last + 1 < length ? last + 1 : DF_SEARCH_COMPLETE;
+	
+	g_free(chunks);
+	g_mutex_clear(&job.lock);
+	g_cond_clear(&job.done);
+	return results;
+}
+
 /* searhces the DF registry for a given entry that matches the template
  * 
  * template - the search criteria
@@ -498,15 +1071,63 @@ gboolean matches(AgentDFDescription* entry, AgentDFDescription* template) {
  * return - array of entries in the database that met the criteria
  */
 GArray* DF_search(AgentDFDescription* template, APError* error) {
+	return DF_searchConstrained(template, DF_SEARCH_UNLIMITED, 0, NULL, error);
+}
+
+/* searches part of the DF registry, stopping once enough matches have been found.  The
+ * cursor is a position in the registry so a search made in pages can skip or repeat an 
+ * entry that is modified while the pages are being read, as a modified entry moves to
+ * the end of the registry.
+ * 
+ * template - the search criteria
+ * maxResults - the most matches to return, DF_SEARCH_UNLIMITED for all of them
+ * cursor - the position in the registry to start from, 0 for the first page
+ * nextCursor - if not NULL filled in with the position to continue from, or 
+ * 	DF_SEARCH_COMPLETE if there are no more entries to look at
+ * error - structure used to report any errors
+ * return - array of entries in the database that met the criteria
+ */
+GArray* DF_searchConstrained(AgentDFDescription* template, int maxResults, int cursor, int* nextCursor, APError* error) {
+	return searchDirectory(theDF.agentDirectory, template, maxResults, cursor, nextCursor);
+}
+
+/* performs the search for DF_searchConstrained on either the live registry or a published
+ * copy of it
+ * 
+ * directory - the registry to search
+ * template - the search criteria
+ * maxResults - the most matches to return, DF_SEARCH_UNLIMITED for all of them
+ * cursor - the position in the registry to start from
+ * nextCursor - if not NULL filled in with the position to continue from, or 
+ * 	DF_SEARCH_COMPLETE if there are no more entries to look at
+ * return - array of entries in the registry that met the criteria
+ */
+GArray* searchDirectory(GArray* directory, AgentDFDescription* template, int maxResults, int cursor, int* nextCursor) {
+	AP_PROBE1(df_search_entry, directory->len);
+	if (cursor < 0) cursor = 0;
+	
+	//large searches are shared between the search pool
+	if (theDF.searchPool != NULL && theDF.parallelThreshold > 0 && maxResults != 0 &&
+		(int)directory->len - cursor >= theDF.parallelThreshold) {
+		GArray* results = searchParallel(directory, template, maxResults, cursor, nextCursor);
+		AP_PROBE2(df_search_return, directory->len, results->len);
+		return results;
+	}
+	
 	GArray* results = g_array_new(FALSE, FALSE, sizeof(AgentDFDescription*));
 	
-	//loop over all entries
+	//loop over the entries until we have as many as were asked for
 	int i;
-	for (i=0; i<theDF.agentDirectory->len; i++) {
-		AgentDFDescription* entry = g_array_index(theDF.agentDirectory, AgentDFDescription*, i);
+	for (i=cursor; i<directory->len; i++) {
+		if (maxResults != DF_SEARCH_UNLIMITED && results->len >= maxResults) break;
+		AgentDFDescription* entry = g_array_index(directory, AgentDFDescription*, i);
 		if (matches(entry, template))
 			g_array_append_val(results, entry);
 	}
 	
+	if (nextCursor != NULL) 
+		*nextCursor = i < directory->len ? i : DF_SEARCH_COMPLETE;
+	
+	AP_PROBE2(df_search_return, directory->len, results->len);
 	return results;
 }
@@ -17,9 +17,16 @@ void DF_start(DBusConnection*, GMainLoop*, gchar*);
 void DF_end();
 
 void DF_registerEntry(AgentDFDescription* entry, APError* error);
+void DF_modifyEntry(AgentDFDescription* entry, APError* error);
+void DF_deRegisterEntry(GString* name, APError* error);
 int DF_entryExists(GString* name);
 void DF_printDirectory();
 GArray* DF_search(AgentDFDescription* template, APError* error);
+GArray* DF_searchConstrained(AgentDFDescription* template, int maxResults, int cursor, int* nextCursor, APError* error);
+void DF_setParallelSearch(int threshold);
+void DF_setSearchThreads(int threads);
+void DF_publish();
+DFSnapshot* DF_snapshot();
 gboolean matches(AgentDFDescription* entry, AgentDFDescription* template);
 
 #endif
@@ -0,0 +1,169 @@
+/****************************************************************************************
+ * Filename:	DFCache.c
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Cache of the replies sent for DF searches.  Agents tend to repeat the same few searches
+ * so the encoded reply to each search is kept and sent again for an identical search, 
+ * until the directory changes.  Every change to the directory bumps its generation and the
+ * whole cache is dropped the next time it is used with a newer generation.
+ * 
+ * Searches are identified by a canonical form of the template.  The DF matches strings
+ * without regard to case and the order of the elements in the arrays of a template makes
+ * no difference, so the key lowercases every string and sorts every array.
+ * **************************************************************************************/
+
+#include "DFCache.h"
+#include "../platform-defs.h"
+#include <string.h>
+
+//separators used in the keys, control characters that do not appear in names or ontologies
+#define KEY_FIELD_SEPARATOR '\x1e'
+#define KEY_ITEM_SEPARATOR '\x1f'
+
+/* function used to sort the strings making up part of a key */
+gint compareKeyParts(gconstpointer a, gconstpointer b) {
+	return strcmp(*(gchar**)a, *(gchar**)b);
+}
+
+/* used with g_hash_table_foreach_remove to empty the cache */
+gboolean removeCacheEntry(gpointer key, gpointer value, gpointer userData) {
+	return TRUE;
+}
+
+/* appends a string to a key in lower case
+ * 
+ * key - the key being built
+ * str - the string to add, which may be NULL
+ */
+void appendKeyString(GString* key, GString* str) {
+	if (str != NULL) {
+		gchar* lower = g_ascii_strdown(str->str, str->len);
+		g_string_append(key, lower);
+		g_free(lower);
+	}
+	g_string_append_c(key, KEY_FIELD_SEPARATOR);
+}
+
+/* appends a set of strings to a key in sorted order, the strings are freed
+ * 
+ * key - the key being built
+ * parts - array of gchar* that should be added
+ */
+void appendKeyParts(GString* key, GPtrArray* parts) {
+	g_ptr_array_sort(parts, compareKeyParts);
+	int i;
+	for (i=0; i<parts->len; i++) {
+		g_string_append(key, g_ptr_array_index(parts, i));
+		g_string_append_c(key, KEY_ITEM_SEPARATOR);
+		g_free(g_ptr_array_index(parts, i));
+	}
+	g_ptr_array_free(parts, TRUE);
+	g_string_append_c(key, KEY_FIELD_SEPARATOR);
+}
+
+/* appends an array of strings to a key, in lower case and sorted
+ * 
+ * key - the key being built
+ * array - array of GString*
+ */
+void appendKeyStringArray(GString* key, GArray* array) {
+	GPtrArray* parts = g_ptr_array_new();
+	int i;
+	for (i=0; i<array->len; i++) {
+		GString* str = g_array_index(array, GString*, i);
+		g_ptr_array_add(parts, g_ascii_strdown(str->str, str->len));
+	}
+	appendKeyParts(key, parts);
+}
+
+/* builds the key used to cache the reply to a search
+ * 
+ * template - the template used for the search
+ * maxResults - the maximum results constraint of the search
+ * cursor - the position the search starts from
+ * returns - the key, which must be passed to DF_cacheInsert or freed
+ */
+GString* DF_cacheKey(AgentDFDescription* template, int maxResults, int cursor) {
+	GString* key = g_string_new("");
+	g_string_sprintfa(key, "%d%c%d%c", maxResults, KEY_FIELD_SEPARATOR, cursor, KEY_FIELD_SEPARATOR);
+	
+	if (template->id != NULL) {
+		appendKeyString(key, template->id->name);
+		appendKeyStringArray(key, template->id->addresses);
+	}
+	else {
+		g_string_append_c(key, KEY_FIELD_SEPARATOR);
+	}
+	appendKeyStringArray(key, template->protocols);
+	appendKeyStringArray(key, template->ontologies);
+	appendKeyStringArray(key, template->languages);
+	
+	//each service is turned into a key of its own and the services are then sorted
+	GPtrArray* services = g_ptr_array_new();
+	int i;
+	for (i=0; i<template->services->len; i++) {
+		DFServiceDescription* service = g_array_index(template->services, DFServiceDescription*, i);
+		GString* serviceKey = g_string_new("");
+		appendKeyString(serviceKey, service->name);
+		appendKeyString(serviceKey, service->type);
+		appendKeyStringArray(serviceKey, service->protocols);
+		appendKeyStringArray(serviceKey, service->ontologies);
+		appendKeyStringArray(serviceKey, service->languages);
+		g_ptr_array_add(services, g_string_free(serviceKey, FALSE));
+	}
+	appendKeyParts(key, services);
+	
+	return key;
+}
+
+/* looks for the reply to an identical search made since the directory last changed
+ * 
+ * key - the key for the search built by DF_cacheKey
+ * returns - the reply to the earlier search, or NULL if there is none.  The reply
+ * 	belongs to the cache and must be copied before it is sent
+ */
+DBusMessage* DF_cacheLookup(GString* key) {
+	//drop everything if the directory has changed since the replies were built
+	if (theDF.cacheGeneration != theDF.generation) {
+		g_hash_table_foreach_remove(theDF.searchCache, removeCacheEntry, NULL);
+		theDF.cacheGeneration = theDF.generation;
+	}
+	
+	DBusMessage* reply = g_hash_table_lookup(theDF.searchCache, key->str);
+	if (reply != NULL) 
+		theDF.cacheHits++;
+	else
+		theDF.cacheMisses++;
+	return reply;
+}
+
+/* adds the reply to a search to the cache.  When the cache is full it is emptied before
+ * the new reply is added
+ * 
+ * key - the key for the search built by DF_cacheKey, it now belongs to the cache
+ * reply - the reply that was sent for the search
+ */
+void DF_cacheInsert(GString* key, DBusMessage* reply) {
+	if (g_hash_table_size(theDF.searchCache) >= DF_CACHE_SIZE)
+		g_hash_table_foreach_remove(theDF.searchCache, removeCacheEntry, NULL);
+	
+	dbus_message_ref(reply);
+	g_hash_table_replace(theDF.searchCache, g_string_free(key, FALSE), reply);
+}
+
+/* Called when the DF is started to create the empty cache */
+void DF_cacheStart() {
+	theDF.searchCache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, 
+		(GDestroyNotify)dbus_message_unref);
+	theDF.generation = 0;
+	theDF.cacheGeneration = 0;
+	theDF.cacheHits = 0;
+	theDF.cacheMisses = 0;
+}
+
+/* Called when the DF terminates to release the cached replies */
+void DF_cacheEnd() {
+	g_message("DF: search cache had %d hits and %d misses", theDF.cacheHits, theDF.cacheMisses);
+	g_hash_table_destroy(theDF.searchCache);
+}
@@ -0,0 +1,22 @@
+/****************************************************************************************
+ * Filename:	DFCache.h
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Declaration of the functions used to cache the replies to DF searches
+ * **************************************************************************************/
+
+#ifndef __DF_DFCACHE_H__
+#define __DF_DFCACHE_H__
+
+#include <glib.h>
+#include <dbus/dbus.h>
+#include "../platform-defs.h"
+
+void DF_cacheStart();
+void DF_cacheEnd();
+GString* DF_cacheKey(AgentDFDescription* template, int maxResults, int cursor);
+DBusMessage* DF_cacheLookup(GString* key);
+void DF_cacheInsert(GString* key, DBusMessage* reply);
+
+#endif
@@ -0,0 +1,185 @@
+/****************************************************************************************
+ * Filename:	DFSubscription.c
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Implementation of the subscribe interaction of the DF.  An agent registers a template
+ * with the DF and from then on is sent a notification whenever an entry matching the
+ * template is registered, modified or de-registered.  Only the entry that has changed is
+ * matched against the templates so the cost of a change is independent of the size of
+ * the directory.
+ * **************************************************************************************/
+
+#include "DFSubscription.h"
+#include "DF.h"
+#include "../platform-defs.h"
+#include "../API/API.h"
+#include "../AMS/AMS.h"
+#include "../MTS/MTS.h"
+#include "../Codec/codecs.h"
+#include "../Tracing/memstats.h"
+
+/* checks that a transport address names a bus name, object path and interface that a
+ * notification can be sent to
+ * 
+ * address - the transport address, in the form used by generateMethodCall
+ * returns - TRUE if a method call can be built from the address
+ */
+gboolean validNotificationAddress(GString* address) {
+	gchar** addressParts = g_strsplit(address->str, ":", 5);
+	gboolean valid = g_strv_length(addressParts) >= 3
+		&& dbus_validate_bus_name(addressParts[1], NULL)
+		&& dbus_validate_interface(addressParts[1], NULL)
+		&& dbus_validate_path(addressParts[2], NULL);
+	g_strfreev(addressParts);
+	return valid;
+}
+
+/* frees a subscription along with the subscriber and template it holds
+ * 
+ * subscription - the subscription, which must already have been removed from the DF
+ */
+void freeSubscription(DFSubscription* subscription) {
+	AIDFree(*subscription->subscriber);
+	AP_FREE(subscription->subscriber);
+	DFDescFree(subscription->template);
+	g_string_free(subscription->address, TRUE);
+	g_free(subscription);
+}
+
+/* adds a subscription for an agent.  The notifications are sent to the address the agent
+ * registered with the AMS rather than any given with the request, so that an agent 
+ * cannot have another agent's notifications sent to it
+ * 
+ * subscriber - the agent that wishes to be told of changes, this is kept by the DF if the
+ * 	subscription is added and must be freed by the caller otherwise
+ * template - the entries the agent is interested in, as used for a search, kept in the
+ * 	same way as the subscriber
+ * error - structure used to report all errors
+ * returns - the identifier of the subscription, or -1 if it could not be added
+ */
+int DF_subscribe(AID* subscriber, AgentDFDescription* template, APError* error) {
+	if (subscriber == NULL || subscriber->name == NULL || template == NULL) {
+		APSetError(error, ERROR_REQUIRED_FIELD_MISSING);
+		return -1;
+	}
+	
+	//check to make sure that the agent is registered with the AMS
+	AID* registered = AMS_lookup(subscriber->name);
+	if (registered == NULL) {
+		APSetError(error, ERROR_UNAUTHORISED_AMS);
+		return -1;
+	}
+	
+	//the notifications are pushed straight to the agent so we need an address for it
+	GString* address = getTransportableAddress(registered);
+	if (address == NULL) {
+		APSetError(error, ERROR_NO_TRANSPORT_ADDRESS);
+		return -1;
+	}
+	if (!validNotificationAddress(address)) {
+		APSetError(error, ERROR_INVALID_TRANSPORT_ADDRESS);
+		return -1;
+	}
+	
+	//the registered entry may be changed or removed so the address is copied
+	DFSubscription* subscription = g_new(DFSubscription, 1);
+	subscription->id = ++theDF.subscriptionCounter;
+	subscription->subscriber = subscriber;
+	subscription->address = g_string_new(address->str);
+	subscription->template = template;
+	g_array_append_val(theDF.subscriptions, subscription);
+	
+	return subscription->id;
+}
+
+/* removes a subscription
+ * 
+ * subscriber - the name of the agent that made the subscription
+ * id - the identifier that was given to the subscription
+ * error - structure used to report all errors
+ */
+void DF_unsubscribe(GString* subscriber, int id, APError* error) {
+	int i;
+	for (i=0; i<theDF.subscriptions->len; i++) {
+		DFSubscription* subscription = g_array_index(theDF.subscriptions, DFSubscription*, i);
+		if (subscription->id == id && g_ascii_strcasecmp(subscription->subscriber->name->str, subscriber->str) == 0) {
+			g_array_remove_index(theDF.subscriptions, i);
+			freeSubscription(subscription);
+			return;
+		}
+	}
+	APSetError(error, ERROR_SUBSCRIPTION_NOT_FOUND);
+}
+
+/* removes all of the subscriptions belonging to an agent, called when the agent leaves
+ * the platform
+ * 
+ * subscriber - the name of the agent
+ */
+void DF_cancelSubscriptions(GString* subscriber) {
+	if (theDF.subscriptions == NULL) return;
+	int i;
+	for (i=theDF.subscriptions->len - 1; i>=0; i--) {
+		DFSubscription* subscription = g_array_index(theDF.subscriptions, DFSubscription*, i);
+		if (g_ascii_strcasecmp(subscription->subscriber->name->str, subscriber->str) == 0) {
+			g_array_remove_index(theDF.subscriptions, i);
+			freeSubscription(subscription);
+		}
+	}
+}
+
+/* pushes a single notification to a subscriber without waiting for a reply
+ * 
+ * subscription - the subscription that matched
+ * event - one of the DF_EVENT constants
+ * entry - the entry that changed
+ */
+void sendNotification(DFSubscription* subscription, char* event, AgentDFDescription* entry) {
+	//notifications go to the same object as agent messages but use their own method
+	gchar** addressParts = g_strsplit(subscription->address->str, ":", 5);
+	DBusMessage* msg = dbus_message_new_method_call(addressParts[1], 
+		addressParts[2], addressParts[1], MSG_DF_NOTIFY);
+	g_strfreev(addressParts);
+	
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(msg, &iter);
+	encodeInt(&iter, subscription->id);
+	encodeReply(&iter, event);
+	encodeDFEntry(&iter, entry);
+	
+	dbus_message_set_no_reply(msg, TRUE);
+	dbus_connection_send(theDF.configuration->connection, msg, NULL);
+	dbus_message_unref(msg);
+}
+
+/* Called whenever an entry in the DF changes.  The entry before and after the change is
+ * matched against each subscription and the subscriber told if the entry has started
+ * matching, still matches or no longer matches.
+ * 
+ * oldEntry - the entry before the change, NULL if it has just been registered
+ * newEntry - the entry after the change, NULL if it has just been de-registered
+ */
+void DF_notifySubscribers(AgentDFDescription* oldEntry, AgentDFDescription* newEntry) {
+	if (theDF.subscriptions == NULL || theDF.subscriptions->len == 0) return;
+	
+	int i;
+	int sent = 0;
+	for (i=0; i<theDF.subscriptions->len; i++) {
+		DFSubscription* subscription = g_array_index(theDF.subscriptions, DFSubscription*, i);
+		gboolean matchedBefore = oldEntry != NULL && matches(oldEntry, subscription->template);
+		gboolean matchesNow = newEntry != NULL && matches(newEntry, subscription->template);
+		
+		if (matchesNow && matchedBefore) 
+			sendNotification(subscription, DF_EVENT_MODIFIED, newEntry);
+		else if (matchesNow)
+			sendNotification(subscription, DF_EVENT_REGISTERED, newEntry);
+		else if (matchedBefore)
+			sendNotification(subscription, DF_EVENT_DEREGISTERED, oldEntry);
+		else
+			continue;
+		sent++;
+	}
+	
+	if (sent > 0) dbus_connection_flush(theDF.configuration->connection);
+}
@@ -0,0 +1,21 @@
+/****************************************************************************************
+ * Filename:	DFSubscription.h
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Declaration of the functions used to maintain the subscriptions held by the DF and
+ * to notify subscribers of changes to the entries they are interested in
+ * **************************************************************************************/
+
+#ifndef __DF_DFSUBSCRIPTION_H__
+#define __DF_DFSUBSCRIPTION_H__
+
+#include <glib.h>
+#include "../platform-defs.h"
+
+int DF_subscribe(AID* subscriber, AgentDFDescription* template, APError* error);
+void DF_unsubscribe(GString* subscriber, int id, APError* error);
+void DF_cancelSubscriptions(GString* subscriber);
+void DF_notifySubscribers(AgentDFDescription* oldEntry, AgentDFDescription* newEntry);
+
+#endif
@@ -12,10 +12,14 @@
 #include "../DBus/DBus-utils.h"
 #include "../platform-defs.h"
 #include "../Codec/codecs.h"
+#include "../Tracing/probes.h"
+#include "../Tracing/memstats.h"
+#include "../Snapshot/snapshot.h"
 #include <glib.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 /* Function put here cos it is required by D-Bus but never used by this application */
 void unregFunction(DBusConnection* conn, void* user_data) {
@@ -35,7 +39,7 @@ GString* getTransportableAddress(AID* id) {
 	
 	GString* dbusProtocol = g_string_new(DBUS_PROTOCOL_NAME);	
 	int i;
-	for (i=0; id->addresses->len; i++) {
+	for (i=0; i<id->addresses->len; i++) {
 		GString* gstr = g_array_index(id->addresses, GString*, i);
 		if (g_ascii_strncasecmp(gstr->str, dbusProtocol->str, dbusProtocol->len) == 0)
 			return gstr;
@@ -64,6 +68,231 @@ DBusMessage* generateMethodCall(GString* address) {
 	return msg;
 }
 
+/* sets the number of unacknowledged messages at which a receiver is treated as saturated
+ * and the number it must fall back to before messages are delivered to it again
+ * 
+ * high - the high watermark
+ * low - the low watermark, this must be below the high watermark
+ */
+void MTS_setWatermarks(int high, int low) {
+	if (low >= high) low = high - 1;
+	theMTS.highWatermark = high;
+	theMTS.lowWatermark = low;
+}
+
+/* sets how long messages for the same receiver are held so they can be delivered 
+ * together and the most that are delivered together
+ * 
+ * window - the number of milliseconds to hold messages for, 0 to deliver straight away
+ * limit - the most messages delivered in one call
+ */
+void MTS_setCoalescing(int window, int limit) {
+	theMTS.coalesceWindow = window;
+	theMTS.coalesceLimit = limit < 1 ? 1 : limit;
+}
+
+/* messages waiting to be delivered to an address in a single call */
+struct stMTSDelivery {
+	gchar* address;
+	DBusMessage* msg;
+	DBusMessageIter iter;
+	int count;
+};
+typedef struct stMTSDelivery MTSDelivery;
+
+/* releases a delivery once it has been acknowledged */
+void freeDelivery(void* data) {
+	MTSDelivery* delivery = (MTSDelivery*)data;
+	g_free(delivery->address);
+	AP_FREE(delivery);
+}
+
+/* empties the code table used to write messages to an address, so that the receiver 
+ * starts a new one with the next message
+ * 
+ * address - the address
+ * codeTable - the identifier of the table to reset, 0 to reset whichever table is in use
+ */
+void resetCodeTable(const gchar* address, guint64 codeTable) {
+	ACLCodeTable* table = g_hash_table_lookup(theMTS.codeTables, address);
+	if (table != NULL && (codeTable == 0 || table->id == codeTable)) ACLCodeTableReset(table);
+}
+
+/* forgets the code tables used to write messages to an agent, called by the AMS when the
+ * agent registers, changes or leaves so that an agent restarted under the same name is
+ * never sent strings from a table it does not have
+ * 
+ * id - the identifier of the agent
+ */
+void MTS_forgetAgent(AID* id) {
+	if (theMTS.codeTables == NULL) return;
+	GString* address = getTransportableAddress(id);
+	if (address != NULL) g_hash_table_remove(theMTS.codeTables, address->str);
+}
+
+/* called when a receiver acknowledges a delivery made to it, or the acknowledgement
+ * times out, to update the count of messages it has outstanding
+ * 
+ * pending - the call made to deliver the messages
+ * data - the delivery that was made
+ */
+void deliveryAcknowledged(DBusPendingCall* pending, void* data) {
+	MTSDelivery* delivery = (MTSDelivery*)data;
+	gchar* address = delivery->address;
+	
+	//a timeout or an error is not the receiver catching up, unless the receiver could not
+	//read messages written with its code table in which case it starts a new one
+	DBusMessage* reply = dbus_pending_call_steal_reply(pending);
+	gboolean acknowledged = reply != NULL && dbus_message_get_type(reply) != DBUS_MESSAGE_TYPE_ERROR;
+	char* text;
+	if (reply != NULL && dbus_message_is_error(reply, ERROR_NAME_CODE_TABLE)
+		&& dbus_message_get_args(reply, NULL, DBUS_TYPE_STRING, &text, DBUS_TYPE_INVALID)) {
+		acknowledged = TRUE;
+		resetCodeTable(address, g_ascii_strtoull(text, NULL, 16));
+		g_message("MTS: %s could not read code table %s, a new table has been started", address, text);
+	}
+	else if (!acknowledged) {
+		//the receiver may never read what the messages added to its code table
+		resetCodeTable(address, 0);
+	}
+	if (reply != NULL) dbus_message_unref(reply);
+	
+	MTSReceiver* receiver = g_hash_table_lookup(theMTS.receivers, address);
+	if (receiver != NULL) {
+		receiver->outstanding -= delivery->count;
+		if (!acknowledged) {
+			//treat the receiver as saturated until a later delivery is acknowledged
+			theMTS.unacknowledged += delivery->count;
+			receiver->saturated = TRUE;
+			g_message("MTS: %s did not acknowledge %d messages", address, delivery->count);
+		}
+		else if (receiver->saturated && receiver->outstanding <= theMTS.lowWatermark) {
+			receiver->saturated = FALSE;
+			g_message("MTS: %s has caught up, %d messages were refused", address, receiver->refused);
+			receiver->refused = 0;
+		}
+		if (receiver->outstanding <= 0 && !receiver->saturated)
+			g_hash_table_remove(theMTS.receivers, address);
+	}
+	dbus_pending_call_unref(pending);
+}
+
+/* sends the messages waiting for an address in a single call
+ * 
+ * delivery - the messages to send, it is freed once the call is acknowledged
+ */
+void sendDelivery(MTSDelivery* delivery) {
+	DBusPendingCall* pending = NULL;
+	if (dbus_connection_send_with_reply(theMTS.configuration->connection, delivery->msg, &pending, WAIT_TIME) 
+		&& pending != NULL) {
+		dbus_pending_call_set_notify(pending, deliveryAcknowledged, delivery, freeDelivery);
+		dbus_message_unref(delivery->msg);
+	}
+	else {
+		//the messages never went so they are not outstanding
+		MTSReceiver* receiver = g_hash_table_lookup(theMTS.receivers, delivery->address);
+		if (receiver != NULL) receiver->outstanding -= delivery->count;
+		g_message("MTS: unable to deliver %d messages to %s", delivery->count, delivery->address);
+		
+		//the receiver will not see anything the messages added to its code table
+		resetCodeTable(delivery->address, 0);
+		dbus_message_unref(delivery->msg);
+		freeDelivery(delivery);
+	}
+}
+
+/* sends one waiting delivery, used when the coalescing window closes */
+gboolean sendWaitingDelivery(gpointer key, gpointer value, gpointer data) {
+	sendDelivery((MTSDelivery*)value);
+	return TRUE;
+}
+
+/* timeout handler that sends everything that has been waiting for the coalescing 
+ * window to close
+ * 
+ * data - not used
+ * returns - FALSE so that it is not called again until there is more to send
+ */
+gboolean flushDeliveries(gpointer data) {
+	theMTS.deliverySource = 0;
+	g_hash_table_foreach_remove(theMTS.deliveries, sendWaitingDelivery, NULL);
+	dbus_connection_flush(theMTS.configuration->connection);
+	return FALSE;
+}
+
+void deliverMessage(AgentMessage* message);
+
+/* tells the sender of a message that it could not be delivered, the failure is sent 
+ * from the MTS itself.  Failures are never sent about failures sent by the MTS.
+ * 
+ * message - the message that was refused, the payload need not have been decoded
+ * reason - why the message was refused
+ */
+void refuseMessage(AgentMessage* message, char* reason) {
+	if (g_ascii_strcasecmp(message->envelope->from->name->str, theMTS.configuration->identifier->name->str) == 0)
+		return;
+	
+	ACLMessage* failure;
+	if (message->payload != NULL) {
+		failure = ACLMessageCreateReply(message->payload);
+		ACLMessageSetPerformative(failure, ACL_FAILURE);
+	}
+	else {
+		failure = ACLMessageNew(ACL_FAILURE);
+		ACLMessageAddReceiver(failure, message->envelope->from);
+	}
+	ACLMessageSetSender(failure, theMTS.configuration->identifier);
+	GString* content = g_string_new("");
+	if (message->envelope->intendedReceiver != NULL)
+		g_string_printf(content, "(%s %s)", reason, message->envelope->intendedReceiver->name->str);
+	else
+		g_string_printf(content, "(%s)", reason);
+	ACLMessageSetContent(failure, content->str);
+	g_string_free(content, TRUE);
+	
+	ACLEnvelope* envelope = g_new(ACLEnvelope, 1);
+	ACLEnvelopeInit(envelope);
+	ACLEnvelopeSetFrom(envelope, theMTS.configuration->identifier);
+	ACLEnvelopeAddTo(envelope, message->envelope->from);
+	ACLEnvelopeSetACLRepresentation(envelope, DBUS_ACL_REPRESENTATION);
+	ACLEnvelopeSetPriority(envelope, ACL_PRIORITY_CONTROL);
+	envelope->intendedReceiver = message->envelope->from;
+	
+	AgentMessage* reply = g_new(AgentMessage, 1);
+	AgentMessageInit(reply);
+	reply->envelope = envelope;
+	reply->payload = failure;
+	deliverMessage(reply);
+	
+	//the identifiers in the failure belong to the MTS and the refused message
+	failure->sender = NULL;
+	ACLMessageFree(*failure);
+	g_free(failure);
+	g_array_free(envelope->to, TRUE);
+	g_string_free(envelope->aclRepresentation, TRUE);
+	g_free(envelope);
+	g_free(reply);
+}
+
+/* finds the identifier the AMS holds for an agent.  The published copy of the name index
+ * is read, as it is by the readers on other threads, unless changes have been made since
+ * it was published, when the live index is read instead
+ * 
+ * name - the full name of the agent
+ * returns - the identifier held in the directory for the agent, NULL if not registered
+ */
+AID* lookupRoute(GString* name) {
+	int epoch = SnapshotReadBegin();
+	AMSSnapshot* snapshot = AMS_snapshot();
+	AID* id;
+	if (snapshot != NULL && AMS_snapshotIsCurrent(snapshot))
+		id = AMS_snapshotLookup(snapshot, name);
+	else
+		id = AMS_lookup(name);
+	SnapshotReadEnd(epoch);
+	return id;
+}
+
 /* used to deliver a message to an agent after the initial processing has been completed
  * the intended receiver field must be set, as this is used to determine the end point
  * 
@@ -82,9 +311,8 @@ void deliverMessage(AgentMessage* message) {
 		if (strstr(agentName->str, "@")  == NULL) 
 			g_string_sprintfa(agentName, "@%s", thePlatform.name->str);			 
 		
-		int index = AMS_agentExists(agentName);	
-		if (index != -1) {
-			AID* id = g_array_index(theAMS.agentDirectory, AID*, index);
+		AID* id = lookupRoute(agentName);	
+		if (id != NULL) {
 			
 			//check to make sure that we now have an address			
 			address = getTransportableAddress(id);
@@ -105,32 +333,114 @@ void deliverMessage(AgentMessage* message) {
 		}
 	}
 	
+	//refuse the message if the receiver is not keeping up, so that one slow agent cannot
+	//fill the buses buffers for everybody else
+	MTSReceiver* receiver = g_hash_table_lookup(theMTS.receivers, address->str);
+	if (receiver == NULL) {
+		receiver = g_new0(MTSReceiver, 1);
+		g_hash_table_insert(theMTS.receivers, g_strdup(address->str), receiver);
+	}
+	//a receiver that stopped acknowledging is sent one message at a time until it answers
+	if (receiver->saturated && receiver->outstanding > 0) {
+		receiver->refused++;
+		theMTS.refused++;
+		g_message("MTS: refusing message to saturated receiver %s", address->str);
+		refuseMessage(message, MTS_RECEIVER_SATURATED);
+		return;
+	}
+	
 	//now go ahead an deliver the message
 	//This is where we would decide what MTP to use to transport it	
 	g_message("MTS: Delivering message to %s", address->str);	
+	AP_PROBE1(mts_deliver, address->str);
 	
-	DBusMessage* msg = generateMethodCall(address);	
+	//add the message to those waiting to go to this address, each in a structure of its
+	//own, the message counts as outstanding until the agent acknowledges the delivery
+	MTSDelivery* delivery = g_hash_table_lookup(theMTS.deliveries, address->str);
+	if (delivery == NULL) {
+		delivery = AP_NEW(MEM_MTS, MTSDelivery, 1);
+		delivery->address = g_strdup(address->str);
+		delivery->msg = generateMethodCall(address);
+		dbus_message_set_member(delivery->msg, MTS_MSG_BATCH);
+		dbus_message_iter_init_append(delivery->msg, &delivery->iter);
+		delivery->count = 0;
+		g_hash_table_insert(theMTS.deliveries, delivery->address, delivery);
+	}
+	//bit-efficient messages to this address are written with its own code table
+	ACLCodeTable* table = NULL;
+	if (isBitEfficientRepresentation(message->envelope)) {
+		table = g_hash_table_lookup(theMTS.codeTables, address->str);
+		if (table == NULL) {
+			table = ACLCodeTableNew();
+			g_hash_table_insert(theMTS.codeTables, g_strdup(address->str), table);
+		}
+	}
+	DBusMessageIter structIter;
+	dbus_message_iter_open_container(&delivery->iter, DBUS_TYPE_STRUCT, NULL, &structIter);
+	encodeAgentMessageWithTable(&structIter, message, table, addressAcceptsSharedContent(address));
+	dbus_message_iter_close_container(&delivery->iter, &structIter);
+	delivery->count++;
 	
-	//put the envelope and the message into this method call
-	DBusMessageIter iter;
-	dbus_message_iter_init_append(msg, &iter);
-	encodeAgentMessage(&iter, message);
+	receiver->outstanding++;
+	theMTS.delivered++;
+	if (receiver->outstanding >= theMTS.highWatermark) {
+		receiver->saturated = TRUE;
+		g_message("MTS: %s is saturated with %d outstanding messages", address->str, receiver->outstanding);
+	}
 	
-	//now send the message to the agent
-	dbus_connection_send(theMTS.configuration->connection, msg, NULL);
-	dbus_connection_flush(theMTS.configuration->connection);
+	//control traffic and full deliveries go straight away, everything else waits in case 
+	//more messages for the same receiver arrive
+	if (message->envelope->priority == ACL_PRIORITY_CONTROL || delivery->count >= theMTS.coalesceLimit
+		|| theMTS.coalesceWindow == 0) {
+		g_hash_table_remove(theMTS.deliveries, delivery->address);
+		sendDelivery(delivery);
+		dbus_connection_flush(theMTS.configuration->connection);
+	}
+	else if (theMTS.deliverySource == 0) {
+		theMTS.deliverySource = g_timeout_add(theMTS.coalesceWindow, flushDeliveries, NULL);
+	}
 }
 
-/* handler for all requests made by agents to get the interaction layer to deliver a message
- * to the agents on the platform.  Performs all initial processing to determine the recipients
+/* closes the MTS's copy of any shared memory the content of a message was passed in, 
+ * once the message has been passed on to all of its receivers
  * 
- * msg - the message that was sent over the transport bus to the interaction layer
+ * message - the message that has been dealt with
  */
-void MTS_handleMessage(DBusMessage* msg) {
-	DBusMessageIter iter;
-	dbus_message_iter_init(msg, &iter);
+void releaseSharedContent(AgentMessage* message) {
+	if (message->payload != NULL && message->payload->contentFd >= 0) {
+		close(message->payload->contentFd);
+		message->payload->contentFd = -1;
+	}
+}
+
+/* drops a message whose deadline has passed and tells the sender
+ * 
+ * message - the expired message
+ */
+void expireMessage(AgentMessage* message) {
+	theMTS.expired++;
+	g_message("MTS: dropping expired message sent by %s", message->envelope->from->name->str);
+	AID* intendedReceiver = message->envelope->intendedReceiver;
+	message->envelope->intendedReceiver = NULL;
+	refuseMessage(message, MTS_MESSAGE_EXPIRED);
+	message->envelope->intendedReceiver = intendedReceiver;
+	releaseSharedContent(message);
+}
+
+/* delivers a message taken from one of the lanes to all of its intended recipients
+ * 
+ * message - the message to deliver
+ */
+void routeMessage(AgentMessage* message) {
+	AP_PROBE(mts_handle_entry);
 	
-	AgentMessage* message = decodeAgentMessage(&iter);
+	//the message may have expired while it waited in its lane, in which case it reaches
+	//none of its receivers
+	if (ACLEnvelopeHasExpired(message->envelope)) {
+		expireMessage(message);
+		AP_PROBE1(mts_handle_return, 0);
+		return;
+	}
 	
 	//output who the message was sent by
 	g_message("MTS: message sent by %s", message->envelope->from->name->str);
@@ -140,7 +450,9 @@ void MTS_handleMessage(DBusMessage* msg) {
 	g_message("Message read as \n%s", temp->str);
 	g_string_free(temp, TRUE);*/
 		
-	//we need to deliver the message to all of the intended recipients
+	//we need to deliver the message to all of the intended recipients, the receiver the
+	//message arrived with is put back afterwards so that it is freed with the message
+	AID* intendedReceiver = message->envelope->intendedReceiver;
 	int i;
 	for (i=0; i<message->envelope->to->len; i++) {
 		//set the intended receiver field
@@ -150,6 +462,137 @@ void MTS_handleMessage(DBusMessage* msg) {
 		//now attempt to deliver the message
 		deliverMessage(message);
 	}	
+	message->envelope->intendedReceiver = intendedReceiver;
+	releaseSharedContent(message);
+	AP_PROBE1(mts_handle_return, message->envelope->to->len);
+}
+
+/* the most messages taken from each lane, lowest priority first, every time the lanes 
+ * are drained.  Higher priority lanes are given most of the turns but bulk messages 
+ * are never starved completely
+ */
+static const int laneWeights[ACL_PRIORITY_LEVELS] = {1, 4, 16};
+
+/* idle handler that delivers the messages waiting in the lanes.  It only runs once the
+ * main loop has read everything waiting on the bus, so messages that have just arrived
+ * are always in their lane before the next turn is taken
+ * 
+ * data - not used
+ * returns - TRUE while there are messages left in the lanes
+ */
+gboolean drainLanes(gpointer data) {
+	gboolean waiting = FALSE;
+	int lane;
+	for (lane=ACL_PRIORITY_LEVELS - 1; lane>=0; lane--) {
+		int taken;
+		for (taken=0; taken<laneWeights[lane] && !g_queue_is_empty(theMTS.lanes[lane]); taken++) {
+			AgentMessage* message = (AgentMessage*)g_queue_pop_head(theMTS.lanes[lane]);
+			routeMessage(message);
+			freeDecodedAgentMessage(message);
+		}
+		if (!g_queue_is_empty(theMTS.lanes[lane])) waiting = TRUE;
+	}
+	if (!waiting) theMTS.laneSource = 0;
+	return waiting;
+}
+
+/* tells the sender of a message that the MTS could not read it with the code table it was
+ * written with, so that the sender starts a new table, and refuses the message
+ * 
+ * message - the message, the payload is not read
+ * codeTable - the identifier of the table
+ */
+void resyncSender(AgentMessage* message, guint64 codeTable) {
+	GString* address = getTransportableAddress(message->envelope->from);
+	if (address != NULL) {
+		gchar* text = g_strdup_printf(ACL_CODE_TABLE_ID_FORMAT, codeTable);
+		DBusMessage* msg = generateMethodCall(address);
+		dbus_message_set_member(msg, MSG_CODE_TABLE_RESET);
+		dbus_message_append_args(msg, DBUS_TYPE_STRING, &text, DBUS_TYPE_INVALID);
+		dbus_message_set_no_reply(msg, TRUE);
+		dbus_connection_send(theMTS.configuration->connection, msg, NULL);
+		dbus_message_unref(msg);
+		g_free(text);
+	}
+	g_message("MTS: message sent by %s could not be read with its code table", message->envelope->from->name->str);
+	refuseMessage(message, MTS_CODE_TABLE_UNKNOWN);
+}
+
+/* reads an agent message sent to the MTS and puts it in the lane for its priority
+ * 
+ * iter - the iterator pointing at the message
+ */
+void queueMessage(DBusMessageIter* iter) {
+	//read the envelope on its own so that an expired message is dropped before any more 
+	//work is done on it
+	AgentMessage* message = AP_NEW(MEM_MTS, AgentMessage, 1);
+	AgentMessageInit(message);
+	message->envelope = decodeEnvelope(iter);
+	guint64 codeTable;
+	if (ACLEnvelopeHasExpired(message->envelope)) {
+		skipPayload(iter, message->envelope, &codeTable);
+		if (codeTable != 0)
+			resyncSender(message, codeTable);
+		else
+			expireMessage(message);
+		freeDecodedAgentMessage(message);
+		return;
+	}
+	message->payload = decodePayload(iter, message->envelope, &codeTable);
+	if (message->payload == NULL) {
+		resyncSender(message, codeTable);
+		freeDecodedAgentMessage(message);
+		return;
+	}
+	
+	//the message counts against the MTS for as long as it waits in its lane
+	AP_MEM_MOVE_MESSAGE(message, MEM_MTS);
+	g_queue_push_tail(theMTS.lanes[message->envelope->priority], message);
+}
+
+/* handler for all requests made by agents to get the interaction layer to deliver a message
+ * to the agents on the platform.  The message is put in the lane for its priority and
+ * delivered when its turn comes
+ * 
+ * msg - the message that was sent over the transport bus to the interaction layer
+ */
+void MTS_handleMessage(DBusMessage* msg) {
+	DBusMessageIter iter;
+	dbus_message_iter_init(msg, &iter);
+	queueMessage(&iter);
+	if (theMTS.laneSource == 0) theMTS.laneSource = g_idle_add(drainLanes, NULL);
+}
+
+/* handler for requests from agents to deliver many messages at once, each message is 
+ * held in a structure of its own and is put in the lane for its priority
+ * 
+ * msg - the message that was sent over the transport bus to the interaction layer
+ */
+void MTS_handleBatch(DBusMessage* msg) {
+	DBusMessageIter iter;
+	dbus_message_iter_init(msg, &iter);
+	int count = decodeInt(&iter);
+	int i;
+	for (i=0; i<count && dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_STRUCT; i++) {
+		DBusMessageIter structIter;
+		dbus_message_iter_recurse(&iter, &structIter);
+		queueMessage(&structIter);
+		dbus_message_iter_next(&iter);
+	}
+	g_message("MTS: %d messages received in a batch", i);
+	if (theMTS.laneSource == 0) theMTS.laneSource = g_idle_add(drainLanes, NULL);
+}
+
+/* outputs the counts of the messages the MTS has handled to the log
+ */
+void MTS_printStats() {
+	g_message("MTS: %d delivered, %d refused, %d expired, %d unacknowledged", theMTS.delivered, theMTS.refused, 
+		theMTS.expired, theMTS.unacknowledged);
+	int lane;
+	for (lane=ACL_PRIORITY_LEVELS - 1; lane>=0; lane--) 
+		g_message("MTS: %d messages waiting in lane %d", g_queue_get_length(theMTS.lanes[lane]), lane);
+	g_message("MTS: %d receivers have messages outstanding", g_hash_table_size(theMTS.receivers));
+	AP_MEM_PRINT();
 }
 
 /* Called by the underlying D-Bus stuff when a message is received that is meant
@@ -163,11 +606,18 @@ DBusHandlerResult MTSMessageHandler(DBusConnection* connection, DBusMessage *msg
 		//just output that we have received the message
 		g_message("MTS: Ping message received from %s", dbus_message_get_sender(msg));
 	}
-	if (g_ascii_strcasecmp(MTS_MSG, method) == 0) {
+	else if (g_ascii_strcasecmp(MSG_PRINT_STATS, method) == 0) {
+		MTS_printStats();
+	}
+	else if (g_ascii_strcasecmp(MTS_MSG, method) == 0) {
 		//just output that we have received the message
 		g_message("MTS: Received route request from %s", dbus_message_get_sender(msg));
 		MTS_handleMessage(msg);
 	}
+	else if (g_ascii_strcasecmp(MTS_MSG_BATCH, method) == 0) {
+		g_message("MTS: Received batch route request from %s", dbus_message_get_sender(msg));
+		MTS_handleBatch(msg);
+	}
 	else {
 		g_message("MTS: Unknown method called (%s)", method);
 	}	
@@ -196,6 +646,23 @@ void MTS_start(DBusConnection* conn, GMainLoop* mainLoop, gchar* baseService) {
 	theMTS.configuration->mainLoop = mainLoop;	
 	theMTS.configuration->baseService = g_string_new(baseService);
 	
+	//no receivers have outstanding messages yet
+	theMTS.receivers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	theMTS.codeTables = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)ACLCodeTableFree);
+	MTS_setWatermarks(MTS_HIGH_WATERMARK, MTS_LOW_WATERMARK);
+	
+	//set up the lanes that hold messages waiting to be delivered
+	int lane;
+	for (lane=0; lane<ACL_PRIORITY_LEVELS; lane++) theMTS.lanes[lane] = g_queue_new();
+	theMTS.laneSource = 0;
+	theMTS.deliveries = g_hash_table_new(g_str_hash, g_str_equal);
+	theMTS.deliverySource = 0;
+	MTS_setCoalescing(MTS_COALESCE_WINDOW, MTS_COALESCE_LIMIT);
+	theMTS.delivered = 0;
+	theMTS.refused = 0;
+	theMTS.expired = 0;
+	theMTS.unacknowledged = 0;
+	
 	//set up this services agent identifier
 	AID* id = g_new(AID, 1);
 	AIDInit(id);	
@@ -203,6 +670,7 @@ void MTS_start(DBusConnection* conn, GMainLoop* mainLoop, gchar* baseService) {
 	g_string_sprintfa(temp, "@%s", thePlatform.name->str);
 	AIDSetName(id, temp->str);
 	GString address = buildTransportAddress(thePlatform.service->str, MTS_SERVICE_PATH, "msg");
+	markSharedContentAddress(&address);
 	AIDAddAddress(id, address.str);
 	theMTS.configuration->identifier = id;
 	
@@ -231,6 +699,18 @@ void MTS_start(DBusConnection* conn, GMainLoop* mainLoop, gchar* baseService) {
 void MTS_end() {
 	//disconnect from the bus
 	g_message("MTS Disconnecting from the bus");
+	if (theMTS.laneSource != 0) g_source_remove(theMTS.laneSource);
+	if (theMTS.deliverySource != 0) {
+		g_source_remove(theMTS.deliverySource);
+		flushDeliveries(NULL);
+	}
+	
+	//messages still waiting in the lanes are dropped, closing any shared memory they hold
+	int lane;
+	for (lane=0; lane<ACL_PRIORITY_LEVELS; lane++) {
+		while (!g_queue_is_empty(theMTS.lanes[lane])) 
+			freeDecodedAgentMessage((AgentMessage*)g_queue_pop_head(theMTS.lanes[lane]));
+	}
 	dbus_connection_unref(theMTS.configuration->connection);
 }
 
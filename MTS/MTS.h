@@ -17,5 +17,12 @@
 
 void MTS_start(DBusConnection*, GMainLoop*, gchar*);
 void MTS_end();
+void MTS_setWatermarks(int high, int low);
+void MTS_setCoalescing(int window, int limit);
+void MTS_printStats();
+void MTS_forgetAgent(AID* id);
+
+GString* getTransportableAddress(AID* id);
+DBusMessage* generateMethodCall(GString* address);
 
 #endif
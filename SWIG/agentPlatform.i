@@ -7,17 +7,34 @@
 
 /********** PLATFORM DEFINITIONS **************************/
 extern void bootstrapPlatform();
+extern void bootstrapPlatformWithLoop(int);
 
 /****************** USER AGENT DEFS ************************/
 extern AgentConfiguration* AP_newAgent(char* INPUT, APError* INPUT);
 extern void AP_finish(AgentConfiguration*, APError*);
+extern AgentContainer* AP_newContainer(char*, APError*);
+extern AgentConfiguration* AP_newContainedAgent(AgentContainer*, char*, APError*);
+extern void AP_containerSleep(AgentContainer*);
+extern void AP_finishContainer(AgentContainer*, APError*);
 extern void AP_agentSleep(AgentConfiguration*);
 extern void AP_modifyAMSEntry(AgentConfiguration*, APError*);
 extern GArray* AP_searchAMS(AgentConfiguration*, char*, APError*);
+extern void AP_enableAIDCache(AgentConfiguration*, int, int, APError*);
+extern void AP_disableAIDCache(AgentConfiguration*);
+extern void AP_enableWorkerPool(AgentConfiguration*, int, int, APError*);
+extern void AP_disableWorkerPool(AgentConfiguration*);
+extern GArray* AP_searchAMSPattern(AgentConfiguration*, char*, int, APError*);
 extern void AP_registerWithDF(AgentConfiguration*, APError*);
 extern void AP_modifyDFEntry(AgentConfiguration*, APError*);
 extern GArray* AP_searchDF(AgentConfiguration*, AgentDFDescription*, APError*);
+extern void AP_DFBatch(AgentConfiguration*, GArray*, APError*);
+extern GArray* AP_searchDFConstrained(AgentConfiguration*, AgentDFDescription*, int, int, int*, APError*);
+extern int AP_subscribeDF(AgentConfiguration*, AgentDFDescription*, GArray**, APError*);
+extern void AP_unsubscribeDF(AgentConfiguration*, int, APError*);
 extern void AP_send(AgentConfiguration*, ACLMessage*, APError*);
+extern void AP_sendWithPriority(AgentConfiguration*, ACLMessage*, int, APError*);
+extern void AP_sendBatch(AgentConfiguration*, ACLMessage**, int, APError*);
+extern void AP_setACLRepresentation(AgentConfiguration*, char*, APError*);
 extern void AP_registerMessageReceiverCallback(AgentConfiguration*, MessageReceiver);
 extern void AP_unregisterMessageReceiverCallback(AgentConfiguration*);
 
@@ -27,6 +44,7 @@ extern GArray* ACLEnvelopeGetTo(ACLEnvelope*);
 extern GString* ACLEnvelopeGetACLRepresentation(ACLEnvelope*);
 extern AID* ACLEnvelopeGetIntendedReceiver(ACLEnvelope*);
 extern int ACLEnvelopeHasIntendedReceiver(ACLEnvelope*);
+extern int ACLEnvelopeGetPriority(ACLEnvelope*);
 extern GString* ACLEnvelopeToString(ACLEnvelope*);
 
 /***************** ACL MESSAGE DEFS ************************/
@@ -43,6 +61,8 @@ extern GString* ACLMessageGetReplyWith(ACLMessage*);
 extern GString* ACLMessageGetInReplyTo(ACLMessage*);
 extern GString* ACLMessageGetReplyBy(ACLMessage*);
 extern GString* ACLMessageGetContent(ACLMessage*);
+extern GString* ACLMessageReadContent(ACLMessage*, APError*);
+extern void ACLMessageUnshareContent(ACLMessage*);
 extern GString* ACLMessageToString(ACLMessage*);
 extern ACLMessage* ACLMessageNew(char*);
 extern ACLMessage* ACLMessageCreateReply(ACLMessage*);
@@ -80,6 +100,7 @@ extern GString* SAPErrorGetError(APError*);
 extern GString* AgentDFDescriptionToString(AgentDFDescription*);
 extern GString* DFServiceDescriptionToString(DFServiceDescription*);
 extern AgentDFDescription* DFDescNew();
+extern void DFDescFree(AgentDFDescription*);
 extern AID* DFDescGetAID(AgentDFDescription*);
 extern GArray* DFDescGetServices(AgentDFDescription*);
 extern GArray* DFDescGetLanguages(AgentDFDescription*);
@@ -89,7 +110,11 @@ extern AgentDFDescription* SDFDescAddProtocol(AgentDFDescription*, char*);
 extern AgentDFDescription* SDFDescAddOntology(AgentDFDescription*, char*);
 extern AgentDFDescription* SDFDescAddLanguage(AgentDFDescription*, char*);
 extern AgentDFDescription* SDFDescAddService(AgentDFDescription*, DFServiceDescription*);
+extern DFBatchOperation* DFBatchOperationNew(char*, AgentDFDescription*);
+extern GString* DFBatchOperationGetStatus(DFBatchOperation*);
+extern void DFBatchOperationFree(DFBatchOperation*, gboolean);
 extern DFServiceDescription* DFServiceDescriptionNew();
+extern void DFServiceDescriptionFree(DFServiceDescription*);
 extern GString* ServiceDescGetName(DFServiceDescription*);
 extern GString* ServiceDescGetType(DFServiceDescription*);
 extern GArray* ServiceDescGetProtocols(DFServiceDescription*);
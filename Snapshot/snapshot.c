@@ -0,0 +1,127 @@
+/****************************************************************************************
+ * Filename:	snapshot.c
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Publication and reclamation of the unchanging copies of the directories that are read
+ * without a lock, see snapshot.h.  Readers count themselves against one of two epochs.
+ * When copies have been replaced the main loop moves new readers onto the other epoch and
+ * frees the replaced copies once no reader is left on the old one, as any reader that
+ * could have seen them must have started before the move.
+ * **************************************************************************************/
+
+#include "snapshot.h"
+
+/* a copy that has been replaced and is waiting for its readers to finish */
+struct stRetiredSnapshot {
+	gpointer snapshot;
+	GDestroyNotify destroy;
+};
+typedef struct stRetiredSnapshot RetiredSnapshot;
+
+SnapshotState theSnapshots; /* the one and only record of the readers and the replaced copies */
+
+/* starts a read of the published copies.  Any copy read before the matching call to
+ * SnapshotReadEnd stays valid until then, the read must not block on the main loop
+ * 
+ * returns - the epoch the read was counted against, to be given to SnapshotReadEnd
+ */
+int SnapshotReadBegin() {
+	while (TRUE) {
+		int current = g_atomic_int_get(&theSnapshots.currentEpoch);
+		g_atomic_int_inc(&theSnapshots.readers[current]);
+
+		//if the epoch moved while we joined it the main loop may not have seen us
+		if (g_atomic_int_get(&theSnapshots.currentEpoch) == current) return current;
+		g_atomic_int_dec_and_test(&theSnapshots.readers[current]);
+	}
+}
+
+/* finishes a read started with SnapshotReadBegin, after which none of the copies read
+ * may be used
+ * 
+ * epoch - the value returned by SnapshotReadBegin
+ */
+void SnapshotReadEnd(int epoch) {
+	g_atomic_int_dec_and_test(&theSnapshots.readers[epoch]);
+}
+
+/* frees a list of retired copies */
+void freeRetired(GSList* list) {
+	GSList* item;
+	for (item = list; item != NULL; item = item->next) {
+		RetiredSnapshot* old = (RetiredSnapshot*)item->data;
+		old->destroy(old->snapshot);
+		g_free(old);
+	}
+	g_slist_free(list);
+}
+
+/* frees whatever copies can be freed without waiting
+ * 
+ * returns - TRUE while there are still copies to free
+ */
+gboolean reclaim() {
+	if (theSnapshots.waiting != NULL) {
+		if (g_atomic_int_get(&theSnapshots.readers[theSnapshots.waitingEpoch]) != 0) return TRUE;
+		freeRetired(theSnapshots.waiting);
+		theSnapshots.waiting = NULL;
+	}
+
+	//move new readers onto the other epoch, the copies retired so far are freed once the
+	//readers on this one have finished
+	if (theSnapshots.retired != NULL) {
+		theSnapshots.waiting = theSnapshots.retired;
+		theSnapshots.retired = NULL;
+		theSnapshots.waitingEpoch = g_atomic_int_get(&theSnapshots.currentEpoch);
+		g_atomic_int_set(&theSnapshots.currentEpoch, 1 - theSnapshots.waitingEpoch);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* run from the main loop while there are retired copies */
+gboolean reclaimTimeout(gpointer data) {
+	if (reclaim()) return TRUE;
+	theSnapshots.reclaimSource = 0;
+	return FALSE;
+}
+
+/* makes a new copy the current one.  The copy it replaces is freed once no reader can be
+ * using it, so it must not be changed or freed by the caller.  Must only be called from
+ * the main loop thread
+ * 
+ * location - where the current copy is kept
+ * snapshot - the new copy, which must not be changed once it has been published
+ * destroy - used to free the replaced copy
+ */
+void SnapshotPublish(gpointer* location, gpointer snapshot, GDestroyNotify destroy) {
+	gpointer old = g_atomic_pointer_get(location);
+	g_atomic_pointer_set(location, snapshot);
+	if (old != NULL) SnapshotRetire(old, destroy);
+}
+
+/* frees a copy that is no longer current once every read that started before this call
+ * has finished.  Must only be called from the main loop thread
+ * 
+ * snapshot - the copy that has been replaced
+ * destroy - used to free the copy
+ */
+void SnapshotRetire(gpointer snapshot, GDestroyNotify destroy) {
+	RetiredSnapshot* old = g_new(RetiredSnapshot, 1);
+	old->snapshot = snapshot;
+	old->destroy = destroy;
+	theSnapshots.retired = g_slist_prepend(theSnapshots.retired, old);
+
+	if (theSnapshots.reclaimSource == 0)
+		theSnapshots.reclaimSource = g_timeout_add(SNAPSHOT_RECLAIM_INTERVAL, reclaimTimeout, NULL);
+}
+
+/* waits for the readers of every retired copy to finish and frees the copies, used when
+ * the platform is shutting down
+ */
+void SnapshotSynchronize() {
+	while (reclaim()) g_usleep(100);
+	if (theSnapshots.reclaimSource != 0) g_source_remove(theSnapshots.reclaimSource);
+	theSnapshots.reclaimSource = 0;
+}
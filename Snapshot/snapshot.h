@@ -0,0 +1,48 @@
+/****************************************************************************************
+ * Filename:	snapshot.h
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Declarations of the functions that let the directories be read from any thread without
+ * taking a lock.  The main loop thread, which makes every change, publishes an unchanging
+ * copy of a directory by swapping a pointer.  Threads read whichever copy is current
+ * between SnapshotReadBegin and SnapshotReadEnd, and a copy that has been replaced is only
+ * freed once every read that could still be using it has finished.
+ * **************************************************************************************/
+
+#ifndef __SNAPSHOT_SNAPSHOT_H__
+#define __SNAPSHOT_SNAPSHOT_H__
+
+#include <glib.h>
+
+//how often, in milliseconds, the main loop checks whether replaced copies can be freed
+#define SNAPSHOT_RECLAIM_INTERVAL 10
+
+//the longest, in milliseconds, a change waits to be published.  A search received after
+//a change waits for the copy that holds it, so a directory is copied at most once in each
+//interval however many searches are made
+#define SNAPSHOT_PUBLISH_INTERVAL 10
+
+/* the readers counted against each epoch and the epoch new readers join, the copies 
+ * replaced since new readers were last moved and those waiting on the old epoch */
+struct stSnapshotState {
+	gint readers[2];
+	gint currentEpoch;
+	GSList* retired;
+	GSList* waiting;
+	int waitingEpoch;
+	guint reclaimSource;
+};
+typedef struct stSnapshotState SnapshotState;
+extern SnapshotState theSnapshots;
+
+/********* READERS ****************************************/
+int SnapshotReadBegin();
+void SnapshotReadEnd(int epoch);
+
+/********* THE MAIN LOOP THREAD ****************************/
+void SnapshotPublish(gpointer* location, gpointer snapshot, GDestroyNotify destroy);
+void SnapshotRetire(gpointer snapshot, GDestroyNotify destroy);
+void SnapshotSynchronize();
+
+#endif
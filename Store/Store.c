@@ -0,0 +1,578 @@
+/****************************************************************************************
+ * Filename:	Store.c
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Persistence of the AMS and DF directories.  Every register, modify and de-register
+ * is appended to a journal, and the journal is periodically folded into a compacted
+ * snapshot of both directories.  When the platform is bootstrapped the snapshot is
+ * mapped into memory and the journal replayed on top of it so that agents do not have
+ * to re-register after a restart.
+ * 
+ * Both files use a flat binary layout in the byte order of the host.  Strings are a
+ * 32 bit length followed by the characters (a length of STORE_NULL_STRING denotes an
+ * unset string) and arrays are a 32 bit count followed by the elements.
+ * **************************************************************************************/
+
+#include "Store.h"
+#include "../platform-defs.h"
+#include "../API/API.h"
+#include "../AMS/AMS.h"
+#include "../Tracing/memstats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define STORE_JOURNAL_MAGIC 0x524a5041 /* APJR */
+#define STORE_SNAPSHOT_MAGIC 0x4e535041 /* APSN */
+#define STORE_FORMAT_VERSION 1
+#define STORE_NULL_STRING 0xffffffff
+
+/* header written in front of every journal record */
+struct stStoreRecordHeader {
+	guint8 operation;
+	guint8 directory;
+	guint16 reserved;
+	guint32 length;
+};
+typedef struct stStoreRecordHeader StoreRecordHeader;
+
+/* cursor over a mapped file that is used to read records back in, once a read runs off 
+ * the end of the data ok is cleared and every subsequent read returns nothing
+ */
+struct stStoreReader {
+	const guint8* position;
+	const guint8* end;
+	gboolean ok;
+};
+typedef struct stStoreReader StoreReader;
+
+/************** WRITING RECORDS ****************************************/
+void storeWriteUint32(GByteArray* buffer, guint32 value) {
+	g_byte_array_append(buffer, (guint8*)&value, sizeof(guint32));
+}
+
+void storeWriteString(GByteArray* buffer, GString* str) {
+	if (str == NULL) {
+		storeWriteUint32(buffer, STORE_NULL_STRING);
+		return;
+	}
+	storeWriteUint32(buffer, str->len);
+	g_byte_array_append(buffer, (guint8*)str->str, str->len);
+}
+
+void storeWriteStringArray(GByteArray* buffer, GArray* array) {
+	storeWriteUint32(buffer, array->len);
+	int i;
+	for (i=0; i<array->len; i++) {
+		storeWriteString(buffer, g_array_index(array, GString*, i));
+	}
+}
+
+void storeWriteAID(GByteArray* buffer, AID* id) {
+	if (id == NULL) {
+		storeWriteString(buffer, NULL);
+		storeWriteUint32(buffer, 0);
+		return;
+	}
+	storeWriteString(buffer, id->name);
+	storeWriteStringArray(buffer, id->addresses);
+}
+
+void storeWriteDFService(GByteArray* buffer, DFServiceDescription* service) {
+	storeWriteString(buffer, service->name);
+	storeWriteString(buffer, service->type);
+	storeWriteStringArray(buffer, service->protocols);
+	storeWriteStringArray(buffer, service->ontologies);
+	storeWriteStringArray(buffer, service->languages);
+}
+
+void storeWriteDFEntry(GByteArray* buffer, AgentDFDescription* entry) {
+	storeWriteAID(buffer, entry->id);
+	storeWriteStringArray(buffer, entry->protocols);
+	storeWriteStringArray(buffer, entry->ontologies);
+	storeWriteStringArray(buffer, entry->languages);
+	storeWriteUint32(buffer, entry->services->len);
+	int i;
+	for (i=0; i<entry->services->len; i++) {
+		storeWriteDFService(buffer, g_array_index(entry->services, DFServiceDescription*, i));
+	}
+}
+
+/************** READING RECORDS ****************************************/
+guint32 storeReadUint32(StoreReader* reader) {
+	guint32 value = 0;
+	if (!reader->ok || reader->end - reader->position < sizeof(guint32)) {
+		reader->ok = FALSE;
+		return 0;
+	}
+	memcpy(&value, reader->position, sizeof(guint32));
+	reader->position += sizeof(guint32);
+	return value;
+}
+
+GString* storeReadString(StoreReader* reader) {
+	guint32 length = storeReadUint32(reader);
+	if (!reader->ok || length == STORE_NULL_STRING) return NULL;
+	if (reader->end - reader->position < length) {
+		reader->ok = FALSE;
+		return NULL;
+	}
+	GString* str = g_string_new_len((const gchar*)reader->position, length);
+	reader->position += length;
+	return str;
+}
+
+/* reads an array of strings, appending them to an array that has already been created */
+void storeReadStringArray(StoreReader* reader, GArray* array) {
+	guint32 count = storeReadUint32(reader);
+	int i;
+	for (i=0; i<count && reader->ok; i++) {
+		GString* str = storeReadString(reader);
+		g_array_append_val(array, str);
+	}
+}
+
+AID* storeReadAID(StoreReader* reader) {
+	AID* id = AIDNew();
+	id->name = storeReadString(reader);
+	storeReadStringArray(reader, id->addresses);
+	return id;
+}
+
+DFServiceDescription* storeReadDFService(StoreReader* reader) {
+	DFServiceDescription* service = DFServiceDescriptionNew();
+	service->name = storeReadString(reader);
+	service->type = storeReadString(reader);
+	storeReadStringArray(reader, service->protocols);
+	storeReadStringArray(reader, service->ontologies);
+	storeReadStringArray(reader, service->languages);
+	return service;
+}
+
+AgentDFDescription* storeReadDFEntry(StoreReader* reader) {
+	AgentDFDescription* entry = DFDescNew();
+	entry->id = storeReadAID(reader);
+	storeReadStringArray(reader, entry->protocols);
+	storeReadStringArray(reader, entry->ontologies);
+	storeReadStringArray(reader, entry->languages);
+	guint32 count = storeReadUint32(reader);
+	int i;
+	for (i=0; i<count && reader->ok; i++) {
+		DFServiceDescription* service = storeReadDFService(reader);
+		g_array_append_val(entry->services, service);
+	}
+	return entry;
+}
+
+/************** FILES *****************************************************/
+/* builds the full path of one of the persistence files
+ * 
+ * file - the name of the file within the store directory
+ * returns - the path, which should be freed
+ */
+GString* storePath(char* file) {
+	GString* path = g_string_new(theStore.directory->str);
+	g_string_sprintfa(path, "/%s", file);
+	return path;
+}
+
+/* maps a file read only into memory
+ * 
+ * path - the file to map
+ * length - filled in with the size of the mapping
+ * returns - the start of the mapping or NULL if the file is missing or empty
+ */
+const guint8* storeMapFile(GString* path, gsize* length) {
+	int fd = open(path->str, O_RDONLY);
+	if (fd == -1) return NULL;
+	
+	struct stat info;
+	if (fstat(fd, &info) == -1 || info.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+	
+	void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return NULL;
+	
+	*length = info.st_size;
+	return (const guint8*)data;
+}
+
+/* checks whether an identifier belongs to one of the platform services, these are
+ * registered afresh on every bootstrap so are never persisted
+ */
+gboolean storeIsPlatformService(AID* id) {
+	return id == theAMS.configuration->identifier || id == theMTS.configuration->identifier
+		|| id == theDF.configuration->identifier;
+}
+
+/************** RESTORING ***********************************************/
+/* applies a single journal record to the directories.  Errors are ignored as a record
+ * may already be reflected in the snapshot if the platform stopped during compaction,
+ * but an entry that was not taken into a directory is freed
+ * 
+ * operation - one of the STORE_OP constants
+ * directory - one of the STORE_DIRECTORY constants
+ * reader - positioned at the payload of the record
+ */
+void storeApplyRecord(int operation, int directory, StoreReader* reader) {
+	APError error;
+	APErrorInit(&error);
+	
+	if (directory == STORE_DIRECTORY_AMS) {
+		if (operation == STORE_OP_DEREGISTER) {
+			GString* name = storeReadString(reader);
+			if (name == NULL) return;
+			AMS_deRegister(name->str, &error);
+			g_string_free(name, TRUE);
+		}
+		else {
+			AID* id = storeReadAID(reader);
+			if (reader->ok) {
+				if (operation == STORE_OP_REGISTER)
+					AMS_register(id, &error);
+				else
+					AMS_modify(id, &error);
+			}
+			if (!reader->ok || APErrorIsSet(error)) {
+				AIDFree(*id);
+				AP_FREE(id);
+			}
+		}
+	}
+	else if (directory == STORE_DIRECTORY_DF) {
+		if (operation == STORE_OP_DEREGISTER) {
+			GString* name = storeReadString(reader);
+			if (name == NULL) return;
+			DF_deRegisterEntry(name, &error);
+			g_string_free(name, TRUE);
+		}
+		else {
+			AgentDFDescription* entry = storeReadDFEntry(reader);
+			if (reader->ok) {
+				if (operation == STORE_OP_REGISTER)
+					DF_registerEntry(entry, &error);
+				else
+					DF_modifyEntry(entry, &error);
+			}
+			if (!reader->ok || APErrorIsSet(error)) DFDescFree(entry);
+		}
+	}
+	if (APErrorIsSet(error)) APErrorFree(&error);
+}
+
+/* loads the directories from the last snapshot that was written
+ * 
+ * returns - the number of AMS and DF entries that were read
+ */
+int storeRestoreSnapshot() {
+	GString* path = storePath(STORE_SNAPSHOT_FILE);
+	gsize length;
+	const guint8* data = storeMapFile(path, &length);
+	g_string_free(path, TRUE);
+	if (data == NULL) return 0;
+	
+	StoreReader reader = { data, data + length, TRUE };
+	guint32 magic = storeReadUint32(&reader);
+	guint32 version = storeReadUint32(&reader);
+	guint32 amsEntries = storeReadUint32(&reader);
+	guint32 dfEntries = storeReadUint32(&reader);
+	if (!reader.ok || magic != STORE_SNAPSHOT_MAGIC || version != STORE_FORMAT_VERSION) {
+		g_warning("STORE: ignoring unreadable snapshot");
+		munmap((void*)data, length);
+		return 0;
+	}
+	
+	//the AMS entries come first as the DF checks its entries against the AMS
+	int i;
+	int restored = 0;
+	for (i=0; i<amsEntries + dfEntries && reader.ok; i++) {
+		guint32 recordLength = storeReadUint32(&reader);
+		if (!reader.ok || reader.end - reader.position < recordLength) break;
+		
+		StoreReader record = { reader.position, reader.position + recordLength, TRUE };
+		storeApplyRecord(STORE_OP_REGISTER, i < amsEntries ? STORE_DIRECTORY_AMS : STORE_DIRECTORY_DF, &record);
+		reader.position += recordLength;
+		restored++;
+	}
+	
+	munmap((void*)data, length);
+	return restored;
+}
+
+/* replays the operations recorded in the journal since the last snapshot was taken.  A
+ * partially written record at the end of the journal is ignored
+ * 
+ * returns - the number of records replayed
+ */
+int storeReplayJournal() {
+	GString* path = storePath(STORE_JOURNAL_FILE);
+	gsize length;
+	const guint8* data = storeMapFile(path, &length);
+	g_string_free(path, TRUE);
+	if (data == NULL) return 0;
+	
+	StoreReader reader = { data, data + length, TRUE };
+	guint32 magic = storeReadUint32(&reader);
+	guint32 version = storeReadUint32(&reader);
+	if (!reader.ok || magic != STORE_JOURNAL_MAGIC || version != STORE_FORMAT_VERSION) {
+		g_warning("STORE: ignoring unreadable journal");
+		munmap((void*)data, length);
+		return 0;
+	}
+	
+	int replayed = 0;
+	while (reader.end - reader.position >= sizeof(StoreRecordHeader)) {
+		StoreRecordHeader header;
+		memcpy(&header, reader.position, sizeof(StoreRecordHeader));
+		reader.position += sizeof(StoreRecordHeader);
+		if (reader.end - reader.position < header.length) break;
+		
+		StoreReader record = { reader.position, reader.position + header.length, TRUE };
+		storeApplyRecord(header.operation, header.directory, &record);
+		reader.position += header.length;
+		replayed++;
+	}
+	
+	munmap((void*)data, length);
+	return replayed;
+}
+
+/************** JOURNALING ***********************************************/
+/* appends a record to the journal and compacts the journal if it has grown too long
+ * 
+ * operation - one of the STORE_OP constants
+ * directory - one of the STORE_DIRECTORY constants
+ * payload - the encoded entry or name the operation applies to
+ */
+void storeAppendRecord(int operation, int directory, GByteArray* payload) {
+	StoreRecordHeader header;
+	header.operation = operation;
+	header.directory = directory;
+	header.reserved = 0;
+	header.length = payload->len;
+	
+	long start = ftell(theStore.journal);
+	gboolean written = fwrite(&header, sizeof(StoreRecordHeader), 1, theStore.journal) == 1;
+	written = written && fwrite(payload->data, 1, payload->len, theStore.journal) == payload->len;
+	written = fflush(theStore.journal) == 0 && written;
+	if (!written) {
+		//cut off the partial record so that later records can still be replayed, then try
+		//to save the change, which is already in the directory, in a new snapshot
+		g_warning("STORE: unable to write to the journal in %s, writing a snapshot instead", theStore.directory->str);
+		clearerr(theStore.journal);
+		if (start < 0 || ftruncate(fileno(theStore.journal), start) != 0) {
+			g_warning("STORE: the journal could not be repaired, directory changes will not be persisted");
+			fclose(theStore.journal);
+			theStore.journal = NULL;
+			return;
+		}
+		fseek(theStore.journal, 0, SEEK_END);
+		Store_compact();
+		return;
+	}
+	
+	theStore.journalRecords++;
+	if (theStore.journalRecords >= STORE_COMPACT_THRESHOLD) Store_compact();
+}
+
+/* records a register or modify of an AMS entry
+ * 
+ * operation - STORE_OP_REGISTER or STORE_OP_MODIFY
+ * id - the identifier as it is now held in the directory
+ */
+void Store_journalAMS(int operation, AID* id) {
+	if (theStore.journal == NULL) return;
+	GByteArray* payload = g_byte_array_new();
+	storeWriteAID(payload, id);
+	storeAppendRecord(operation, STORE_DIRECTORY_AMS, payload);
+	g_byte_array_free(payload, TRUE);
+}
+
+/* records the removal of an agent from the AMS
+ * 
+ * name - the full name of the agent that was removed
+ */
+void Store_journalAMSDeRegister(char* name) {
+	if (theStore.journal == NULL) return;
+	GByteArray* payload = g_byte_array_new();
+	GString* temp = g_string_new(name);
+	storeWriteString(payload, temp);
+	storeAppendRecord(STORE_OP_DEREGISTER, STORE_DIRECTORY_AMS, payload);
+	g_string_free(temp, TRUE);
+	g_byte_array_free(payload, TRUE);
+}
+
+/* records a register or modify of a DF entry
+ * 
+ * operation - STORE_OP_REGISTER or STORE_OP_MODIFY
+ * entry - the entry as it is now held in the directory
+ */
+void Store_journalDF(int operation, AgentDFDescription* entry) {
+	if (theStore.journal == NULL) return;
+	GByteArray* payload = g_byte_array_new();
+	storeWriteDFEntry(payload, entry);
+	storeAppendRecord(operation, STORE_DIRECTORY_DF, payload);
+	g_byte_array_free(payload, TRUE);
+}
+
+/* records the removal of an entry from the DF
+ * 
+ * name - the name of the agent whose entry was removed
+ */
+void Store_journalDFDeRegister(GString* name) {
+	if (theStore.journal == NULL) return;
+	GByteArray* payload = g_byte_array_new();
+	storeWriteString(payload, name);
+	storeAppendRecord(STORE_OP_DEREGISTER, STORE_DIRECTORY_DF, payload);
+	g_byte_array_free(payload, TRUE);
+}
+
+/* appends a length prefixed record to a snapshot being built
+ * 
+ * buffer - the snapshot
+ * returns - the offset of the length, to be filled in by storeEndSnapshotRecord
+ */
+guint storeBeginSnapshotRecord(GByteArray* buffer) {
+	guint offset = buffer->len;
+	storeWriteUint32(buffer, 0);
+	return offset;
+}
+
+void storeEndSnapshotRecord(GByteArray* buffer, guint offset) {
+	guint32 length = buffer->len - offset - sizeof(guint32);
+	memcpy(buffer->data + offset, &length, sizeof(guint32));
+}
+
+/* opens the journal so that changes can be appended to it.  A header is written if the
+ * journal is new or empty
+ * 
+ * truncate - TRUE to start an empty journal, FALSE to append to the existing one
+ */
+void storeOpenJournal(gboolean truncate) {
+	GString* path = storePath(STORE_JOURNAL_FILE);
+	theStore.journal = fopen(path->str, truncate ? "wb" : "ab");
+	g_string_free(path, TRUE);
+	if (theStore.journal == NULL) {
+		g_warning("STORE: unable to open the journal, directory changes will not be persisted");
+		return;
+	}
+	
+	fseek(theStore.journal, 0, SEEK_END);
+	if (ftell(theStore.journal) == 0) {
+		guint32 header[2] = { STORE_JOURNAL_MAGIC, STORE_FORMAT_VERSION };
+		fwrite(header, sizeof(guint32), 2, theStore.journal);
+		fflush(theStore.journal);
+	}
+}
+
+/* writes a snapshot of both directories and then starts a new empty journal.  The 
+ * snapshot is written to a temporary file and renamed into place so that a crash part
+ * way through leaves the previous snapshot and journal intact
+ */
+void Store_compact() {
+	if (theStore.directory == NULL) return;
+	
+	//build the snapshot in memory
+	GByteArray* buffer = g_byte_array_new();
+	storeWriteUint32(buffer, STORE_SNAPSHOT_MAGIC);
+	storeWriteUint32(buffer, STORE_FORMAT_VERSION);
+	guint countOffset = buffer->len;
+	storeWriteUint32(buffer, 0);
+	storeWriteUint32(buffer, theDF.agentDirectory->len);
+	
+	int i;
+	guint32 amsEntries = 0;
+	for (i=0; i<theAMS.agentDirectory->len; i++) {
+		AID* id = g_array_index(theAMS.agentDirectory, AID*, i);
+		if (storeIsPlatformService(id)) continue;
+		guint offset = storeBeginSnapshotRecord(buffer);
+		storeWriteAID(buffer, id);
+		storeEndSnapshotRecord(buffer, offset);
+		amsEntries++;
+	}
+	memcpy(buffer->data + countOffset, &amsEntries, sizeof(guint32));
+	
+	for (i=0; i<theDF.agentDirectory->len; i++) {
+		guint offset = storeBeginSnapshotRecord(buffer);
+		storeWriteDFEntry(buffer, g_array_index(theDF.agentDirectory, AgentDFDescription*, i));
+		storeEndSnapshotRecord(buffer, offset);
+	}
+	
+	//write it out and move it into place
+	GString* path = storePath(STORE_SNAPSHOT_FILE);
+	GString* tempPath = g_string_new(path->str);
+	g_string_sprintfa(tempPath, ".tmp");
+	gboolean written = FALSE;
+	FILE* file = fopen(tempPath->str, "wb");
+	if (file != NULL) {
+		written = fwrite(buffer->data, 1, buffer->len, file) == buffer->len;
+		written = fflush(file) == 0 && fsync(fileno(file)) == 0 && written;
+		fclose(file);
+		if (written) written = rename(tempPath->str, path->str) == 0;
+	}
+	g_byte_array_free(buffer, TRUE);
+	g_string_free(tempPath, TRUE);
+	g_string_free(path, TRUE);
+	if (!written) {
+		//the journal still holds everything since the last snapshot so keep adding to it,
+		//opening it again if this is the compaction made at bootstrap
+		g_warning("STORE: unable to write a snapshot to %s, keeping the existing journal", theStore.directory->str);
+		if (theStore.journal == NULL) storeOpenJournal(FALSE);
+		return;
+	}
+	
+	//everything in the journal is now in the snapshot so start again
+	if (theStore.journal != NULL) fclose(theStore.journal);
+	theStore.journal = NULL;
+	storeOpenJournal(TRUE);
+	if (theStore.journal == NULL) return;
+	theStore.journalRecords = 0;
+	
+	g_message("STORE: snapshot written with %d AMS and %d DF entries", amsEntries, theDF.agentDirectory->len);
+}
+
+/* Called during bootstrapping of the platform once the AMS and DF have been started and
+ * the platform services registered.  Restores both directories from the snapshot and
+ * journal and then begins journaling.
+ * 
+ * directory - the directory holding the persistence files, if NULL then the value of
+ * 	AP_STORE_DIRECTORY is used or failing that the working directory
+ */
+void Store_start(char* directory) {
+	if (directory == NULL) directory = getenv(STORE_DIRECTORY_VARIABLE);
+	if (directory == NULL) directory = ".";
+	theStore.directory = g_string_new(directory);
+	theStore.journal = NULL;
+	theStore.journalRecords = 0;
+	
+	GTimer* timer = g_timer_new();
+	int restored = storeRestoreSnapshot();
+	int replayed = storeReplayJournal();
+	g_message("STORE: restored %d entries and replayed %d journal records in %.1fms", 
+		restored, replayed, g_timer_elapsed(timer, NULL) * 1000);
+	g_timer_destroy(timer);
+	
+	//drop the agents that died while the platform was down before anything is journaled
+	AMS_checkRestored();
+	
+	//fold what was replayed into a new snapshot which also opens a fresh journal
+	Store_compact();
+}
+
+/* Called when the platform has been told to terminate, writes a final snapshot so that
+ * the next bootstrap does not need to replay the journal
+ */
+void Store_end() {
+	g_message("STORE: writing final snapshot");
+	Store_compact();
+	if (theStore.journal != NULL) fclose(theStore.journal);
+	theStore.journal = NULL;
+}
@@ -0,0 +1,36 @@
+/****************************************************************************************
+ * Filename:	Store.h
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Declarations of the functions that persist the AMS and DF directories so that they
+ * survive a restart of the platform
+ * **************************************************************************************/
+
+#ifndef __STORE_STORE_H__
+#define __STORE_STORE_H__
+
+#include <glib.h>
+#include "../platform-defs.h"
+
+/* operations recorded in the journal */
+#define STORE_OP_REGISTER 1
+#define STORE_OP_MODIFY 2
+#define STORE_OP_DEREGISTER 3
+
+/* directories that a journal record can apply to */
+#define STORE_DIRECTORY_AMS 1
+#define STORE_DIRECTORY_DF 2
+
+/********* BOOTSTRAP FUNCTIONS ***********************/
+void Store_start(char* directory);
+void Store_end();
+
+/********* JOURNALING **********************************/
+void Store_journalAMS(int operation, AID* id);
+void Store_journalAMSDeRegister(char* name);
+void Store_journalDF(int operation, AgentDFDescription* entry);
+void Store_journalDFDeRegister(GString* name);
+void Store_compact();
+
+#endif
@@ -8,7 +8,9 @@
 
 #include "test-agents.h"
 #include "../API/API.h"
+#include "../Codec/DBusCodec.h"
 #include <stdio.h>
+#include <string.h>
 
 /* function registered with the API that is used as the callback function when a message
  * is received, it simply echoes the message received to the terminal window
@@ -50,6 +52,44 @@ void bootAgent(char* name) {
 	AP_finish(myAgent, &error);
 }
 
+/* measures how quickly agents can be bootstrapped by starting a number of them one after
+ * the other in this process and reporting the rate, the agents are finished afterwards
+ * 
+ * count - the number of agents to start
+ */
+void bootBenchmark(int count) {
+	APError error;
+	APErrorInit(&error);
+	AgentConfiguration** agents = g_new0(AgentConfiguration*, count);
+	
+	GTimer* timer = g_timer_new();
+	int i;
+	for (i=0; i<count; i++) {
+		GString* name = g_string_new("");
+		g_string_printf(name, "BootBench%d", i);
+		agents[i] = AP_newAgent(name->str, &error);
+		g_string_free(name, TRUE);
+		if (APErrorIsSet(error)) {
+			g_message("Unable to bootstrap agent %d - %s", i, error.message->str);
+			APErrorFree(&error);
+			APErrorInit(&error);
+			break;
+		}
+	}
+	g_timer_stop(timer);
+	
+	gdouble elapsed = g_timer_elapsed(timer, NULL);
+	g_message("Bootstrapped %d agents in %.3f seconds (%.1f agents/second)", i, elapsed, 
+		elapsed > 0 ? i / elapsed : 0.0);
+	g_timer_destroy(timer);
+	
+	g_message("Finishing Agents...");
+	for (i=0; i<count && agents[i] != NULL; i++) {
+		AP_finish(agents[i], &error);
+	}
+	g_free(agents);
+}
+
 /* simple agent that just boots up and then modifies its AMS entry
  * 
  * name - the name that the agent should use
@@ -123,7 +163,31 @@ void AMSSearchAgent(char* name) {
 			g_string_free(str, TRUE);
 		}
 	}
-
+	
+	//resolve several names in one go, one of which will not exist
+	char* names[] = { "server", name, "no-such-agent" };
+	results = AP_searchAMSBatch(myAgent, names, 3, &error);
+	if (APErrorIsSet(error)) {
+		g_message("AMS batch search failed - %s", error.message->str);
+		APErrorReInit(&error);
+	}
+	else {
+		int i;
+		for (i=0; i<results->len; i++) {
+			AID* id = g_array_index(results, AID*, i);
+			g_message("%s resolved to %s", names[i], id == NULL ? "nothing" : id->name->str);
+		}
+	}
+	
+	//find every agent whose name starts with s
+	results = AP_searchAMSPattern(myAgent, "s*", 0, &error);
+	if (APErrorIsSet(error)) {
+		g_message("AMS pattern search failed - %s", error.message->str);
+		APErrorReInit(&error);
+	}
+	else {
+		g_message("AMS pattern search found %d agents", results->len);
+	}
 	
 	g_message("Finishing Agent...");
 	AP_finish(myAgent, &error);
@@ -373,6 +437,142 @@ void agent(char* name) {
 	AP_finish(myAgent, &error);
 }
 
+/* agent that sends a number of messages to the agent called server1 in a single batch
+ * and then waits for the replies
+ * 
+ * count - the number of messages to send
+ */
+void batchAgent(int count) {
+	APError error;
+	APErrorInit(&error);
+	AgentConfiguration* myAgent = AP_newAgent("BatchSender", &error);	
+	if (APErrorIsSet(error)) {
+		g_message("Unable to bootstrap agent - %s", error.message->str);
+		APErrorFree(&error);
+		return;
+	}
+	
+	AID* receiver = g_new(AID, 1);
+	AIDInit(receiver);
+	AIDSetName(receiver, "server1");
+	
+	//each message is a conversation of its own
+	ACLMessage** msgs = g_new(ACLMessage*, count);
+	int i;
+	for (i=0; i<count; i++) {
+		msgs[i] = ACLMessageNew(ACL_QUERY_IF);
+		ACLMessageAddReceiver(msgs[i], receiver);
+		ACLMessageSetContent(msgs[i], "ping");
+		ACLMessageSetLanguage(msgs[i], "string");
+		ACLMessageSetOntology(msgs[i], "ap-tests");
+		GString* conversation = g_string_new("");
+		g_string_printf(conversation, "batch-%d", i);
+		ACLMessageSetConversationID(msgs[i], conversation->str);
+		g_string_free(conversation, TRUE);
+	}
+	
+	AP_sendBatch(myAgent, msgs, count, &error);
+	if (APErrorIsSet(error)) {
+		g_message("Batch sending failed - %s", error.message->str);
+		APErrorReInit(&error);
+	}
+	else {
+		g_message("Batch of %d messages sent", count);
+	}
+	g_free(msgs);
+	
+	AP_registerMessageReceiverCallback(myAgent, callbackFn);
+	g_message("Agent sleeping...");
+	AP_agentSleep(myAgent);
+	
+	g_message("Finishing Agent...");
+	AP_finish(myAgent, &error);
+}
+
+//state of the loop benchmark, the agent keeps a window of messages to itself in flight
+#define LOOP_BENCH_WINDOW 128
+static int loopBenchToSend = 0;
+static int loopBenchToReceive = 0;
+static ACLMessage* loopBenchMessage = NULL;
+static GTimer* loopBenchTimer = NULL;
+
+/* callback function used by the loop benchmark, every message that comes back through 
+ * the MTS is replaced by another until all of them have been sent
+ * 
+ * data - the agent configuration structure
+ * message - the message that was received
+ */
+void loopBenchCallbackFn(void* data, AgentMessage* message) {
+	AgentConfiguration* agent = (AgentConfiguration*)data;
+	APError error;
+	APErrorInit(&error);
+	
+	loopBenchToReceive--;
+	if (loopBenchToSend > 0) {
+		loopBenchToSend--;
+		AP_send(agent, loopBenchMessage, &error);
+		if (APErrorIsSet(error)) {
+			g_message("Sending failed - %s", error.message->str);
+			APErrorFree(&error);
+			loopBenchToReceive--;
+		}
+	}
+	
+	if (loopBenchToReceive <= 0) g_main_loop_quit(agent->mainLoop);
+}
+
+/* sends the given number of messages from an agent to itself through the MTS, keeping a
+ * window of them in flight, and reports how many messages per second the platform 
+ * delivered.  Running it against a platform started normally and one started with 
+ * AP_EVENT_LOOP=epoll compares the two loops
+ * 
+ * count - the number of messages to send
+ */
+void loopBenchmark(int count) {
+	APError error;
+	APErrorInit(&error);
+	AgentConfiguration* myAgent = AP_newAgent("LoopBench", &error);	
+	if (APErrorIsSet(error)) {
+		g_message("Unable to bootstrap agent - %s", error.message->str);
+		APErrorFree(&error);
+		return;
+	}
+	
+	loopBenchMessage = ACLMessageNew(ACL_INFORM);
+	ACLMessageAddReceiver(loopBenchMessage, myAgent->identifier);
+	ACLMessageSetContent(loopBenchMessage, "ping");
+	ACLMessageSetLanguage(loopBenchMessage, "string");
+	ACLMessageSetOntology(loopBenchMessage, "ap-tests");
+	AP_registerMessageReceiverCallback(myAgent, loopBenchCallbackFn);
+	
+	loopBenchToSend = count;
+	loopBenchToReceive = count;
+	loopBenchTimer = g_timer_new();
+	int i;
+	for (i=0; i<LOOP_BENCH_WINDOW && loopBenchToSend > 0; i++) {
+		loopBenchToSend--;
+		AP_send(myAgent, loopBenchMessage, &error);
+		if (APErrorIsSet(error)) {
+			g_message("Sending failed - %s", error.message->str);
+			APErrorFree(&error);
+			APErrorInit(&error);
+			loopBenchToReceive--;
+		}
+	}
+	
+	if (loopBenchToReceive > 0) AP_agentSleep(myAgent);
+	g_timer_stop(loopBenchTimer);
+	
+	gdouble elapsed = g_timer_elapsed(loopBenchTimer, NULL);
+	int delivered = count - loopBenchToReceive;
+	g_message("Delivered %d messages in %.3f seconds (%.1f messages/second)", delivered, elapsed,
+		elapsed > 0 ? delivered / elapsed : 0.0);
+	g_timer_destroy(loopBenchTimer);
+	
+	g_message("Finishing Agent...");
+	AP_finish(myAgent, &error);
+}
+
 /* callback function registered with the API by server agents used in some of the tests,
  * it simply echoes the message received to the screen and sends a reply saying
  * i'm here
@@ -396,6 +596,48 @@ void serverCallbackFn(void* data, AgentMessage* message) {
 	AP_send(agent, reply, &error);
 }
 
+/* starts a container holding the given number of agents, each of which echoes any 
+ * message that it receives back to the sender, and then sleeps until the container is 
+ * sent the terminate management message
+ * 
+ * count - the number of agents to start in the container
+ */
+void containerAgents(int count) {
+	APError error;
+	APErrorInit(&error);
+	
+	AgentContainer* container = AP_newContainer("Container", &error);
+	if (APErrorIsSet(error)) {
+		g_message("Unable to start container - %s", error.message->str);
+		APErrorFree(&error);
+		return;
+	}
+	
+	GTimer* timer = g_timer_new();
+	int i;
+	for (i=0; i<count; i++) {
+		GString* name = g_string_new("");
+		g_string_printf(name, "Contained%d", i);
+		AgentConfiguration* agent = AP_newContainedAgent(container, name->str, &error);
+		g_string_free(name, TRUE);
+		if (APErrorIsSet(error)) {
+			g_message("Unable to start agent %d - %s", i, error.message->str);
+			APErrorFree(&error);
+			APErrorInit(&error);
+			break;
+		}
+		AP_registerMessageReceiverCallback(agent, serverCallbackFn);
+	}
+	g_timer_stop(timer);
+	g_message("Started %d agents in the container in %.3f seconds", i, g_timer_elapsed(timer, NULL));
+	g_timer_destroy(timer);
+	
+	AP_containerSleep(container);
+	
+	g_message("Finishing Container...");
+	AP_finishContainer(container, &error);
+}
+
 /* implementation of the simple server agents that are used for the testing of some
  * of the functionality.  It bootstraps adds a DF entry and then waits to receive
  * messages
@@ -438,3 +680,212 @@ void serverAgent(char* name) {
 	g_message("Finishing Agent...");
 	AP_finish(myAgent, &error);
 }
+
+/* function registered with the API that is called when the DF notifies the subscriber 
+ * agent of a change, it simply echoes the notification to the terminal window
+ * 
+ * data - the agent configuration structure
+ * subscription - the identifier of the subscription that matched
+ * event - what happened to the entry
+ * entry - the entry that changed
+ */
+void subscriberCallbackFn(void* data, int subscription, GString* event, AgentDFDescription* entry) {
+	GString* gstr = AgentDFDescriptionToString(entry);
+	g_message("Subscription %d: entry %s\n%s", subscription, event->str, gstr->str);
+	g_string_free(gstr, TRUE);
+}
+
+/* agent that subscribes to the DF for the test servers and then waits to be told as 
+ * servers are started and stopped
+ * 
+ * name - the name that the agent should use
+ */
+void DFSubscribeAgent(char* name) {
+	APError error;
+	APErrorInit(&error);
+	
+	AgentConfiguration* myAgent = AP_newAgent(name, &error);	
+	if (APErrorIsSet(error)) {
+		g_message("Unable to bootstrap agent - %s", error.message->str);
+		APErrorFree(&error);
+		return;
+	}
+	else {
+		g_message("Agent bootstrapped successfully");
+	}	
+	
+	//subscribe to all of the test servers
+	AgentDFDescription template;
+	AgentDFDescriptionInit(&template);
+	DFDescAddOntology(&template, "test-server");
+	AP_registerDFNotificationCallback(myAgent, subscriberCallbackFn);
+	GArray* results;
+	int subscription = AP_subscribeDF(myAgent, &template, &results, &error);
+	if (APErrorIsSet(error)) {
+		g_message("DF subscription failed - %s", error.message->str);
+		APErrorReInit(&error);
+	}
+	else {
+		g_message("Subscription %d made, %d servers currently registered", subscription, results->len);
+	}
+	
+	//put the agent to sleep waiting for notifications
+	g_message("Agent sleeping...");
+	AP_agentSleep(myAgent);
+	
+	g_message("Finishing Agent...");
+	AP_finish(myAgent, &error);
+}
+
+/* agent that registers, modifies and de-registers its DF entry in batches, including
+ * operations that should fail, and then sends a batch that claims to hold far more 
+ * operations than it does to check that the DF only answers the ones that were sent
+ * 
+ * name - the name that the agent should use
+ */
+void DFBatchAgent(char* name) {
+	APError error;
+	APErrorInit(&error);
+	
+	AgentConfiguration* myAgent = AP_newAgent(name, &error);	
+	if (APErrorIsSet(error)) {
+		g_message("Unable to bootstrap agent - %s", error.message->str);
+		APErrorFree(&error);
+		return;
+	}
+	else {
+		g_message("Agent bootstrapped successfully");
+	}	
+	DFDescAddOntology(myAgent->DFEntry, "test-batch");
+	
+	//register twice, the second should be refused as a duplicate, then modify
+	GArray* operations = g_array_new(FALSE, FALSE, sizeof(DFBatchOperation*));
+	DFBatchOperation* op = DFBatchOperationNew(MSG_DF_REGISTER, myAgent->DFEntry);
+	g_array_append_val(operations, op);
+	op = DFBatchOperationNew(MSG_DF_REGISTER, myAgent->DFEntry);
+	g_array_append_val(operations, op);
+	op = DFBatchOperationNew(MSG_DF_MODIFY, myAgent->DFEntry);
+	g_array_append_val(operations, op);
+	op = DFBatchOperationNew(MSG_DF_DEREGISTER, myAgent->DFEntry);
+	g_array_append_val(operations, op);
+	op = DFBatchOperationNew(MSG_DF_DEREGISTER, myAgent->DFEntry);
+	g_array_append_val(operations, op);
+	AP_DFBatch(myAgent, operations, &error);
+	if (APErrorIsSet(error)) {
+		g_message("DF batch failed - %s", error.message->str);
+		APErrorReInit(&error);
+	}
+	int i;
+	for (i=0; i<operations->len; i++) {
+		op = g_array_index(operations, DFBatchOperation*, i);
+		g_message("Operation %d (%s): %s", i, op->operation->str, 
+			op->status == NULL ? "no status" : op->status->str);
+		DFBatchOperationFree(op, FALSE);
+	}
+	g_array_free(operations, TRUE);
+	
+	//a batch that claims a million operations but only holds one
+	DBusMessage* msg = dbus_message_new_method_call(PLATFORM_SERVICE, 
+	 	DF_SERVICE_PATH, PLATFORM_SERVICE, MSG_DF_BATCH);
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(msg, &iter);
+	encodeInt(&iter, 1000000);
+	GString* operation = g_string_new(MSG_DF_DEREGISTER);
+	encodeString(&iter, operation);
+	encodeDFEntry(&iter, myAgent->DFEntry);
+	g_string_free(operation, TRUE);
+	
+	DBusError dbusError;
+	dbus_error_init(&dbusError);
+	DBusMessage* reply = dbus_connection_send_with_reply_and_block(myAgent->connection, msg, 
+		WAIT_TIME, &dbusError);
+	dbus_message_unref(msg);
+	if (reply == NULL) {
+		g_message("Malformed batch got no reply - %s", dbusError.message);
+		dbus_error_free(&dbusError);
+	}
+	else {
+		DBusMessageIter replyIter;
+		dbus_message_iter_init(reply, &replyIter);
+		g_message("Malformed batch answered with %d results, expected 1", decodeInt(&replyIter));
+		dbus_message_unref(reply);
+	}
+	
+	g_message("Finishing Agent...");
+	AP_finish(myAgent, &error);
+}
+
+//messages and failures received by the expiry test agent
+static int expiryDelivered = 0;
+static int expiryFailures = 0;
+
+/* callback for the expiry test agent, counts the failures the MTS sends back about 
+ * expired messages separately from the messages that were delivered
+ * 
+ * data - the agent configuration structure
+ * message - the message that was received
+ */
+void expiryCallbackFn(void* data, AgentMessage* message) {
+	AgentConfiguration* agent = (AgentConfiguration*)data;
+	ACLMessage* payload = message->payload;
+	if (payload->performative != NULL && g_ascii_strcasecmp(payload->performative->str, ACL_FAILURE) == 0
+		&& payload->content != NULL && strstr(payload->content->str, MTS_MESSAGE_EXPIRED) != NULL)
+		expiryFailures++;
+	else
+		expiryDelivered++;
+	if (expiryDelivered + expiryFailures >= 3) g_main_loop_quit(agent->mainLoop);
+}
+
+/* stops the expiry test agent if the messages it is waiting for never arrive */
+gboolean expiryTimeout(gpointer data) {
+	g_main_loop_quit(((AgentConfiguration*)data)->mainLoop);
+	return FALSE;
+}
+
+/* agent that sends itself one message whose reply-by time has already passed, one whose
+ * reply-by time is a minute from now and one that has no deadline, the MTS should drop 
+ * the first and tell the agent it expired
+ * 
+ * name - the name that the agent should use
+ */
+void expiryAgent(char* name) {
+	APError error;
+	APErrorInit(&error);
+	AgentConfiguration* myAgent = AP_newAgent(name, &error);	
+	if (APErrorIsSet(error)) {
+		g_message("Unable to bootstrap agent - %s", error.message->str);
+		APErrorFree(&error);
+		return;
+	}
+	AP_registerMessageReceiverCallback(myAgent, expiryCallbackFn);
+	
+	ACLMessage* expired = ACLMessageNew(ACL_INFORM);
+	ACLMessageAddReceiver(expired, myAgent->identifier);
+	ACLMessageSetContent(expired, "too late");
+	ACLMessageSetReplyBy(expired, "20000101T000000000");
+	AP_send(myAgent, expired, &error);
+	
+	ACLMessage* relative = ACLMessageNew(ACL_INFORM);
+	ACLMessageAddReceiver(relative, myAgent->identifier);
+	ACLMessageSetContent(relative, "within a minute");
+	ACLMessageSetReplyBy(relative, "+00000000T000100000");
+	if (!APErrorIsSet(error)) AP_send(myAgent, relative, &error);
+	
+	ACLMessage* fresh = ACLMessageNew(ACL_INFORM);
+	ACLMessageAddReceiver(fresh, myAgent->identifier);
+	ACLMessageSetContent(fresh, "in time");
+	if (!APErrorIsSet(error)) AP_send(myAgent, fresh, &error);
+	if (APErrorIsSet(error)) {
+		g_message("Sending failed - %s", error.message->str);
+		APErrorFree(&error);
+		APErrorInit(&error);
+	}
+	else {
+		g_timeout_add(WAIT_TIME, expiryTimeout, myAgent);
+		AP_agentSleep(myAgent);
+	}
+	g_message("Received %d messages and %d expiry failures, expected 2 and 1", expiryDelivered, expiryFailures);
+	
+	g_message("Finishing Agent...");
+	AP_finish(myAgent, &error);
+}
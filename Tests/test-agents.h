@@ -10,12 +10,19 @@
 #define __TESTS_TEST_AGENTS_H__
 
 void bootAgent(char* name);
+void bootBenchmark(int count);
+void containerAgents(int count);
 void AMSModifyAgent(char* name);
 void AMSSearchAgent(char* name);
 void DFRegAgent(char* name);
 void DFModifyAgent(char* name);
 void DFSearchAgent(char* name);
 void agent(char* name);
+void batchAgent(int count);
+void loopBenchmark(int count);
 void serverAgent(char* name);
+void DFSubscribeAgent(char* name);
+void DFBatchAgent(char* name);
+void expiryAgent(char* name);
 
 #endif
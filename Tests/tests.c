@@ -18,10 +18,20 @@
 #include "../platform-defs.h"
 #include "../API/API.h"
 #include "../util.h"
+#include "../Codec/StringCodec.h"
+#include "../Codec/BitEfficientCodec.h"
+#include "../Codec/DBusCodec.h"
+#include "../Codec/compression.h"
+#include "../Codec/sharedContent.h"
+#include "../DF/DF.h"
+#include "../AMS/AMS.h"
+#include "../Snapshot/snapshot.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <glib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 /* test-driver function that calls the appropraite test for the given arguments
  * 
@@ -103,6 +113,43 @@ void runTests(char** argv) {
 		dbus_connection_unref(conn);
 		printf("********* Finished the Print Directory Tests **********\n");
 	}		
+	else if (strcmp(argv[1], "mtsstats") == 0) {
+		printf("********* Running the MTS Statistics Tests **********\n");
+		DBusConnection* conn = getConnection();
+		sendTestMessage(conn, PLATFORM_SERVICE, MTS_SERVICE_PATH, MSG_PRINT_STATS);
+		dbus_connection_unref(conn);
+		printf("********* Finished the MTS Statistics Tests **********\n");
+	}		
+	else if (strcmp(argv[1], "aclstring") == 0) {
+		printf("********* Running the ACL String Representation Tests **********\n");
+		ACLStringTest(argv[2] == NULL ? 100000 : atoi(argv[2]));
+		printf("********* Finished the ACL String Representation Tests **********\n");
+	}
+	else if (strcmp(argv[1], "aclbitefficient") == 0) {
+		printf("********* Running the ACL Bit-Efficient Representation Tests **********\n");
+		ACLBitEfficientTest(argv[2] == NULL ? 100000 : atoi(argv[2]));
+		printf("********* Finished the ACL Bit-Efficient Representation Tests **********\n");
+	}
+	else if (strcmp(argv[1], "aclcompress") == 0) {
+		printf("********* Running the ACL Content Compression Tests **********\n");
+		ACLCompressionTest();
+		printf("********* Finished the ACL Content Compression Tests **********\n");
+	}
+	else if (strcmp(argv[1], "sharedcontent") == 0) {
+		printf("********* Running the Shared Content Tests **********\n");
+		sharedContentTest();
+		printf("********* Finished the Shared Content Tests **********\n");
+	}
+	else if (strcmp(argv[1], "dfparallel") == 0) {
+		printf("********* Running the DF Parallel Search Tests **********\n");
+		DFParallelSearchTest(argv[2] == NULL ? 4 * DF_PARALLEL_SEARCH_THRESHOLD + 1000 : atoi(argv[2]));
+		printf("********* Finished the DF Parallel Search Tests **********\n");
+	}
+	else if (strcmp(argv[1], "snapshotbench") == 0) {
+		printf("********* Running the AMS Snapshot Benchmark **********\n");
+		AMSSnapshotBenchmark(argv[2] == NULL ? 1000000 : atoi(argv[2]));
+		printf("********* Finished the AMS Snapshot Benchmark **********\n");
+	}
 	else if (strcmp(argv[1], "temp") == 0) {
 		GString* str = getMachineName();
 		printf("The host name of this machine is : %s\n", str->str);
@@ -112,6 +159,21 @@ void runTests(char** argv) {
 		bootAgent(argv[2]);
 		printf("********* Finished the boostrap tests **********\n");
 	}		
+	else if (strcmp(argv[1], "bootbench") == 0) {
+		printf("********* Running the bootstrap benchmark **********\n");
+		bootBenchmark(argv[2] == NULL ? 100 : atoi(argv[2]));
+		printf("********* Finished the bootstrap benchmark **********\n");
+	}		
+	else if (strcmp(argv[1], "loopbench") == 0) {
+		printf("********* Running the loop benchmark **********\n");
+		loopBenchmark(argv[2] == NULL ? 100000 : atoi(argv[2]));
+		printf("********* Finished the loop benchmark **********\n");
+	}		
+	else if (strcmp(argv[1], "container") == 0) {
+		printf("********* Running the container tests **********\n");
+		containerAgents(argv[2] == NULL ? 1000 : atoi(argv[2]));
+		printf("********* Finished the container tests **********\n");
+	}		
 	else if (strcmp(argv[1], "amsmod") == 0) {
 		printf("********* Running the AMS modify tests **********\n");
 		AMSModifyAgent("AMSMod");
@@ -137,11 +199,31 @@ void runTests(char** argv) {
 		DFSearchAgent("DFSearcher");
 		printf("********* Finished the DF search tests **********\n");
 	}		
+	else if (strcmp(argv[1], "dfsubscribe") == 0) {
+		printf("********* Running the DF subscribe tests **********\n");
+		DFSubscribeAgent("DFSubscriber");
+		printf("********* Finished the DF subscribe tests **********\n");
+	}
+	else if (strcmp(argv[1], "dfbatch") == 0) {
+		printf("********* Running the DF batch tests **********\n");
+		DFBatchAgent("DFBatcher");
+		printf("********* Finished the DF batch tests **********\n");
+	}
+	else if (strcmp(argv[1], "expiry") == 0) {
+		printf("********* Running the message expiry tests **********\n");
+		expiryAgent("Expiry");
+		printf("********* Finished the message expiry tests **********\n");
+	}
 	else if (strcmp(argv[1], "agent") == 0) {
 		printf("********* Running the Agent **********\n");
 		agent(argv[2]);
 		printf("********* Finished the Agent **********\n");
 	}		
+	else if (strcmp(argv[1], "batch") == 0) {
+		printf("********* Running the batch send Agent **********\n");
+		batchAgent(argv[2] == NULL ? 100 : atoi(argv[2]));
+		printf("********* Finished the batch send Agent **********\n");
+	}		
 	else if (strcmp(argv[1], "server") == 0) {
 		printf("********* Running the server **********\n");
 		serverAgent(argv[2]);
@@ -213,6 +295,266 @@ void AIDTest() {
 	AIDFree(id);	
 }
 
+/* writes a message in the FIPA string representation and reads it back, checking that
+ * nothing is lost, then times writing and reading it the given number of times
+ * 
+ * count - the number of times to write and read the message
+ */
+void ACLStringTest(int count) {
+	if (count <= 0) return;
+	ACLMessage* msg = ACLMessageNew(ACL_REQUEST);
+	AID* sender = g_new(AID, 1);
+	AIDInit(sender);
+	sender->name = g_string_new("sender@platform");
+	GString* address = g_string_new("dbus:ap.agents:/ap/agents/sender");
+	g_array_append_val(sender->addresses, address);
+	ACLMessageSetSender(msg, sender);
+	int i;
+	for (i=0; i<3; i++) {
+		AID* receiver = g_new(AID, 1);
+		AIDInit(receiver);
+		receiver->name = g_string_new("");
+		g_string_printf(receiver->name, "receiver%d@platform", i);
+		ACLMessageAddReceiver(msg, receiver);
+	}
+	ACLMessageSetLanguage(msg, "fipa-sl");
+	ACLMessageSetOntology(msg, "(booking (flights hotels))");
+	ACLMessageSetProtocol(msg, "fipa request");
+	//values that would be read as a parameter name or a variable if written as words
+	ACLMessageSetConversationID(msg, ":1.42");
+	ACLMessageSetInReplyTo(msg, "?booking");
+	ACLMessageSetReplyBy(msg, "20040401T120000000");
+	ACLMessageSetContent(msg, "((action (agent-identifier :name receiver0@platform) (book \"LHR\" \"JFK\")))");
+	
+	//the message read back should write out exactly the same
+	GString* buffer = g_string_sized_new(1024);
+	ACLStringEncode(buffer, msg);
+	g_message("Encoded as %s", buffer->str);
+	ACLMessage* copy = ACLStringDecode(buffer->str, buffer->len);
+	GString* again = g_string_sized_new(1024);
+	if (copy != NULL) ACLStringEncode(again, copy);
+	if (copy != NULL && g_string_equal(buffer, again) && g_string_equal(msg->content, copy->content)
+		&& copy->conversationID != NULL && g_string_equal(msg->conversationID, copy->conversationID)
+		&& copy->inReplyTo != NULL && g_string_equal(msg->inReplyTo, copy->inReplyTo))
+		g_message("Message read back unchanged");
+	else
+		g_message("ERROR: message read back as %s", again->str);
+	if (copy != NULL) {
+		ACLMessageFree(*copy);
+		g_free(copy);
+	}
+	
+	//time writing into the same buffer and reading back
+	GTimer* timer = g_timer_new();
+	for (i=0; i<count; i++) {
+		g_string_truncate(buffer, 0);
+		ACLStringEncode(buffer, msg);
+	}
+	double encodeTime = g_timer_elapsed(timer, NULL);
+	g_timer_start(timer);
+	for (i=0; i<count; i++) {
+		copy = ACLStringDecode(buffer->str, buffer->len);
+		ACLMessageFree(*copy);
+		g_free(copy);
+	}
+	double decodeTime = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+	
+	g_message("%d messages of %lu bytes written in %.2f microseconds each, %.1f MB/s", count,
+		(unsigned long)buffer->len, encodeTime * 1000000 / count, buffer->len * count / encodeTime / 1000000);
+	g_message("%d messages of %lu bytes read in %.2f microseconds each, %.1f MB/s", count,
+		(unsigned long)buffer->len, decodeTime * 1000000 / count, buffer->len * count / decodeTime / 1000000);
+	
+	g_string_free(again, TRUE);
+	g_string_free(buffer, TRUE);
+	ACLMessageFree(*msg);
+	g_free(msg);
+}
+
+/* writes the messages of a conversation in the bit-efficient representation with a code
+ * table and reads them back, reporting the size of the messages with and without the
+ * table and the time taken to write and read them.  Then checks that a message written
+ * with a table the reader has missed part of is refused rather than misread
+ * 
+ * count - the number of messages in the conversation
+ */
+void ACLBitEfficientTest(int count) {
+	if (count <= 0) return;
+	ACLMessage* msg = ACLMessageNew(ACL_INFORM);
+	AID* sender = g_new(AID, 1);
+	AIDInit(sender);
+	sender->name = g_string_new("sender@platform");
+	GString* address = g_string_new("dbus:ap.agents:/ap/agents/sender");
+	g_array_append_val(sender->addresses, address);
+	ACLMessageSetSender(msg, sender);
+	AID* receiver = g_new(AID, 1);
+	AIDInit(receiver);
+	receiver->name = g_string_new("receiver@platform");
+	ACLMessageAddReceiver(msg, receiver);
+	ACLMessageSetLanguage(msg, "fipa-sl");
+	ACLMessageSetOntology(msg, "booking");
+	ACLMessageSetProtocol(msg, "fipa-request");
+	ACLMessageSetConversationID(msg, "conversation-1");
+	ACLMessageSetContent(msg, "((done (book LHR JFK)))");
+	
+	GString* buffer = g_string_sized_new(1024);
+	BitEfficientEncode(buffer, msg, NULL);
+	gsize plain = buffer->len;
+	
+	//the first message fills the table and the rest use it
+	ACLCodeTable* table = ACLCodeTableNew();
+	gsize first = 0;
+	int matched = 0;
+	int i;
+	guint64 codeTable;
+	GTimer* timer = g_timer_new();
+	for (i=0; i<count; i++) {
+		g_string_truncate(buffer, 0);
+		BitEfficientEncode(buffer, msg, table);
+		if (i == 0) first = buffer->len;
+		ACLMessage* copy = BitEfficientDecode((guint8*)buffer->str, buffer->len, &codeTable);
+		if (copy == NULL) continue;
+		if (g_string_equal(copy->content, msg->content) && g_string_equal(copy->sender->name, sender->name)
+			&& g_string_equal(copy->conversationID, msg->conversationID)) matched++;
+		ACLMessageFree(*copy);
+		g_free(copy);
+	}
+	g_timer_stop(timer);
+	
+	g_message("Messages are %lu bytes without a code table, %lu bytes with the first use of one and %lu bytes after",
+		(unsigned long)plain, (unsigned long)first, (unsigned long)buffer->len);
+	g_message("%d of %d messages read back unchanged, %.2f microseconds to write and read each", matched,
+		count, g_timer_elapsed(timer, NULL) * 1000000 / count);
+	
+	//the reader never sees the message that fills the second table, so the next one 
+	//must be refused and the table named so the writer can be told to start again
+	ACLCodeTable* missed = ACLCodeTableNew();
+	g_string_truncate(buffer, 0);
+	BitEfficientEncode(buffer, msg, missed);
+	g_string_truncate(buffer, 0);
+	BitEfficientEncode(buffer, msg, missed);
+	ACLMessage* copy = BitEfficientDecode((guint8*)buffer->str, buffer->len, &codeTable);
+	if (copy == NULL && codeTable == missed->id)
+		g_message("A message written with a table that is out of step was refused");
+	else
+		g_message("ERROR: a message written with a table that is out of step was read");
+	if (copy != NULL) {
+		ACLMessageFree(*copy);
+		g_free(copy);
+	}
+	
+	g_timer_destroy(timer);
+	ACLCodeTableFree(missed);
+	ACLCodeTableFree(table);
+	g_string_free(buffer, TRUE);
+	ACLMessageFree(*msg);
+	g_free(msg);
+}
+
+/* sends a message whose content is over the compression threshold through the DBus 
+ * codec and checks that it arrives compressed and reads back unchanged, then damages 
+ * the compressed content of a second copy and checks that the receiver is told
+ */
+void ACLCompressionTest() {
+	ACLMessage* msg = ACLMessageNew(ACL_INFORM);
+	GString* content = g_string_new("");
+	while (content->len <= COMPRESSION_THRESHOLD * 2) g_string_append(content, "((done (book LHR JFK))) ");
+	ACLMessageSetContent(msg, content->str);
+	
+	DBusMessage* dbusMsg = dbus_message_new_method_call(PLATFORM_SERVICE, MTS_SERVICE_PATH, PLATFORM_SERVICE, MTS_MSG);
+	DBusMessageIter iter;
+	dbus_message_iter_init_append(dbusMsg, &iter);
+	encodeACLMessage(&iter, msg);
+	encodeACLMessage(&iter, msg);
+	
+	dbus_message_iter_init(dbusMsg, &iter);
+	ACLMessage* copy = decodeACLMessage(&iter);
+	ACLMessage* damaged = decodeACLMessage(&iter);
+	gboolean compressed = copy->compressedContent != NULL;
+	
+	APError error;
+	APErrorInit(&error);
+	GString* read = ACLMessageReadContent(copy, &error);
+	g_message("%lu bytes of content were %s and %s", (unsigned long)content->len, 
+		compressed ? "sent compressed" : "not compressed", 
+		!APErrorIsSet(error) && read != NULL && g_string_equal(read, content) ? "read back unchanged" : "were NOT read back");
+	APErrorReInit(&error);
+	
+	//damage everything after the zlib header
+	if (damaged->compressedContent != NULL) 
+		memset(damaged->compressedContent->data + 2, 0xff, damaged->compressedContent->len - 2);
+	read = ACLMessageReadContent(damaged, &error);
+	g_message("Damaged content %s and %s", APErrorIsSet(error) ? "was reported" : "was NOT reported",
+		damaged->compressedContent != NULL ? "kept" : "lost");
+	APErrorFree(&error);
+	
+	freeDecodedPayload(copy);
+	freeDecodedPayload(damaged);
+	dbus_message_unref(dbusMsg);
+	g_string_free(content, TRUE);
+	ACLMessageFree(*msg);
+	g_free(msg);
+}
+
+/* checks that content passed in shared memory is only read when it has been sealed and
+ * is only passed on in shared memory to receivers that have said they can take it, a 
+ * message for any other receiver carries the content itself
+ */
+void sharedContentTest() {
+	GString* content = g_string_new("");
+	while (content->len <= SHARED_CONTENT_THRESHOLD) g_string_append(content, "((done (book LHR JFK))) ");
+	
+	int fd = shareContent(content);
+	gpointer mapping = NULL;
+	gsize length = 0;
+	gboolean mapped = fd >= 0 && mapSharedContent(fd, &mapping, &length);
+	g_message("Sealed content %s", mapped && length == content->len 
+		&& memcmp(mapping, content->str, length) == 0 ? "was read back unchanged" : "could NOT be read");
+	
+	//a file that anybody holding it could still change
+	FILE* file = tmpfile();
+	fwrite(content->str, 1, content->len, file);
+	fflush(file);
+	gpointer unsealedMapping = NULL;
+	gboolean unsealed = mapSharedContent(fileno(file), &unsealedMapping, &length);
+	g_message("Unsealed content %s", unsealed ? "was NOT refused" : "was refused");
+	fclose(file);
+	
+	enableSharedContent(TRUE);
+	GString* marked = g_string_new("dbus:ap.agents.Taker:/ap/agent/msg:msg");
+	GString* unmarked = g_string_new(marked->str);
+	markSharedContentAddress(marked);
+	g_message("A marked address %s and an unmarked one %s shared content", 
+		addressAcceptsSharedContent(marked) ? "takes" : "does NOT take",
+		addressAcceptsSharedContent(unmarked) ? "DOES take" : "does not take");
+	
+	//a message that arrived in shared memory being passed on to a receiver without it
+	if (mapped) {
+		ACLMessage* msg = ACLMessageNew(ACL_INFORM);
+		msg->contentFd = dup(fd);
+		DBusMessage* dbusMsg = dbus_message_new_method_call(PLATFORM_SERVICE, MTS_SERVICE_PATH, PLATFORM_SERVICE, MTS_MSG);
+		DBusMessageIter iter;
+		dbus_message_iter_init_append(dbusMsg, &iter);
+		encodeACLMessageSharing(&iter, msg, addressAcceptsSharedContent(unmarked));
+		dbus_message_iter_init(dbusMsg, &iter);
+		ACLMessage* copy = decodeACLMessage(&iter);
+		GString* read = ACLMessageGetContent(copy);
+		g_message("Content passed on to a receiver without shared memory %s", copy->contentFd < 0 && read != NULL 
+			&& g_string_equal(read, content) ? "was carried in the message" : "was NOT carried in the message");
+		freeDecodedPayload(copy);
+		dbus_message_unref(dbusMsg);
+		ACLMessageFree(*msg);
+		g_free(msg);
+	}
+	enableSharedContent(FALSE);
+	
+	if (mapping != NULL) munmap(mapping, content->len);
+	if (fd >= 0) close(fd);
+	g_string_free(marked, TRUE);
+	g_string_free(unmarked, TRUE);
+	g_string_free(content, TRUE);
+}
+
 /* tests the ACL structure implementation to make sure that it works correctly using
  * the functions offered by the API for manipulating these structures
  */
@@ -286,6 +628,222 @@ void sendTestMessage(DBusConnection* cn_conn, gchar* service, gchar* path, gchar
 /* used to test the search semantics employed by the DF service to ensure that it
  * returns the correct results
  */
+/* searches a registry page by page both on the search pool and on one thread and counts
+ * the pages that differ in their matches or their next cursor
+ * 
+ * template - the search criteria
+ * maxResults - the most matches in each page
+ * pages - incremented by the number of pages searched
+ * returns - the number of pages that differed
+ */
+int compareParallelSearch(AgentDFDescription* template, int maxResults, int* pages) {
+	int differences = 0;
+	int cursor = 0;
+	while (cursor != DF_SEARCH_COMPLETE) {
+		int parallelCursor, sequentialCursor;
+		DF_setParallelSearch(1);
+		GArray* parallel = DF_searchConstrained(template, maxResults, cursor, &parallelCursor, NULL);
+		DF_setParallelSearch(0);
+		GArray* sequential = DF_searchConstrained(template, maxResults, cursor, &sequentialCursor, NULL);
+		
+		gboolean same = parallel->len == sequential->len && parallelCursor == sequentialCursor;
+		int i;
+		for (i=0; same && i<parallel->len; i++) {
+			same = g_array_index(parallel, AgentDFDescription*, i) == g_array_index(sequential, AgentDFDescription*, i);
+		}
+		if (!same) {
+			g_message("ERROR: page at %d of %d gave %d matches and next cursor %d in parallel, %d and %d on one thread",
+				cursor, maxResults, parallel->len, parallelCursor, sequential->len, sequentialCursor);
+			differences++;
+		}
+		
+		(*pages)++;
+		g_array_free(parallel, TRUE);
+		g_array_free(sequential, TRUE);
+		cursor = sequentialCursor;
+	}
+	return differences;
+}
+
+/* fills the DF registry of this process with the given number of entries and checks that
+ * searches shared out between the search pool give exactly the matches and next cursors
+ * that searching on one thread does, for common, rare and missing matches and for pages
+ * of several sizes.  Also reports the time taken by a search of the whole registry each
+ * way.  The platform does not need to be running
+ * 
+ * count - the number of entries, searches are only shared out above 
+ * 	DF_PARALLEL_SEARCH_THRESHOLD entries
+ */
+void DFParallelSearchTest(int count) {
+	GArray* directory = theDF.agentDirectory;
+	theDF.agentDirectory = g_array_new(FALSE, FALSE, sizeof(AgentDFDescription*));
+	DF_setSearchThreads(MAX(g_get_num_processors(), 2));
+	
+	//every third entry speaks fipa-request and a few use a rare ontology, which the last
+	//entry always does so that a match falls in the last chunk
+	int i;
+	for (i=0; i<count; i++) {
+		AgentDFDescription* entry = g_new(AgentDFDescription, 1);
+		AgentDFDescriptionInit(entry);
+		entry->id = g_new(AID, 1);
+		AIDInit(entry->id);
+		entry->id->name = g_string_new("");
+		g_string_printf(entry->id->name, "agent%d@platform", i);
+		DFDescAddLanguage(entry, "fipa-sl");
+		if (i % 3 == 0) DFDescAddProtocol(entry, "fipa-request");
+		if (i % 4999 == 0 || i == count - 1) DFDescAddOntology(entry, "rare");
+		g_array_append_val(theDF.agentDirectory, entry);
+	}
+	
+	AgentDFDescription* templates[3];
+	for (i=0; i<3; i++) {
+		templates[i] = g_new(AgentDFDescription, 1);
+		AgentDFDescriptionInit(templates[i]);
+	}
+	DFDescAddProtocol(templates[0], "fipa-request");
+	DFDescAddOntology(templates[1], "rare");
+	DFDescAddOntology(templates[2], "missing");
+	
+	int pageSizes[] = {DF_SEARCH_UNLIMITED, 1, DF_SEARCH_PAGE_SIZE, DF_PARALLEL_SEARCH_CHUNK + 1};
+	int pages = 0;
+	int differences = 0;
+	int j;
+	for (i=0; i<3; i++) {
+		for (j=0; j<G_N_ELEMENTS(pageSizes); j++) 
+			differences += compareParallelSearch(templates[i], pageSizes[j], &pages);
+	}
+	g_message("%d of %d pages searched in parallel matched the search on one thread", pages - differences, pages);
+	
+	//time a search of the whole registry each way
+	GTimer* timer = g_timer_new();
+	DF_setParallelSearch(DF_PARALLEL_SEARCH_THRESHOLD);
+	GArray* results = DF_search(templates[0], NULL);
+	double parallelTime = g_timer_elapsed(timer, NULL);
+	g_array_free(results, TRUE);
+	DF_setParallelSearch(0);
+	g_timer_start(timer);
+	results = DF_search(templates[0], NULL);
+	double sequentialTime = g_timer_elapsed(timer, NULL);
+	g_array_free(results, TRUE);
+	g_timer_destroy(timer);
+	g_message("Searching %d entries took %.2f ms on %d threads and %.2f ms on one", count, parallelTime * 1000,
+		MAX(g_get_num_processors(), 2), sequentialTime * 1000);
+	
+	DF_setParallelSearch(DF_PARALLEL_SEARCH_THRESHOLD);
+	DF_setSearchThreads(0);
+	for (i=0; i<3; i++) DFDescFree(templates[i]);
+	for (i=0; i<theDF.agentDirectory->len; i++) DFDescFree(g_array_index(theDF.agentDirectory, AgentDFDescription*, i));
+	g_array_free(theDF.agentDirectory, TRUE);
+	theDF.agentDirectory = directory;
+}
+
+//the names looked up by the snapshot benchmark, the lookups each thread makes and the
+//number of threads still reading
+#define SNAPSHOT_BENCH_AGENTS 100000
+static GString** snapshotBenchNames;
+static int snapshotBenchLookups;
+static gint snapshotBenchReaders;
+
+/* looks up names in the published copy of the AMS index the way the reader pool does,
+ * starting from a different name in each thread
+ * 
+ * data - the first name to look up
+ * returns - the number of names found
+ */
+gpointer snapshotBenchReader(gpointer data) {
+	int next = GPOINTER_TO_INT(data);
+	int found = 0;
+	int i;
+	for (i=0; i<snapshotBenchLookups; i++) {
+		int epoch = SnapshotReadBegin();
+		if (AMS_snapshotLookup(AMS_snapshot(), snapshotBenchNames[next]) != NULL) found++;
+		SnapshotReadEnd(epoch);
+		next = (next + 7919) % SNAPSHOT_BENCH_AGENTS;
+	}
+	g_atomic_int_dec_and_test(&snapshotBenchReaders);
+	return GINT_TO_POINTER(found);
+}
+
+/* measures how the rate of lookups in the published copy of the AMS index grows with the
+ * number of threads reading it, from one thread up to one per processor.  While the 
+ * threads read, this thread keeps publishing new copies as the main loop does after 
+ * registrations.  The platform does not need to be running
+ * 
+ * count - the number of lookups each thread makes
+ */
+void AMSSnapshotBenchmark(int count) {
+	GArray* nameIndex = theAMS.nameIndex;
+	GQueue* waitingReads = theAMS.waitingReads;
+	AMSSnapshot* snapshot = theAMS.snapshot;
+	theAMS.nameIndex = g_array_sized_new(FALSE, FALSE, sizeof(AID*), SNAPSHOT_BENCH_AGENTS);
+	theAMS.waitingReads = g_queue_new();
+	theAMS.snapshot = NULL;
+	theAMS.version++;
+	
+	//the names are numbered so that they are added in order
+	snapshotBenchNames = g_new(GString*, SNAPSHOT_BENCH_AGENTS);
+	int i;
+	for (i=0; i<SNAPSHOT_BENCH_AGENTS; i++) {
+		AID* id = g_new(AID, 1);
+		AIDInit(id);
+		id->name = g_string_new("");
+		g_string_printf(id->name, "agent%06d@platform", i);
+		g_array_append_val(theAMS.nameIndex, id);
+		snapshotBenchNames[i] = id->name;
+	}
+	AMS_publish();
+	snapshotBenchLookups = count;
+	
+	int processors = g_get_num_processors();
+	double singleRate = 0;
+	int threads = 1;
+	while (TRUE) {
+		GThread** readers = g_new(GThread*, threads);
+		g_atomic_int_set(&snapshotBenchReaders, threads);
+		GTimer* timer = g_timer_new();
+		for (i=0; i<threads; i++)
+			readers[i] = g_thread_new("snapshot-bench", snapshotBenchReader, GINT_TO_POINTER(i * SNAPSHOT_BENCH_AGENTS / threads));
+		
+		//publish a new copy every millisecond until the readers finish
+		int published = 0;
+		while (g_atomic_int_get(&snapshotBenchReaders) > 0) {
+			theAMS.version++;
+			AMS_publish();
+			SnapshotSynchronize();
+			published++;
+			g_usleep(1000);
+		}
+		
+		int found = 0;
+		for (i=0; i<threads; i++) found += GPOINTER_TO_INT(g_thread_join(readers[i]));
+		double rate = (double)threads * count / g_timer_elapsed(timer, NULL);
+		g_timer_destroy(timer);
+		g_free(readers);
+		
+		if (threads == 1) singleRate = rate;
+		if (found != threads * count)
+			g_message("ERROR: %d of %d lookups on %d threads found their agent", found, threads * count, threads);
+		g_message("%d threads: %.0f lookups per second, %.2f times one thread, %d copies published", 
+			threads, rate, rate / singleRate, published);
+		
+		if (threads == processors) break;
+		threads = MIN(threads * 2, processors);
+	}
+	
+	SnapshotPublish((gpointer*)&theAMS.snapshot, snapshot, freeAMSSnapshot);
+	SnapshotSynchronize();
+	for (i=0; i<theAMS.nameIndex->len; i++) {
+		AID* id = g_array_index(theAMS.nameIndex, AID*, i);
+		AIDFree(*id);
+		g_free(id);
+	}
+	g_array_free(theAMS.nameIndex, TRUE);
+	g_queue_free(theAMS.waitingReads);
+	g_free(snapshotBenchNames);
+	theAMS.nameIndex = nameIndex;
+	theAMS.waitingReads = waitingReads;
+}
+
 void dfSearch() {
 	/***************** THE DATABASE ********************/
 	//build the default entry in the list
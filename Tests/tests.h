@@ -20,6 +20,12 @@ void runTests(char** argv);
 DBusConnection* getConnection();
 
 void AIDTest();
+void ACLStringTest(int count);
+void ACLBitEfficientTest(int count);
+void ACLCompressionTest();
+void sharedContentTest();
+void DFParallelSearchTest(int count);
+void AMSSnapshotBenchmark(int count);
 void ACLTest();
 void sendTestMessage(DBusConnection* cn_conn, gchar* service, gchar* path, gchar* method);
 void dfSearch();
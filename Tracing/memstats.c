@@ -0,0 +1,227 @@
+/****************************************************************************************
+ * Filename:	memstats.c
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Accounting of the memory held by each part of the platform, see memstats.h.  Every
+ * tagged allocation is recorded against its address so that it can be moved between
+ * subsystems and given back when it is freed through AP_FREE or AP_STRING_FREE.  Memory
+ * that is freed some other way stays counted until its address is handed out again.
+ * **************************************************************************************/
+
+#include "memstats.h"
+#include <glib-unix.h>
+#include <signal.h>
+
+//the names the subsystems are printed with
+static const char* subsystemNames[MEM_SUBSYSTEMS] = {"codec", "AMS", "DF", "MTS", "API inbox"};
+
+MemStatsState theMemStats; /* the one and only set of totals and tagged allocations */
+
+/* adds an allocation to the totals of its subsystem, the lock must be held */
+void account(MemRecord* record) {
+	MemTotals* total = &theMemStats.totals[record->subsystem];
+	total->liveBytes += record->size;
+	total->liveObjects++;
+	if (total->liveBytes > total->peakBytes) total->peakBytes = total->liveBytes;
+	if (total->liveObjects > total->peakObjects) total->peakObjects = total->liveObjects;
+}
+
+/* takes an allocation off the totals of its subsystem, the lock must be held */
+void unaccount(MemRecord* record) {
+	MemTotals* total = &theMemStats.totals[record->subsystem];
+	total->liveBytes -= record->size;
+	total->liveObjects--;
+}
+
+/* records an allocation against a subsystem
+ * 
+ * subsystem - the subsystem that made the allocation
+ * mem - the memory allocated
+ * size - the number of bytes allocated
+ * returns - the memory allocated, so that the call can wrap the allocation
+ */
+gpointer MemStatsTag(MemSubsystem subsystem, gpointer mem, gsize size) {
+	if (mem == NULL) return mem;
+	MemRecord* record = g_new(MemRecord, 1);
+	record->subsystem = subsystem;
+	record->size = size;
+
+	g_mutex_lock(&theMemStats.lock);
+	if (theMemStats.records == NULL) theMemStats.records = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+	//the address being handed out again means whatever was recorded there has been freed
+	MemRecord* old = g_hash_table_lookup(theMemStats.records, mem);
+	if (old != NULL) unaccount(old);
+	g_hash_table_insert(theMemStats.records, mem, record);
+	account(record);
+	theMemStats.totals[subsystem].allocations++;
+	g_mutex_unlock(&theMemStats.lock);
+	return mem;
+}
+
+/* records a new string against a subsystem, counting the space reserved for its text
+ * 
+ * subsystem - the subsystem that made the string
+ * string - the string
+ * returns - the string
+ */
+GString* MemStatsTagString(MemSubsystem subsystem, GString* string) {
+	return (GString*)MemStatsTag(subsystem, string, sizeof(GString) + string->allocated_len);
+}
+
+/* forgets an allocation that is about to be freed, anything not tagged is ignored
+ * 
+ * mem - the memory
+ */
+void MemStatsUntag(gconstpointer mem) {
+	if (mem == NULL) return;
+	g_mutex_lock(&theMemStats.lock);
+	if (theMemStats.records != NULL) {
+		MemRecord* record = g_hash_table_lookup(theMemStats.records, mem);
+		if (record != NULL) {
+			unaccount(record);
+			g_hash_table_remove(theMemStats.records, mem);
+		}
+	}
+	g_mutex_unlock(&theMemStats.lock);
+}
+
+/* counts an allocation against a different subsystem, usually the one that now keeps it
+ * 
+ * mem - the memory
+ * subsystem - the subsystem to count it against
+ */
+void MemStatsMove(gconstpointer mem, MemSubsystem subsystem) {
+	if (mem == NULL) return;
+	g_mutex_lock(&theMemStats.lock);
+	if (theMemStats.records != NULL) {
+		MemRecord* record = g_hash_table_lookup(theMemStats.records, mem);
+		if (record != NULL) {
+			unaccount(record);
+			record->subsystem = subsystem;
+			account(record);
+		}
+	}
+	g_mutex_unlock(&theMemStats.lock);
+}
+
+/* calls the given function for an identifier, its name and each of its addresses */
+void forEachAIDPart(AID* id, void (*fn)(gconstpointer, MemSubsystem), MemSubsystem subsystem) {
+	if (id == NULL) return;
+	fn(id, subsystem);
+	fn(id->name, subsystem);
+	int i;
+	for (i=0; i<id->addresses->len; i++) {
+		fn(g_array_index(id->addresses, GString*, i), subsystem);
+	}
+}
+
+/* calls the given function for every identifier in an array and its parts */
+void forEachAIDArrayPart(GArray* ids, void (*fn)(gconstpointer, MemSubsystem), MemSubsystem subsystem) {
+	if (ids == NULL) return;
+	int i;
+	for (i=0; i<ids->len; i++) forEachAIDPart(g_array_index(ids, AID*, i), fn, subsystem);
+}
+
+/* moves an identifier along with its name and addresses
+ * 
+ * id - the identifier
+ * subsystem - the subsystem to count it against
+ */
+void MemStatsMoveAID(AID* id, MemSubsystem subsystem) {
+	forEachAIDPart(id, MemStatsMove, subsystem);
+}
+
+/* calls the given function for every tagged part of an agent message, including every
+ * identifier in the envelope and the payload
+ * 
+ * message - the message
+ * fn - called with each part
+ * subsystem - passed on to the function
+ */
+void forEachPart(AgentMessage* message, void (*fn)(gconstpointer, MemSubsystem),
+	MemSubsystem subsystem) {
+	if (message == NULL) return;
+	fn(message, subsystem);
+
+	ACLEnvelope* envelope = message->envelope;
+	if (envelope != NULL) {
+		fn(envelope, subsystem);
+		fn(envelope->aclRepresentation, subsystem);
+		forEachAIDPart(envelope->from, fn, subsystem);
+		forEachAIDArrayPart(envelope->to, fn, subsystem);
+		forEachAIDPart(envelope->intendedReceiver, fn, subsystem);
+	}
+
+	ACLMessage* payload = message->payload;
+	if (payload != NULL) {
+		GString* strings[] = {payload->performative, payload->language, payload->encoding,
+			payload->ontology, payload->protocol, payload->conversationID, payload->replyWith,
+			payload->inReplyTo, payload->replyBy, payload->content};
+		int i;
+		fn(payload, subsystem);
+		for (i=0; i<G_N_ELEMENTS(strings); i++) fn(strings[i], subsystem);
+		forEachAIDPart(payload->sender, fn, subsystem);
+		forEachAIDArrayPart(payload->receivers, fn, subsystem);
+		forEachAIDArrayPart(payload->replyTo, fn, subsystem);
+	}
+}
+
+/* untags a single part of a message, the subsystem is not used */
+void untagPart(gconstpointer mem, MemSubsystem subsystem) {
+	MemStatsUntag(mem);
+}
+
+/* moves an agent message along with its envelope, payload and their strings
+ * 
+ * message - the message
+ * subsystem - the subsystem to count it against
+ */
+void MemStatsMoveAgentMessage(AgentMessage* message, MemSubsystem subsystem) {
+	forEachPart(message, MemStatsMove, subsystem);
+}
+
+/* stops counting an agent message against any subsystem, used when the message is handed
+ * on to somebody who does not free it through the accounting macros
+ * 
+ * message - the message
+ */
+void MemStatsUntagAgentMessage(AgentMessage* message) {
+	forEachPart(message, untagPart, MEM_CODEC);
+}
+
+/* outputs the live and high-water bytes and objects of each subsystem to the log
+ */
+void MemStatsPrint() {
+#ifdef AP_MEMORY_ACCOUNTING
+	g_mutex_lock(&theMemStats.lock);
+	int i;
+	for (i=0; i<MEM_SUBSYSTEMS; i++) {
+		MemTotals* total = &theMemStats.totals[i];
+		g_message("MEMORY: %s - %lu bytes in %lu objects live, peak %lu bytes in %lu objects, %lu allocations",
+			subsystemNames[i], (unsigned long)total->liveBytes, (unsigned long)total->liveObjects,
+			(unsigned long)total->peakBytes, (unsigned long)total->peakObjects,
+			(unsigned long)total->allocations);
+	}
+	g_mutex_unlock(&theMemStats.lock);
+#else
+	g_message("MEMORY: accounting is not compiled in, build with -DAP_MEMORY_ACCOUNTING");
+#endif
+}
+
+/* called from the main loop when the process has been sent SIGUSR1 */
+gboolean dumpOnSignal(gpointer data) {
+	MemStatsPrint();
+	return TRUE;
+}
+
+/* makes the process print its memory accounting whenever it is sent SIGUSR1, it only
+ * needs to be called once per process but calling it again does no harm.  The dump is
+ * made from the main loop rather than the signal handler
+ */
+void MemStatsInstallDump() {
+	if (theMemStats.dumpInstalled) return;
+	theMemStats.dumpInstalled = TRUE;
+	g_unix_signal_add(SIGUSR1, dumpOnSignal, NULL);
+}
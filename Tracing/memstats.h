@@ -0,0 +1,100 @@
+/****************************************************************************************
+ * Filename:	memstats.h
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Opt in accounting of the memory held by each part of the platform.  Allocations made
+ * through the AP_NEW and AP_STRING_NEW macros are tagged with the subsystem that made
+ * them, and objects can be moved to the subsystem that keeps them, such as an identifier
+ * decoded by the codec that is then held in the AMS directory.  Live bytes and objects
+ * and their high-water marks are printed with the MTS statistics and whenever the
+ * process is sent SIGUSR1.  Build with -DAP_MEMORY_ACCOUNTING to turn it on, otherwise
+ * the macros are the plain GLib calls.
+ * **************************************************************************************/
+
+#ifndef __TRACING_MEMSTATS_H__
+#define __TRACING_MEMSTATS_H__
+
+#include <glib.h>
+#include "../platform-defs.h"
+
+typedef enum {
+	MEM_CODEC,
+	MEM_AMS,
+	MEM_DF,
+	MEM_MTS,
+	MEM_INBOX,
+	MEM_SUBSYSTEMS
+} MemSubsystem;
+
+/* what is known about a single tagged allocation */
+struct stMemRecord {
+	MemSubsystem subsystem;
+	gsize size;
+};
+typedef struct stMemRecord MemRecord;
+
+/* the running totals for one subsystem */
+struct stMemTotals {
+	gsize liveBytes;
+	gsize liveObjects;
+	gsize peakBytes;
+	gsize peakObjects;
+	gsize allocations;
+};
+typedef struct stMemTotals MemTotals;
+
+/* the totals of every subsystem and the tagged allocations by address, both guarded by
+ * the lock, and whether the dump on SIGUSR1 has been installed */
+struct stMemStatsState {
+	MemTotals totals[MEM_SUBSYSTEMS];
+	GHashTable* records;
+	GMutex lock;
+	gboolean dumpInstalled;
+};
+typedef struct stMemStatsState MemStatsState;
+extern MemStatsState theMemStats;
+
+gpointer MemStatsTag(MemSubsystem subsystem, gpointer mem, gsize size);
+GString* MemStatsTagString(MemSubsystem subsystem, GString* string);
+void MemStatsUntag(gconstpointer mem);
+void MemStatsMove(gconstpointer mem, MemSubsystem subsystem);
+void MemStatsMoveAID(AID* id, MemSubsystem subsystem);
+void MemStatsMoveAgentMessage(AgentMessage* message, MemSubsystem subsystem);
+void MemStatsUntagAgentMessage(AgentMessage* message);
+void MemStatsPrint();
+void MemStatsInstallDump();
+
+#ifdef AP_MEMORY_ACCOUNTING
+
+#define AP_NEW(subsystem, type, count) \
+	((type*)MemStatsTag(subsystem, g_new(type, count), sizeof(type) * (count)))
+#define AP_NEW0(subsystem, type, count) \
+	((type*)MemStatsTag(subsystem, g_new0(type, count), sizeof(type) * (count)))
+#define AP_STRING_NEW(subsystem, init) MemStatsTagString(subsystem, g_string_new(init))
+#define AP_FREE(mem) (MemStatsUntag(mem), g_free(mem))
+#define AP_STRING_FREE(string, freeSegment) (MemStatsUntag(string), g_string_free(string, freeSegment))
+#define AP_MEM_MOVE(mem, subsystem) MemStatsMove(mem, subsystem)
+#define AP_MEM_MOVE_AID(id, subsystem) MemStatsMoveAID(id, subsystem)
+#define AP_MEM_MOVE_MESSAGE(message, subsystem) MemStatsMoveAgentMessage(message, subsystem)
+#define AP_MEM_UNTAG_MESSAGE(message) MemStatsUntagAgentMessage(message)
+#define AP_MEM_PRINT() MemStatsPrint()
+#define AP_MEM_INSTALL_DUMP() MemStatsInstallDump()
+
+#else
+
+#define AP_NEW(subsystem, type, count) g_new(type, count)
+#define AP_NEW0(subsystem, type, count) g_new0(type, count)
+#define AP_STRING_NEW(subsystem, init) g_string_new(init)
+#define AP_FREE(mem) g_free(mem)
+#define AP_STRING_FREE(string, freeSegment) g_string_free(string, freeSegment)
+#define AP_MEM_MOVE(mem, subsystem) do {} while (0)
+#define AP_MEM_MOVE_AID(id, subsystem) do {} while (0)
+#define AP_MEM_MOVE_MESSAGE(message, subsystem) do {} while (0)
+#define AP_MEM_UNTAG_MESSAGE(message) do {} while (0)
+#define AP_MEM_PRINT() do {} while (0)
+#define AP_MEM_INSTALL_DUMP() do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,33 @@
+/****************************************************************************************
+ * Filename:	probes.h
+ * Author:		Craig Paton
+ * Date:			Apr 2004
+ * 
+ * Static tracepoints (USDT) placed on the hot paths of the platform so that a running
+ * platform can be profiled with perf or bpftrace without rebuilding it or turning on
+ * logging.  When sys/sdt.h is available each probe compiles to a single nop that only
+ * becomes active when a tracer attaches, otherwise the macros compile away entirely.
+ * All probes live in the "agentplatform" provider, see the .bt scripts in this
+ * directory for examples of their use.
+ * **************************************************************************************/
+
+#ifndef __TRACING_PROBES_H__
+#define __TRACING_PROBES_H__
+
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define AP_PROBE(name) DTRACE_PROBE(agentplatform, name)
+#define AP_PROBE1(name, a) DTRACE_PROBE1(agentplatform, name, a)
+#define AP_PROBE2(name, a, b) DTRACE_PROBE2(agentplatform, name, a, b)
+
+#else
+
+#define AP_PROBE(name) do {} while (0)
+#define AP_PROBE1(name, a) do {} while (0)
+#define AP_PROBE2(name, a, b) do {} while (0)
+
+#endif
+
+#endif
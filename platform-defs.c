@@ -10,6 +10,9 @@
 
 #include "platform-defs.h"
 #include "API/API.h"
+#include "Tracing/memstats.h"
+#include <sys/mman.h>
+#include <unistd.h>
 
 /* initialises the platform description strucutre that is maintained by the AMS when
  * the platform is bootstrapped
@@ -22,6 +25,23 @@ void InitPlatformDescription(PlatformDescription* desc) {
 	desc->services = g_array_new(FALSE, FALSE, sizeof(PlatformServiceDescription*));
 }
 
+/* frees a platform description along with the descriptions of its services
+ * 
+ * desc - the description to free
+ */
+void FreePlatformDescription(PlatformDescription* desc) {
+	if (desc->name != NULL) g_string_free(desc->name, TRUE);
+	int i;
+	for (i=0; i<desc->services->len; i++) {
+		PlatformServiceDescription* service = g_array_index(desc->services, PlatformServiceDescription*, i);
+		if (service->name != NULL) g_string_free(service->name, TRUE);
+		if (service->address != NULL) g_string_free(service->address, TRUE);
+		g_free(service);
+	}
+	g_array_free(desc->services, TRUE);
+	g_free(desc);
+}
+
 /* initialises a DF service description structure
  * 
  * desc - DF description object to be initialised which must have been previously allocated
@@ -64,7 +84,15 @@ void AgentConfigurationInit(AgentConfiguration* config) {
 	config->DFEntry = g_new(AgentDFDescription,1);
 	AgentDFDescriptionInit(config->DFEntry);
 	config->conversationIDCounter = 0;
+	config->expiredMessages = 0;
 	config->callbackFunction = NULL;
+	config->DFNotificationFunction = NULL;
+	config->identifierCache = NULL;
+	config->workerPool = NULL;
+	config->aclRepresentation = NULL;
+	config->codeTable = NULL;
+	config->codeTableGeneration = 0;
+	config->container = NULL;
 }
 
 //setter functions
@@ -93,6 +121,10 @@ void ACLMessageInit(ACLMessage* msg) {
 	msg->receivers = g_array_new(FALSE, FALSE, sizeof(AID*));
 	msg->replyTo = g_array_new(FALSE, FALSE, sizeof(AID*));
 	msg->content = NULL;
+	msg->compressedContent = NULL;
+	msg->contentFd = -1;
+	msg->contentMapping = NULL;
+	msg->contentLength = 0;
 	msg->language = NULL;
 	msg->encoding = NULL;
 	msg->ontology = NULL;
@@ -114,16 +146,19 @@ void ACLMessageFree(ACLMessage msg) {
 	if (msg.sender !=  NULL) AIDFree(*msg.sender);
 	
 	//free all of the strings
-	if (msg.performative !=  NULL) g_string_free(msg.performative, TRUE);
-	if (msg.content !=  NULL) g_string_free(msg.content, TRUE);
-	if (msg.language !=  NULL) g_string_free(msg.language, TRUE);
-	if (msg.encoding !=  NULL) g_string_free(msg.encoding, TRUE);
-	if (msg.ontology !=  NULL) g_string_free(msg.ontology, TRUE);
-	if (msg.protocol !=  NULL) g_string_free(msg.protocol, TRUE);
-	if (msg.conversationID !=  NULL) g_string_free(msg.conversationID, TRUE);
-	if (msg.replyWith !=  NULL) g_string_free(msg.replyWith, TRUE);
-	if (msg.inReplyTo !=  NULL) g_string_free(msg.inReplyTo, TRUE);
-	if (msg.replyBy !=  NULL) g_string_free(msg.replyBy, TRUE);
+	if (msg.performative !=  NULL) AP_STRING_FREE(msg.performative, TRUE);
+	if (msg.content !=  NULL) AP_STRING_FREE(msg.content, TRUE);
+	if (msg.compressedContent !=  NULL) g_byte_array_free(msg.compressedContent, TRUE);
+	if (msg.contentMapping != NULL) munmap(msg.contentMapping, msg.contentLength);
+	if (msg.contentFd >= 0) close(msg.contentFd);
+	if (msg.language !=  NULL) AP_STRING_FREE(msg.language, TRUE);
+	if (msg.encoding !=  NULL) AP_STRING_FREE(msg.encoding, TRUE);
+	if (msg.ontology !=  NULL) AP_STRING_FREE(msg.ontology, TRUE);
+	if (msg.protocol !=  NULL) AP_STRING_FREE(msg.protocol, TRUE);
+	if (msg.conversationID !=  NULL) AP_STRING_FREE(msg.conversationID, TRUE);
+	if (msg.replyWith !=  NULL) AP_STRING_FREE(msg.replyWith, TRUE);
+	if (msg.inReplyTo !=  NULL) AP_STRING_FREE(msg.inReplyTo, TRUE);
+	if (msg.replyBy !=  NULL) AP_STRING_FREE(msg.replyBy, TRUE);
 }
 
 /* initiailises a envelope that is used by the interaction layer for transporting messages
@@ -136,6 +171,8 @@ void ACLEnvelopeInit(ACLEnvelope* envelope) {
 	envelope->from = NULL;
 	envelope->aclRepresentation = NULL;
 	envelope->intendedReceiver = NULL;
+	envelope->priority = ACL_PRIORITY_NORMAL;
+	envelope->deadline = 0;
 }
 
 /* initialises and agent message structure that is used for all agent messages sent to
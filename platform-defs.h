@@ -11,6 +11,7 @@
 
 #include <glib.h>
 #include <dbus/dbus.h>
+#include <stdio.h>
 
 /******************************************************************************
  * ******************** SERVICE DECLARATIONS ************************
@@ -43,8 +44,13 @@ static const char* MESSAGE_PATH_ARRAY[] = {"ap", "msg", NULL};
 #define MANAGEMENT_PATH "/ap/management"
 static const char* MANAGEMENT_PATH_ARRAY[] = {"ap", "management", NULL};
 
+#define CONTAINER_PATH "/ap/agents"
+static const char* CONTAINER_PATH_ARRAY[] = {"ap", "agents", NULL};
+
 #define DBUS_PROTOCOL_NAME "dbus"
 #define DBUS_ACL_REPRESENTATION "dbus-acl"
+#define FIPA_STRING_REPRESENTATION "fipa.acl.rep.string.std"
+#define BIT_EFFICIENT_REPRESENTATION "fipa.acl.rep.bitefficient.std"
 
 /***************************************************************************************
  * ************* AGENT IDENTIFIER STRUCTURE ********************************
@@ -135,17 +141,30 @@ struct stACLMessage {
 	GString* inReplyTo;
 	GString* replyBy;
 	GString* content;		
+	GByteArray* compressedContent;
+	int contentFd;
+	gpointer contentMapping;
+	gsize contentLength;
 };
 typedef struct stACLMessage ACLMessage;
 void ACLMessageInit(ACLMessage* msg);
 void ACLMessageFree(ACLMessage msg);
 
+//priorities that can be given to a message in its envelope, the MTS delivers messages
+//of a higher priority ahead of those of a lower one
+#define ACL_PRIORITY_BULK 0
+#define ACL_PRIORITY_NORMAL 1
+#define ACL_PRIORITY_CONTROL 2
+#define ACL_PRIORITY_LEVELS 3
+
 //define the structre that will be used to represent the FIPA Enevelope
 struct FIPAACLEnvelope {
 	GArray* to;
 	AID* from;
 	GString* aclRepresentation;
 	AID* intendedReceiver;
+	int priority;
+	gint64 deadline;
 } ;
 typedef struct FIPAACLEnvelope ACLEnvelope;
 void ACLEnvelopeInit(ACLEnvelope* envelope);
@@ -157,8 +176,75 @@ struct stAgentMessage {
 typedef struct stAgentMessage AgentMessage;
 void AgentMessageInit(AgentMessage* message);
 
+//the number of strings held in a code table of the bit-efficient representation
+#define ACL_CODE_TABLE_SIZE 1024
+
+//how the identifier of a code table is written when it is sent on its own
+#define ACL_CODE_TABLE_ID_FORMAT "%016" G_GINT64_MODIFIER "x"
+
+/* the dynamic code table of the bit-efficient representation, kept by the encoder at one
+ * end of a hop and by the decoder at the other.  Both put every new string in the next 
+ * slot, taking the slots in turn, so they stay in step as long as every message is read
+ * in the order it was written.  Only the encoder uses the lookup, only the decoder uses
+ * recent, its place among the tables ordered by when they were last read with */
+struct stACLCodeTable {
+	guint64 id;
+	GString** entries;
+	GHashTable* lookup;
+	int next;
+	GMutex lock;
+	GList* recent;
+};
+typedef struct stACLCodeTable ACLCodeTable;
+
 typedef void (*MessageReceiver)(void*, AgentMessage*);
 
+/* called when the DF pushes a change to an entry matching one of the agents subscriptions,
+ * passed the agent, the subscription identifier, the event and the entry concerned
+ */
+typedef void (*DFNotificationReceiver)(void*, int, GString*, AgentDFDescription*);
+
+/* called with each page of results as a streamed DF search arrives, passed the agent and
+ * the entries in the page
+ */
+typedef void (*DFSearchResultReceiver)(void*, GArray*);
+
+/* cache of identifiers resolved through the AMS, ordered by how recently they were used.
+ * The lock is held for every use as callbacks on worker threads search the cache while
+ * the thread dispatching messages removes the agents the AMS announces have changed */
+struct stAIDCache {
+	GHashTable* entries;
+	GQueue* order;
+	int maxEntries;
+	int timeToLive;
+	int hits;
+	int misses;
+	GMutex lock;
+};
+typedef struct stAIDCache AIDCache;
+
+/* threads that run an agents message callbacks, every message of a conversation is given
+ * to the same worker so that a conversation is handled in the order it arrived */
+struct stWorkerPool {
+	GThread** workers;
+	GAsyncQueue** queues;
+	int size;
+	int maxInFlight;
+	int inFlight;
+	GMutex lock;
+	GCond slotFree;
+};
+typedef struct stWorkerPool WorkerPool;
+
+/* the acknowledgement of a delivery from the MTS, sent once every message in the delivery
+ * has been handled so that an agent with slow callbacks holds the MTS back */
+struct stWorkerAck {
+	DBusConnection* connection;
+	DBusMessage* reply;
+	gint remaining;
+};
+typedef struct stWorkerAck WorkerAck;
+
 /***************************************************************************************
  * ********************* AGENT CONFIGURATION*********************************
  * **************************************************************************************/
@@ -175,8 +261,16 @@ struct stAgentConfig{
 	GString* platformName;
 	AgentDFDescription* DFEntry;
 	int conversationIDCounter;
+	int expiredMessages;
 	MessageReceiver callbackFunction;
 	//void (*callbackFn) (void*, AgentMessage*);
+	DFNotificationReceiver DFNotificationFunction;
+	AIDCache* identifierCache;
+	WorkerPool* workerPool;
+	GString* aclRepresentation;
+	ACLCodeTable* codeTable;
+	int codeTableGeneration;
+	struct stAgentContainer* container;
 };
 typedef struct stAgentConfig AgentConfiguration;
 void AgentConfigurationInit(AgentConfiguration* config);
@@ -184,6 +278,15 @@ void AgentConfigurationSetID(AgentConfiguration* config, AID* id);
 void AgentConfigurationSetMainLoop(AgentConfiguration* config, GMainLoop* loop);
 void AgentConfigurationSetConnection(AgentConfiguration* config, DBusConnection* conn);
 void AgentConfigurationSetBaseService(AgentConfiguration* config, gchar* service);
+
+/* hosts many agents in one process on one connection and one service name, messages 
+ * are passed to the agents by the object path they were sent to */
+struct stAgentContainer {
+	AgentConfiguration* configuration;
+	GString* serviceName;
+	GHashTable* agents;
+};
+typedef struct stAgentContainer AgentContainer;
  
 /***************************************************************************************
  * ********************* PLATFORM DESCRIPTION********************************
@@ -201,13 +304,46 @@ struct stPlatformDescription {
 };
 typedef struct stPlatformDescription PlatformDescription;
 void InitPlatformDescription(PlatformDescription* desc);
+void FreePlatformDescription(PlatformDescription* desc);
 
 /***************************************************************************************
  * ***************************************** MTS **************************************
  * **************************************************************************************/
+/* the messages the MTS has delivered to a receiver that the receiver has not yet 
+ * acknowledged.  Once the high watermark is reached the receiver is saturated and
+ * messages to it are refused until it has caught up to the low watermark */
+struct stMTSReceiver {
+	int outstanding;
+	gboolean saturated;
+	int refused;
+};
+typedef struct stMTSReceiver MTSReceiver;
+
+#define MTS_HIGH_WATERMARK 256
+#define MTS_LOW_WATERMARK 64
+
+//messages for the same receiver that arrive within this many milliseconds of each other
+//are delivered together, up to the limit in one call
+#define MTS_COALESCE_WINDOW 2
+#define MTS_COALESCE_LIMIT 64
+
 struct stMTSConfig {
 	AgentConfiguration* configuration;
 	PlatformServiceDescription* description;
+	GHashTable* receivers;
+	GHashTable* codeTables;
+	int highWatermark;
+	int lowWatermark;
+	GQueue* lanes[ACL_PRIORITY_LEVELS];
+	guint laneSource;
+	GHashTable* deliveries;
+	guint deliverySource;
+	int coalesceWindow;
+	int coalesceLimit;
+	int delivered;
+	int refused;
+	int expired;
+	int unacknowledged;
 };
 typedef struct stMTSConfig MTSConfiguration;
 extern MTSConfiguration theMTS;
@@ -215,32 +351,101 @@ extern MTSConfiguration theMTS;
 /***************************************************************************************
  * ********************************** DF ***********************************************
  * **************************************************************************************/
+//an unchanging copy of the registry that searches made away from the main loop thread
+//read, generation is that of the registry when it was copied
+struct stDFSnapshot {
+	guint generation;
+	GArray* entries;
+};
+typedef struct stDFSnapshot DFSnapshot;
+
 struct stDFConfig {
 	AgentConfiguration* configuration;
 	PlatformServiceDescription* description;
 	GArray* agentDirectory;
+	GArray* subscriptions;
+	int subscriptionCounter;
+	guint generation;
+	GHashTable* searchCache;
+	guint cacheGeneration;
+	int cacheHits;
+	int cacheMisses;
+	GThreadPool* searchPool;
+	int parallelThreshold;
+	DFSnapshot* snapshot;
+	guint publishSource;
+	GThreadPool* readerPool;
+	GQueue* waitingSearches;
 };
 typedef struct stDFConfig DFConfiguration;
 extern DFConfiguration theDF;
 
+//a standing search of the DF made by an agent which is told of any changes to the
+//entries matching the template
+struct stDFSubscription {
+	int id;
+	AID* subscriber;
+	GString* address;
+	AgentDFDescription* template;
+};
+typedef struct stDFSubscription DFSubscription;
+
+//one of the operations carried in a batch request to the DF, operation is one of 
+//MSG_DF_REGISTER, MSG_DF_MODIFY or MSG_DF_DEREGISTER and status is filled in with the
+//result once the batch has been applied
+struct stDFBatchOperation {
+	GString* operation;
+	AgentDFDescription* entry;
+	GString* status;
+};
+typedef struct stDFBatchOperation DFBatchOperation;
+
 /***************************************************************************************
  * ********************************** AMS *********************************************
  * **************************************************************************************/
+//an unchanging copy of the name index that searches made away from the main loop thread
+//read, version is that of the directory when it was copied
+struct stAMSSnapshot {
+	guint version;
+	GArray* nameIndex;
+};
+typedef struct stAMSSnapshot AMSSnapshot;
+
 struct stAMSConfig {
 	AgentConfiguration* configuration;
 	GArray* agentDirectory;
+	GArray* nameIndex;
 	PlatformServiceDescription* description;
 	PlatformDescription* platformDescription;
+	DBusMessage* descriptionReply;
+	guint version;
+	AMSSnapshot* snapshot;
+	guint publishSource;
+	GThreadPool* readerPool;
+	GQueue* waitingReads;
+	GHashTable* restoredNames;
 };
 typedef struct stAMSConfig AMSConfiguration;
 extern AMSConfiguration theAMS;
 
+/***************************************************************************************
+ * ********************************* STORE ********************************************
+ * **************************************************************************************/
+struct stStoreConfig {
+	GString* directory;
+	FILE* journal;
+	int journalRecords;
+};
+typedef struct stStoreConfig StoreConfiguration;
+extern StoreConfiguration theStore;
+
 /***************************************************************************************
  * ********************** THE PLATFORM *******************************************
  * **************************************************************************************/
 struct stPlatform {
 	GString* name;
 	GString* service;
+	struct stEpollLoop* epollLoop; //set when the platform runs on the epoll loop
 };
 typedef struct stPlatform Platform;
 extern Platform thePlatform;
@@ -258,6 +463,7 @@ extern Platform thePlatform;
 #define MSG_PING "ping"
 #define MSG_TERMINATE "terminate"
 #define MSG_PRINT_AGENT_DIRECTORY "printDirectory"
+#define MSG_PRINT_STATS "printStats"
 
 //AMS specific
 #define MSG_GET_DESCRIPTION "getDescription"
@@ -265,18 +471,69 @@ extern Platform thePlatform;
 #define MSG_AMS_DEREGISTER "deregister"
 #define MSG_AMS_MODIFY "modify"
 #define MSG_AMS_SEARCH "search"
+#define MSG_AMS_SEARCH_BATCH "searchBatch"
+#define MSG_AMS_SEARCH_PATTERN "searchPattern"
+
+//signal emitted by the AMS when an agent is modified or leaves the platform
+#define SIGNAL_AMS_AGENT_CHANGED "agentChanged"
+#define AMS_EVENT_MODIFIED "modified"
+#define AMS_EVENT_DEREGISTERED "deregistered"
 
 //DF specific
 #define MSG_DF_REGISTER "register"
 #define MSG_DF_DEREGISTER "deregister"
 #define MSG_DF_MODIFY "modify"
 #define MSG_DF_SEARCH "search"
+#define MSG_DF_SUBSCRIBE ACL_SUBSCRIBE
+#define MSG_DF_CANCEL ACL_CANCEL
+#define MSG_DF_BATCH "batch"
+
+//search constraints, a cursor of DF_SEARCH_COMPLETE means there are no more pages
+#define DF_SEARCH_UNLIMITED -1
+#define DF_SEARCH_COMPLETE -1
+#define DF_SEARCH_PAGE_SIZE 100
+
+//number of search replies the DF keeps before its cache is emptied
+#define DF_CACHE_SIZE 128
+
+//searches with at least this many entries to look at are shared out between a pool of
+//threads, a chunk of entries at a time
+#define DF_PARALLEL_SEARCH_THRESHOLD 8192
+#define DF_PARALLEL_SEARCH_CHUNK 2048
+
+//sent by the DF to subscribed agents
+#define MSG_DF_NOTIFY "dfNotify"
+
+//events reported to the subscribers of the DF
+#define DF_EVENT_REGISTERED "registered"
+#define DF_EVENT_MODIFIED "modified"
+#define DF_EVENT_DEREGISTERED "deregistered"
 
 //MTS specific
 #define MTS_MSG "agentMessage"
+#define MTS_MSG_BATCH "agentMessages"
+
+//content of the failure sent back to the sender of a message refused by the MTS
+#define MTS_RECEIVER_SATURATED "receiver-saturated"
+#define MTS_MESSAGE_EXPIRED "message-expired"
+#define MTS_CODE_TABLE_UNKNOWN "code-table-unknown"
+
+//sent by the MTS to an agent whose messages were written with a code table the MTS does
+//not have, and the error an agent answers a delivery with when it is sent one
+#define MSG_CODE_TABLE_RESET "codeTableReset"
+#define ERROR_NAME_CODE_TABLE PLATFORM_SERVICE ".CodeTableUnknown"
 
 //time to wait for a reply
 #define WAIT_TIME 5000
 
+//files used to persist the AMS and DF directories between runs of the platform, they are
+//created in the directory given by AP_STORE_DIRECTORY or the working directory
+#define STORE_DIRECTORY_VARIABLE "AP_STORE_DIRECTORY"
+#define STORE_JOURNAL_FILE "directory.journal"
+#define STORE_SNAPSHOT_FILE "directory.snapshot"
+
+//number of journal records written before the journal is folded into a new snapshot
+#define STORE_COMPACT_THRESHOLD 4096
+
 
 #endif
@@ -9,6 +9,8 @@
 
 #include "util.h"
 #include <stdio.h>
+#include <time.h>
+#include <string.h>
 #include "platform-defs.h"
 
 /* sets the default log handler for all messages written by the entire platform and API
@@ -76,3 +78,51 @@ void appendStringArray(GString** str, GArray* array) {
 	g_string_sprintfa((*str), "%s", temp->str);
 	g_string_free(temp, TRUE);
 }
+
+/* converts a FIPA date time, such as the reply-by of an ACL message, into milliseconds
+ * since the epoch.  The format is YYYYMMDDTHHMMSSsss where the milliseconds are optional
+ * and a trailing Z means the time is in UTC rather than local time.  A leading + or - 
+ * makes the value an offset of that many years, months, days and so on from now
+ * 
+ * value - the date time to convert
+ * returns - the time in milliseconds, 0 if the value is not a valid date time
+ */
+gint64 parseFIPADateTime(const char* value) {
+	if (value == NULL) return 0;
+	int sign = 0;
+	if (value[0] == '+' || value[0] == '-') {
+		sign = value[0] == '+' ? 1 : -1;
+		value++;
+	}
+	
+	struct tm time;
+	int millis = 0;
+	memset(&time, 0, sizeof(struct tm));
+	int read = sscanf(value, "%4d%2d%2dT%2d%2d%2d%3d", &time.tm_year, &time.tm_mon, &time.tm_mday, 
+		&time.tm_hour, &time.tm_min, &time.tm_sec, &millis);
+	if (read < 6) return 0;
+	
+	//the months and years of an offset are calendar ones so GLib adds them on
+	if (sign != 0) {
+		GDateTime* now = g_date_time_new_now_local();
+		GDateTime* then = g_date_time_add_full(now, sign * time.tm_year, sign * time.tm_mon, 
+			sign * time.tm_mday, sign * time.tm_hour, sign * time.tm_min, sign * (time.tm_sec + millis / 1000.0));
+		gint64 result = g_date_time_to_unix(then) * 1000 + g_date_time_get_microsecond(then) / 1000;
+		g_date_time_unref(then);
+		g_date_time_unref(now);
+		return result;
+	}
+	
+	time.tm_year -= 1900;
+	time.tm_mon -= 1;
+	time.tm_isdst = -1;
+	
+	time_t seconds = strchr(value, 'Z') != NULL ? timegm(&time) : mktime(&time);
+	if (seconds == (time_t)-1) return 0;
+	return (gint64)seconds * 1000 + millis;
+}
+
+/* returns - the current time in milliseconds since the epoch */
+gint64 currentTimeMillis() {
+	return g_get_real_time() / 1000;
+}
@@ -11,5 +11,7 @@ void myLogHandler(const gchar *domain, GLogLevelFlags level, const gchar* msg,
 GString* getMachineName();
 GString* stringArrayToString(GArray* array);
 void appendStringArray(GString** str, GArray* array);
+gint64 parseFIPADateTime(const char* value);
+gint64 currentTimeMillis();
 
 #endif